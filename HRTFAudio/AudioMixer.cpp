@@ -3,65 +3,339 @@
 #include "AudioMixer.h"
 #include "AudioSource.h"
 #include "AudioPlayer.h"
-#include "kissfft/kiss_fft.h"
+#include "AudioMixerKernels.h"
+#include "kissfft/kiss_fftr.h"
 #include "miniz/miniz.h"
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 #include <stdexcept>
 #include <map>
 #include <string>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <deque>
+#ifndef WIN32
+#include <semaphore.h>
+#include <cerrno>
+#endif
 
 class AudioMixerImpl;
 
+// Sample memory comes in size classes four to an octave. Freed blocks are kept for reuse, up to a limit, so that
+// loading the sounds of the next map mostly reuses the memory of the last one. Used by the game thread and the sound loader.
+class SamplePool
+{
+public:
+	~SamplePool()
+	{
+		for (std::vector<uint8_t*>& list : freelists)
+		{
+			for (uint8_t* block : list)
+				delete[] block;
+		}
+	}
+
+	uint8_t* Alloc(size_t size, size_t& capacity)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		size_t index = GetClassIndex(size);
+		capacity = GetClassSize(index);
+		BytesInUse += capacity;
+
+		if (index < freelists.size() && !freelists[index].empty())
+		{
+			uint8_t* block = freelists[index].back();
+			freelists[index].pop_back();
+			BytesPooled -= capacity;
+			return block;
+		}
+		return new uint8_t[capacity];
+	}
+
+	void Free(uint8_t* block, size_t capacity)
+	{
+		if (!block)
+			return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		BytesInUse -= capacity;
+		if (BytesPooled + capacity <= MaxPooledBytes)
+		{
+			size_t index = GetClassIndex(capacity);
+			if (index >= freelists.size())
+				freelists.resize(index + 1);
+			freelists[index].push_back(block);
+			BytesPooled += capacity;
+		}
+		else
+		{
+			delete[] block;
+		}
+	}
+
+	void GetUsage(size_t& inuse, size_t& pooled)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		inuse = BytesInUse;
+		pooled = BytesPooled;
+	}
+
+private:
+	static size_t GetClassSize(size_t index)
+	{
+		return ((4 + (index & 3)) << (index >> 2)) * MinUnit;
+	}
+
+	static size_t GetClassIndex(size_t size)
+	{
+		size_t index = 0;
+		while (GetClassSize(index) < size)
+			index++;
+		return index;
+	}
+
+	static const size_t MinUnit = 1024; // The smallest class is four of these
+	static const size_t MaxPooledBytes = 32 * 1024 * 1024;
+
+	std::mutex mutex;
+	std::vector<std::vector<uint8_t*>> freelists;
+	size_t BytesInUse = 0;
+	size_t BytesPooled = 0;
+};
+
+// Fixed size sample array in pooled memory
+class SampleBuffer
+{
+public:
+	SampleBuffer() = default;
+
+	~SampleBuffer()
+	{
+		if (pool)
+			pool->Free(block, capacity);
+	}
+
+	void alloc(SamplePool* newpool, size_t newcount, size_t bytesPerSample)
+	{
+		if (pool)
+			pool->Free(block, capacity);
+		pool = newpool;
+		count = newcount;
+
+		// The AVX2 kernels read integer samples 32 bits at a time
+		block = pool->Alloc(count * bytesPerSample + sizeof(int32_t), capacity);
+		memset(block + count * bytesPerSample, 0, sizeof(int32_t));
+	}
+
+	void* data() { return block; }
+	const void* data() const { return block; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t bytes() const { return capacity; }
+
+	// Shortens the array. The memory stays reserved.
+	void shrink(size_t newcount) { count = std::min(count, newcount); }
+
+private:
+	SampleBuffer(const SampleBuffer&) = delete;
+	SampleBuffer& operator=(const SampleBuffer&) = delete;
+
+	SamplePool* pool = nullptr;
+	uint8_t* block = nullptr;
+	size_t capacity = 0;
+	size_t count = 0;
+};
+
+// Samples are kept in the bit depth and rate they were loaded with. The mixer converts them as it plays them.
+// The constructor only checks the format. Load decodes the samples, usually on a SoundLoader thread.
 class AudioSound
 {
 public:
-	AudioSound(int mixing_frequency, std::unique_ptr<AudioSource> source, const AudioLoopInfo& inloopinfo) : loopinfo(inloopinfo)
+	AudioSound(SamplePool* pool, int mixing_frequency, std::unique_ptr<AudioSource> insource, const AudioLoopInfo& inloopinfo) : loopinfo(inloopinfo), pool(pool), mixing_frequency(mixing_frequency), source(std::move(insource))
 	{
 		duration = samples.size() / 44100.0f;
 
-		if (source->GetChannels() == 1)
-		{
-			uint64_t oldSampleCount = source->GetSamples();
-			if (source->GetFrequency() != mixing_frequency)
-			{
-				source = AudioSource::CreateResampler(mixing_frequency, std::move(source));
-			}
+		if (source->GetChannels() != 1)
+			throw std::runtime_error("Only mono sounds are supported");
+	}
 
-			samples.resize(source->GetSamples());
-			samples.resize(source->ReadSamples(samples.data(), samples.size()));
+	void Load()
+	{
+		try
+		{
+			frequency = source->GetFrequency();
+			rate = (double)frequency / mixing_frequency;
 
-			// Remove any audio pops at end of the sound that the resampler might have created
-			if (samples.size() >= 16)
+			size_t count = std::max(source->GetSamples(), 0);
+			int bits = source->GetBitsPerSample();
+			if (bits <= 8)
 			{
-				for (size_t i = 1; i < 16; i++)
+				// 8 bit data is read as 16 bit with the low byte zero
+				format = MixSampleS8;
+				samples.alloc(pool, count, sizeof(int8_t));
+				int8_t* dest = (int8_t*)samples.data();
+				int16_t buffer[1024];
+				size_t pos = 0;
+				while (pos < count)
 				{
-					float t = i / 16.0f;
-					size_t pos = samples.size() - i;
-					samples[pos] = samples[pos] * t;
+					size_t read = source->ReadSamples(buffer, std::min(count - pos, (size_t)1024));
+					for (size_t i = 0; i < read; i++)
+						dest[pos + i] = (int8_t)(buffer[i] >> 8);
+					pos += read;
+					if (read == 0)
+						break;
 				}
+				samples.shrink(pos);
+			}
+			else if (bits <= 16)
+			{
+				format = MixSampleS16;
+				samples.alloc(pool, count, sizeof(int16_t));
+				samples.shrink(source->ReadSamples((int16_t*)samples.data(), count));
+			}
+			else
+			{
+				format = MixSampleFloat;
+				samples.alloc(pool, count, sizeof(float));
+				samples.shrink(source->ReadSamples((float*)samples.data(), count));
 			}
 
-			if (oldSampleCount > 0)
+			if (!samples.empty())
 			{
-				uint64_t newSampleCount = samples.size();
-				loopinfo.LoopStart = std::max(std::min(loopinfo.LoopStart * newSampleCount / oldSampleCount, newSampleCount - 1), (uint64_t)0);
-				loopinfo.LoopEnd = std::max(std::min(loopinfo.LoopEnd * newSampleCount / oldSampleCount, newSampleCount), (uint64_t)0);
+				uint64_t sampleCount = samples.size();
+				loopinfo.LoopStart = std::min(loopinfo.LoopStart, sampleCount - 1);
+				loopinfo.LoopEnd = std::min(loopinfo.LoopEnd, sampleCount);
 			}
 			else
 			{
 				loopinfo = {};
 			}
 		}
-		else
+		catch (const std::exception&)
 		{
-			throw std::runtime_error("Only mono sounds are supported");
+			// Plays as silence
+			samples.shrink(0);
+			loopinfo = {};
 		}
+
+		source.reset();
+		loaded.store(true, std::memory_order_release);
+	}
+
+	// The samples, format and rate may only be looked at once this returns true
+	bool IsLoaded() const
+	{
+		return loaded.load(std::memory_order_acquire);
 	}
 
-	std::vector<float> samples;
+	SampleBuffer samples;
+	MixSampleFormat format = MixSampleFloat;
+	int frequency = 44100;
+	double rate = 1.0; // Source samples per mixed sample at a pitch of one
 	float duration = 0.0f;
 	AudioLoopInfo loopinfo;
+	int refcount = 1; // Held by the game and by every play command until the mixer thread reports the sound stopped
+
+private:
+	SamplePool* pool = nullptr;
+	int mixing_frequency = 44100;
+	std::unique_ptr<AudioSource> source;
+	std::atomic<bool> loaded{ false };
+};
+
+// Decodes sounds on worker threads so that registering the sounds of a level doesn't wait for each one in turn
+class SoundLoader
+{
+public:
+	SoundLoader()
+	{
+		int count = std::max(std::min((int)std::thread::hardware_concurrency() - 1, 4), 1);
+		for (int i = 0; i < count; i++)
+			workers.push_back(std::thread([this]() { WorkerMain(); }));
+	}
+
+	~SoundLoader()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+		queue.clear();
+		lock.unlock();
+		condition.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	void Add(AudioSound* sound)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		queue.push_back(sound);
+		pending++;
+		lock.unlock();
+		condition.notify_one();
+	}
+
+	// Makes sure no worker is or will be loading the sound, so that it can be destroyed
+	void Cancel(AudioSound* sound)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto it = std::find(queue.begin(), queue.end(), sound);
+		if (it != queue.end())
+		{
+			queue.erase(it);
+			pending--;
+			return;
+		}
+
+		// A worker is decoding it. Workers notify after every load.
+		loadedCondition.wait(lock, [&]() { return sound->IsLoaded(); });
+	}
+
+	void GetStats(double& seconds, int& count)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		seconds = loadSeconds;
+		count = pending;
+	}
+
+private:
+	SoundLoader(const SoundLoader&) = delete;
+	SoundLoader& operator=(const SoundLoader&) = delete;
+
+	void WorkerMain()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			condition.wait(lock, [&]() { return stop || !queue.empty(); });
+			if (stop)
+				break;
+
+			AudioSound* sound = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			auto loadStart = std::chrono::steady_clock::now();
+			sound->Load();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+			lock.lock();
+			loadSeconds += seconds;
+			pending--;
+			loadedCondition.notify_all();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::condition_variable loadedCondition;
+	std::deque<AudioSound*> queue;
+	bool stop = false;
+	double loadSeconds = 0.0;
+	int pending = 0; // Queued or being loaded
 };
 
 class HRTFAudioChannel;
@@ -83,223 +357,68 @@ public:
 	double pos = 0;
 	HRTFAudioChannel* prevHrtfChannel = nullptr;
 	HRTFAudioChannel* curHrtfChannel = nullptr;
+	HRTFAudioChannel* nextHrtfChannel = nullptr;
+	kiss_fft_cpx* leftHRTF = nullptr;
+	kiss_fft_cpx* rightHRTF = nullptr;
 
+	// Sounds still loading wait at their start
 	bool SoundEnded() const
 	{
-		return pos >= (double)sound->samples.size();
+		return sound->IsLoaded() && pos >= (double)sound->samples.size();
 	}
 
-	bool MixInto(kiss_fft_cpx* outputOld, kiss_fft_cpx* outputNew, size_t samples)
+	bool MixInto(float* outputOld, float* outputNew, size_t samples)
 	{
-		if (SoundEnded())
-			return false;
-
-		const float* src = sound->samples.data();
-		double srcpos = pos;
-		double srcpitch = pitch;
-		int srcsize = (int)sound->samples.size();
-		int srcmax = srcsize - 1;
-		if (srcmax < 0)
+		if (!sound->IsLoaded())
+			return true;
+		if (SoundEnded() || sound->samples.empty())
 			return false;
 
-		float vol = volume;
+		const MixKernels& kernels = MixKernels::Get();
 		float rcpSamples = 1.0f / samples;
-
-		if (sound->loopinfo.Looped)
+		float buffer[MixChunkSize];
+		for (size_t i = 0; i < samples; i += MixChunkSize)
 		{
-			double loopStart = (double)sound->loopinfo.LoopStart;
-			double loopEnd = (double)sound->loopinfo.LoopEnd;
-			double loopLen = loopEnd - loopStart;
-
-			for (size_t i = 0; i < samples; i++)
-			{
-				double p0 = srcpos;
-				double p1 = srcpos + 1;
-				if (p0 >= loopEnd) p0 -= loopLen;
-				if (p1 >= loopEnd) p1 -= loopLen;
-
-				int pos = (int)p0;
-				int pos2 = (int)p1;
-				float t = (float)(p0 - pos);
-
-				pos = std::min(pos, srcmax);
-				pos2 = std::min(pos2, srcmax);
-
-				float value = (src[pos] * t + src[pos2] * (1.0f - t)) * vol;
-				float tt = i * rcpSamples;
-				outputOld[i].r += value * (1.0f - tt);
-				outputNew[i].r += value * tt;
-
-				srcpos += srcpitch;
-				while (srcpos >= loopEnd)
-					srcpos -= loopLen;
-			}
-
-			pos = srcpos;
-			return true;
+			size_t count = std::min(samples - i, (size_t)MixChunkSize);
+			Resample(buffer, count);
+			kernels.MixCrossfade(outputOld + i, outputNew + i, buffer, volume, i, rcpSamples, count);
 		}
-		else
-		{
-			for (size_t i = 0; i < samples; i++)
-			{
-				int pos = (int)srcpos;
-				int pos2 = pos + 1;
-				float t = (float)(srcpos - pos);
-
-				pos = std::min(pos, srcmax);
-				pos2 = std::min(pos2, srcmax);
-
-				float value = (src[pos] * t + src[pos2] * (1.0f - t)) * vol;
-				float tt = i * rcpSamples;
-				outputOld[i].r += value * (1.0f - tt);
-				outputNew[i].r += value * tt;
 
-				srcpos += srcpitch;
-			}
-
-			pos = srcpos;
-			return pos < (double)sound->samples.size();
-		}
+		return sound->loopinfo.Looped || pos < (double)sound->samples.size();
 	}
 
-	bool MixInto(kiss_fft_cpx* output, size_t samples)
+	bool MixInto(float* output, size_t samples)
 	{
-		if (SoundEnded())
-			return false;
-
-		const float* src = sound->samples.data();
-		double srcpos = pos;
-		double srcpitch = pitch;
-		int srcsize = (int)sound->samples.size();
-		int srcmax = srcsize - 1;
-		if (srcmax < 0)
+		if (!sound->IsLoaded())
+			return true;
+		if (SoundEnded() || sound->samples.empty())
 			return false;
 
-		float vol = volume;
-
-		if (sound->loopinfo.Looped)
+		const MixKernels& kernels = MixKernels::Get();
+		float buffer[MixChunkSize];
+		for (size_t i = 0; i < samples; i += MixChunkSize)
 		{
-			double loopStart = (double)sound->loopinfo.LoopStart;
-			double loopEnd = (double)sound->loopinfo.LoopEnd;
-			double loopLen = loopEnd - loopStart;
-
-			for (size_t i = 0; i < samples; i++)
-			{
-				double p0 = srcpos;
-				double p1 = srcpos + 1;
-				if (p0 >= loopEnd) p0 -= loopLen;
-				if (p1 >= loopEnd) p1 -= loopLen;
-
-				int pos = (int)p0;
-				int pos2 = (int)p1;
-				float t = (float)(p0 - pos);
-
-				pos = std::min(pos, srcmax);
-				pos2 = std::min(pos2, srcmax);
-
-				float value = (src[pos] * t + src[pos2] * (1.0f - t));
-				output[i].r += value * vol;
-
-				srcpos += srcpitch;
-				while (srcpos >= loopEnd)
-					srcpos -= loopLen;
-			}
-
-			pos = srcpos;
-			return true;
+			size_t count = std::min(samples - i, (size_t)MixChunkSize);
+			Resample(buffer, count);
+			kernels.MixMono(output + i, buffer, volume, count);
 		}
-		else
-		{
-			for (size_t i = 0; i < samples; i++)
-			{
-				int pos = (int)srcpos;
-				int pos2 = pos + 1;
-				float t = (float)(srcpos - pos);
-
-				pos = std::min(pos, srcmax);
-				pos2 = std::min(pos2, srcmax);
-
-				float value = (src[pos] * t + src[pos2] * (1.0f - t));
-				output[i].r += value * vol;
 
-				srcpos += srcpitch;
-			}
-
-			pos = srcpos;
-			return pos < (double)sound->samples.size();
-		}
+		return sound->loopinfo.Looped || pos < (double)sound->samples.size();
 	}
 
 	bool MixInto(float* output, size_t samples, float globalvolume)
 	{
-		const float* src = sound->samples.data();
-		double srcpos = pos;
-		double srcpitch = pitch;
-		int srcsize = (int)sound->samples.size();
-		int srcmax = srcsize - 1;
-		if (srcmax < 0)
+		if (!sound->IsLoaded())
+			return true;
+		if (sound->samples.empty())
 			return false;
 
 		float leftVolume, rightVolume;
 		GetVolume(leftVolume, rightVolume, globalvolume);
 
-		if (sound->loopinfo.Looped)
-		{
-			double loopStart = (double)sound->loopinfo.LoopStart;
-			double loopEnd = (double)sound->loopinfo.LoopEnd;
-			double loopLen = loopEnd - loopStart;
-
-			for (size_t i = 0; i < samples; i++)
-			{
-				double p0 = srcpos;
-				double p1 = srcpos + 1;
-				if (p0 >= loopEnd) p0 -= loopLen;
-				if (p1 >= loopEnd) p1 -= loopLen;
-
-				int pos = (int)p0;
-				int pos2 = (int)p1;
-				float t = (float)(p0 - pos);
-
-				pos = std::min(pos, srcmax);
-				pos2 = std::min(pos2, srcmax);
-
-				float value = (src[pos] * t + src[pos2] * (1.0f - t));
-				output[i << 1] += value * leftVolume;
-				output[(i << 1) + 1] += value * rightVolume;
-
-				srcpos += srcpitch;
-				while (srcpos >= loopEnd)
-					srcpos -= loopLen;
-			}
-
-			pos = srcpos;
-			return true;
-		}
-		else
+		if (!sound->loopinfo.Looped && leftVolume <= 0.0f && rightVolume <= 0.0f)
 		{
-			if (leftVolume > 0.0f || rightVolume > 0.0f)
-			{
-				for (size_t i = 0; i < samples; i++)
-				{
-					int pos = (int)srcpos;
-					int pos2 = pos + 1;
-					float t = (float)(srcpos - pos);
-
-					pos = std::min(pos, srcmax);
-					pos2 = std::min(pos2, srcmax);
-
-					float value = (src[pos] * t + src[pos2] * (1.0f - t));
-					output[i << 1] += value * leftVolume;
-					output[(i << 1) + 1] += value * rightVolume;
-
-					srcpos += srcpitch;
-				}
-			}
-			else
-			{
-				srcpos += srcpitch * samples;
-			}
-
+			double srcpos = pos + pitch * sound->rate * samples;
 			if (srcpos < sound->samples.size())
 			{
 				pos = srcpos;
@@ -310,6 +429,17 @@ public:
 				return false;
 			}
 		}
+
+		const MixKernels& kernels = MixKernels::Get();
+		float buffer[MixChunkSize];
+		for (size_t i = 0; i < samples; i += MixChunkSize)
+		{
+			size_t count = std::min(samples - i, (size_t)MixChunkSize);
+			Resample(buffer, count);
+			kernels.MixStereo(output + (i << 1), buffer, leftVolume, rightVolume, count);
+		}
+
+		return sound->loopinfo.Looped || pos < (double)sound->samples.size();
 	}
 
 	void GetVolume(float& leftVolume, float& rightVolume, float globalvolume)
@@ -318,6 +448,22 @@ public:
 		leftVolume = clamp(volume * std::min(1.0f - pan, 1.0f) * globalvolume, 0.0f, 1.0f);
 		rightVolume = clamp(volume * std::min(1.0f + pan, 1.0f) * globalvolume, 0.0f, 1.0f);
 	}
+
+private:
+	static const size_t MixChunkSize = 256;
+
+	// Linear interpolation of the next count samples at the current pitch, converted to float at the mixing rate
+	void Resample(float* dest, size_t count)
+	{
+		const MixKernels& kernels = MixKernels::Get();
+		const void* src = sound->samples.data();
+		int srcmax = (int)sound->samples.size() - 1;
+		double step = pitch * sound->rate;
+		if (sound->loopinfo.Looped)
+			pos = kernels.ResampleLooped(sound->format, dest, src, srcmax, pos, step, (double)sound->loopinfo.LoopEnd, (double)(sound->loopinfo.LoopEnd - sound->loopinfo.LoopStart), count);
+		else
+			pos = kernels.Resample[sound->format](dest, src, srcmax, pos, step, count);
+	}
 };
 
 class ZipFileStream
@@ -394,7 +540,7 @@ private:
 class HRTF_Direction
 {
 public:
-	void load(std::unique_ptr<ZipFileStream> file)
+	void load(std::unique_ptr<ZipFileStream> file, kiss_fftr_cfg cfg, int blocksize, int partitions)
 	{
 		uint32_t ChunkID = file->read_uint32(); // "RIFF"
 		uint32_t ChunkSize = file->read_uint32();
@@ -424,37 +570,38 @@ public:
 		file.reset();
 
 		size_t size = samples.size() / 2;
-		if (size > 128)
+		if (size > max_taps)
 			throw std::runtime_error("Invalid HRTF file");
 
-		std::vector<kiss_fft_cpx> left(nfft);
-		std::vector<kiss_fft_cpx> right(nfft);
-		memset(left.data(), 0, left.size() * sizeof(kiss_fft_cpx));
-		memset(right.data(), 0, right.size() * sizeof(kiss_fft_cpx));
+		std::vector<float> left(blocksize * partitions, 0.0f);
+		std::vector<float> right(blocksize * partitions, 0.0f);
 
 		for (size_t i = 0; i < size; i++)
 		{
-			left[i].r = samples[i << 1] * (1.0f / 32768.0f);
-			right[i].r = samples[(i << 1) + 1] * (1.0f / 32768.0f);
+			left[i] = samples[i << 1] * (1.0f / 32768.0f);
+			right[i] = samples[(i << 1) + 1] * (1.0f / 32768.0f);
 		}
 
-		left_freq = transform_channel(left);
-		right_freq = transform_channel(right);
+		left_freq = transform_channel(left, cfg, blocksize, partitions);
+		right_freq = transform_channel(right, cfg, blocksize, partitions);
 	}
 
-	std::vector<kiss_fft_cpx> transform_channel(const std::vector<kiss_fft_cpx>& samples)
+	// Splits the impulse response into blocksize long partitions. Each is zero padded to twice its length and transformed.
+	// The impulse responses are real, so only the first blocksize+1 bins of their conjugate symmetric spectra are kept.
+	std::vector<kiss_fft_cpx> transform_channel(const std::vector<float>& samples, kiss_fftr_cfg cfg, int blocksize, int partitions)
 	{
-		std::vector<kiss_fft_cpx> freq(samples.size());
-		memset(freq.data(), 0, freq.size() * sizeof(kiss_fft_cpx));
-
-		kiss_fft_cfg cfg = kiss_fft_alloc((int)samples.size(), 0, nullptr, nullptr);
-		kiss_fft(cfg, samples.data(), freq.data());
-		kiss_fft_free(cfg);
-
+		size_t nbins = blocksize + 1;
+		std::vector<kiss_fft_cpx> freq(nbins * partitions);
+		std::vector<float> padded(blocksize * 2, 0.0f);
+		for (int i = 0; i < partitions; i++)
+		{
+			memcpy(padded.data(), samples.data() + i * blocksize, blocksize * sizeof(float));
+			kiss_fftr(cfg, padded.data(), freq.data() + i * nbins);
+		}
 		return freq;
 	}
 
-	static const int nfft = 1024;
+	static const size_t max_taps = 128;
 
 	std::vector<kiss_fft_cpx> left_freq;
 	std::vector<kiss_fft_cpx> right_freq;
@@ -463,8 +610,10 @@ public:
 class HRTF_Data
 {
 public:
-	HRTF_Data(ZipReader* zip)
+	HRTF_Data(ZipReader* zip, int blocksize) : blocksize(blocksize), nfft(blocksize * 2), nbins(blocksize + 1), partitions(((int)HRTF_Direction::max_taps + blocksize - 1) / blocksize)
 	{
+		kiss_fftr_cfg cfg = kiss_fftr_alloc(nfft, 0, nullptr, nullptr);
+
 		data.resize(N_ELEV);
 		for (int el_index = 0; el_index < N_ELEV; el_index++)
 		{
@@ -472,18 +621,11 @@ public:
 			data[el_index].resize(nfaz);
 			for (int az_index = 0; az_index < nfaz; az_index++)
 			{
-				data[el_index][az_index].load(zip->read_file(hrtf_name(el_index, az_index)));
+				data[el_index][az_index].load(zip->read_file(hrtf_name(el_index, az_index)), cfg, blocksize, partitions);
 			}
 		}
 
-		cfg_forward = kiss_fft_alloc(HRTF_Direction::nfft, 0, nullptr, nullptr);
-		cfg_inverse = kiss_fft_alloc(HRTF_Direction::nfft, 1, nullptr, nullptr);
-	}
-
-	~HRTF_Data()
-	{
-		kiss_fft_free(cfg_forward);
-		kiss_fft_free(cfg_inverse);
+		kiss_fftr_free(cfg);
 	}
 
 	// Get the closest HRTF to the specified elevation and azimuth in degrees
@@ -508,8 +650,11 @@ public:
 		}
 	}
 
-	kiss_fft_cfg cfg_forward;
-	kiss_fft_cfg cfg_inverse;
+	// The convolution runs in blocks of blocksize samples using FFTs of twice that size
+	const int blocksize;
+	const int nfft;
+	const int nbins;
+	const int partitions;
 
 private:
 	// Return the number of azimuths actually stored in file system
@@ -596,52 +741,79 @@ private:
 
 int HRTF_Data::elev_data[N_ELEV] = { 56, 60, 72, 72, 72, 72, 72, 60, 56, 45, 36, 24, 12, 1 };
 
+// Uniformly partitioned overlap-save convolution. Each block of input is transformed once into a frequency-domain
+// delay line and convolved with every impulse response partition, so the latency is one block no matter the filter length.
 class HRTFAudioChannel
 {
 public:
-	HRTFAudioChannel(kiss_fft_cpx* leftHRTF, kiss_fft_cpx* rightHRTF, HRTF_Data* hrtf) : leftHRTF(leftHRTF), rightHRTF(rightHRTF), hrtf(hrtf)
+	HRTFAudioChannel(HRTF_Data* hrtf) : hrtf(hrtf)
 	{
 		kiss_fft_cpx zero;
 		zero.i = 0.0f;
 		zero.r = 0.0f;
-		left.resize(HRTF_Direction::nfft, 0.0f);
-		right.resize(HRTF_Direction::nfft, 0.0f);
-		samples_buf.resize(HRTF_Direction::nfft, zero);
-		time_buf.resize(HRTF_Direction::nfft, zero);
-		freq_buf.resize(HRTF_Direction::nfft, zero);
-		workspace_buf.resize(HRTF_Direction::nfft, zero);
+		left.resize(hrtf->nfft, 0.0f);
+		right.resize(hrtf->nfft, 0.0f);
+		samples_buf.resize(hrtf->nfft, 0.0f);
+		delay_line.resize(hrtf->nbins * hrtf->partitions, zero);
+		workspace_buf.resize(hrtf->nbins, zero);
+
+		// kiss_fftr configs have scratch space, so each channel needs its own to run on any thread
+		cfg_forward = kiss_fftr_alloc(hrtf->nfft, 0, nullptr, nullptr);
+		cfg_inverse = kiss_fftr_alloc(hrtf->nfft, 1, nullptr, nullptr);
+	}
+
+	~HRTFAudioChannel()
+	{
+		kiss_fftr_free(cfg_forward);
+		kiss_fftr_free(cfg_inverse);
+	}
+
+	// Points the channel at a new direction. Nothing of the previous direction is carried over.
+	void Bind(kiss_fft_cpx* left, kiss_fft_cpx* right, const float* dir)
+	{
+		leftHRTF = left;
+		rightHRTF = right;
+		direction[0] = dir[0];
+		direction[1] = dir[1];
+		direction[2] = dir[2];
+
+		memset(samples_buf.data(), 0, samples_buf.size() * sizeof(float));
+		memset(delay_line.data(), 0, delay_line.size() * sizeof(kiss_fft_cpx));
+		delay_pos = 0;
+	}
+
+	void Unbind()
+	{
+		leftHRTF = nullptr;
+		rightHRTF = nullptr;
 	}
 
+	bool IsBound() const { return leftHRTF != nullptr; }
+
 	void MixInto(float* output)
 	{
-		size_t samples = HRTF_Direction::nfft / 2;
-		size_t quarter = HRTF_Direction::nfft / 4;
-		const float* l = left.data() + quarter;
-		const float* r = right.data() + quarter;
-		for (size_t i = 0; i < samples; i++)
-		{
-			*(output++) += *(l++);
-			*(output++) += *(r++);
-		}
+		size_t samples = hrtf->blocksize;
+		MixKernels::Get().AddStereo(output, left.data() + samples, right.data() + samples, samples);
 	}
 
 	void BeginFrame()
 	{
-		size_t half = HRTF_Direction::nfft / 2;
-		memmove(samples_buf.data(), samples_buf.data() + half, half * sizeof(kiss_fft_cpx));
-		memset(samples_buf.data() + half, 0, half * sizeof(kiss_fft_cpx));
+		size_t half = hrtf->blocksize;
+		memmove(samples_buf.data(), samples_buf.data() + half, half * sizeof(float));
+		memset(samples_buf.data() + half, 0, half * sizeof(float));
 	}
 
-	kiss_fft_cpx* GetBuffer()
+	float* GetBuffer()
 	{
-		size_t half = HRTF_Direction::nfft / 2;
+		size_t half = hrtf->blocksize;
 		return samples_buf.data() + half;
 	}
 
 	void EndFrame()
 	{
-		time_buf = samples_buf;
-		kiss_fft(hrtf->cfg_forward, time_buf.data(), freq_buf.data());
+		// Newest spectrum goes in front of the previous ones, overwriting the oldest
+		delay_pos = (delay_pos + hrtf->partitions - 1) % hrtf->partitions;
+		kiss_fftr(cfg_forward, samples_buf.data(), delay_line.data() + delay_pos * hrtf->nbins);
 
 		ApplyHRTF(left.data(), leftHRTF);
 		ApplyHRTF(right.data(), rightHRTF);
@@ -649,55 +821,167 @@ public:
 
 	kiss_fft_cpx* leftHRTF = nullptr;
 	kiss_fft_cpx* rightHRTF = nullptr;
+	float direction[3] = { 0.0f, 0.0f, 1.0f };
+	bool used = false;
 	std::vector<ActiveSound*> sounds;
 
 private:
 	HRTFAudioChannel(const HRTFAudioChannel&) = delete;
 	HRTFAudioChannel& operator=(const HRTFAudioChannel&) = delete;
 
-	std::vector<kiss_fft_cpx> samples_buf, time_buf, freq_buf, workspace_buf;
+	std::vector<float> samples_buf;
+	std::vector<kiss_fft_cpx> delay_line, workspace_buf;
 	std::vector<float> left, right;
+	int delay_pos = 0;
+	kiss_fftr_cfg cfg_forward = nullptr;
+	kiss_fftr_cfg cfg_inverse = nullptr;
 
-	static kiss_fft_cpx CMul(const kiss_fft_cpx& a, const kiss_fft_cpx& b)
+	void ApplyHRTF(float* samples, kiss_fft_cpx* hrtf)
 	{
-		kiss_fft_cpx c;
-		c.r = a.r * b.r - a.i * b.i;
-		c.i = a.i * b.r + a.r * b.i;
-		return c;
+		// Partition k of the impulse response applies to the input block from k blocks ago.
+		// The spectra are half spectra. The mirrored upper half is implied by kiss_fftri.
+		const MixKernels& kernels = MixKernels::Get();
+		size_t nbins = this->hrtf->nbins;
+		int partitions = this->hrtf->partitions;
+		memset(workspace_buf.data(), 0, nbins * sizeof(kiss_fft_cpx));
+		for (int k = 0; k < partitions; k++)
+		{
+			int slot = (delay_pos + k) % partitions;
+			kernels.ComplexMultiplyAdd(delay_line.data() + slot * nbins, hrtf + k * nbins, workspace_buf.data(), nbins);
+		}
+		kiss_fftri(cfg_inverse, workspace_buf.data(), samples);
+
+		// Only the second half is free of circular wrap-around
+		size_t blocksize = this->hrtf->blocksize;
+		float rcp_nfft = 1.0f / this->hrtf->nfft;
+		for (size_t i = blocksize; i < blocksize * 2; i++)
+			samples[i] *= rcp_nfft;
 	}
 
-	// Optimized multiply of two conjugate symmetric arrays (c = a * b)
-	static void COptMul(const kiss_fft_cpx* a, const kiss_fft_cpx* b, kiss_fft_cpx* c, size_t count)
+	static float clamp(float v, float minval, float maxval)
 	{
-		size_t half = count >> 1;
-		for (size_t i = 0; i <= half; i++)
-		{
-			c[i] = CMul(a[i], b[i]);
-		}
-		for (size_t i = 1; i < half; i++)
+		return std::max(std::min(v, maxval), minval);
+	}
+
+	HRTF_Data* hrtf = nullptr;
+};
+
+// Counting semaphore the mixer thread can release without taking a lock
+class WorkerSemaphore
+{
+public:
+#ifdef WIN32
+	WorkerSemaphore() { handle = CreateSemaphore(nullptr, 0, 0x7fffffff, nullptr); }
+	~WorkerSemaphore() { CloseHandle(handle); }
+	void Release(int count) { ReleaseSemaphore(handle, count, nullptr); }
+	void Acquire() { WaitForSingleObject(handle, INFINITE); }
+#else
+	WorkerSemaphore() { sem_init(&handle, 0, 0); }
+	~WorkerSemaphore() { sem_destroy(&handle); }
+	void Release(int count) { for (int i = 0; i < count; i++) sem_post(&handle); }
+	void Acquire() { while (sem_wait(&handle) != 0 && errno == EINTR) { } }
+#endif
+
+private:
+	WorkerSemaphore(const WorkerSemaphore&) = delete;
+	WorkerSemaphore& operator=(const WorkerSemaphore&) = delete;
+
+#ifdef WIN32
+	HANDLE handle;
+#else
+	sem_t handle;
+#endif
+};
+
+// Runs HRTFAudioChannel::EndFrame for many channels at once on a few worker threads, with the mixer thread taking part.
+// The mixer thread never blocks on a lock, sleeps or allocates here. Workers are woken through a semaphore, and the
+// mixer thread processes every channel no worker has claimed yet. Channels only write to their own buffers, so the
+// result is the same no matter which thread processes what.
+class HRTFWorkerPool
+{
+public:
+	HRTFWorkerPool()
+	{
+		// Leave a core for the game and one for the mixer thread itself
+		int count = std::max(std::min((int)std::thread::hardware_concurrency() - 2, 3), 0);
+		for (int i = 0; i < count; i++)
+			workers.push_back(std::thread([this]() { WorkerMain(); }));
+	}
+
+	~HRTFWorkerPool()
+	{
+		stop.store(true, std::memory_order_release);
+		wakeup.Release((int)workers.size());
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	void EndFrame(HRTFAudioChannel** channels, size_t count)
+	{
+		if (workers.empty() || count < 2)
 		{
-			c[half + i].r = c[half - i].r;
-			c[half + i].i = -c[half - i].i;
+			for (size_t i = 0; i < count; i++)
+				channels[i]->EndFrame();
+			return;
 		}
+
+		// Bits 0-15 are the next channel to claim and bits 16-31 the channel count, so a claim is never made against a stale count
+		count = std::min(count, (size_t)0xffff);
+		jobs = channels;
+		finished.store(0, std::memory_order_relaxed);
+		state.store(((uint64_t)++batch << 32) | ((uint64_t)count << 16), std::memory_order_release);
+		wakeup.Release((int)std::min(workers.size(), count - 1));
+
+		// Workers that wake up late find nothing left to claim
+		RunJobs();
+
+		// Every channel is claimed now. At most one channel per worker is still being processed.
+		while (finished.load(std::memory_order_acquire) != count)
+			std::this_thread::yield();
 	}
 
-	void ApplyHRTF(float* samples, kiss_fft_cpx* hrtf)
+private:
+	HRTFWorkerPool(const HRTFWorkerPool&) = delete;
+	HRTFWorkerPool& operator=(const HRTFWorkerPool&) = delete;
+
+	void RunJobs()
 	{
-		COptMul(freq_buf.data(), hrtf, workspace_buf.data(), freq_buf.size());
-		kiss_fft(this->hrtf->cfg_inverse, workspace_buf.data(), time_buf.data());
+		uint64_t s = state.load(std::memory_order_acquire);
+		while (true)
+		{
+			uint64_t index = s & 0xffff;
+			uint64_t count = (s >> 16) & 0xffff;
+			if (index >= count)
+				break;
 
-		size_t nfft = HRTF_Direction::nfft;
-		float rcp_nfft = 1.0f / nfft;
-		for (size_t i = 0; i < nfft; i++)
-			samples[i] = time_buf[i].r * rcp_nfft;
+			if (state.compare_exchange_weak(s, s + 1, std::memory_order_acq_rel))
+			{
+				jobs[index]->EndFrame();
+				finished.fetch_add(1, std::memory_order_release);
+				s = state.load(std::memory_order_acquire);
+			}
+		}
 	}
 
-	static float clamp(float v, float minval, float maxval)
+	void WorkerMain()
 	{
-		return std::max(std::min(v, maxval), minval);
+		while (true)
+		{
+			wakeup.Acquire();
+			if (stop.load(std::memory_order_acquire))
+				break;
+			RunJobs();
+		}
 	}
 
-	HRTF_Data* hrtf = nullptr;
+	std::vector<std::thread> workers;
+	WorkerSemaphore wakeup;
+	std::atomic<bool> stop{ false };
+
+	HRTFAudioChannel** jobs = nullptr;
+	std::atomic<uint64_t> state{ 0 };
+	std::atomic<size_t> finished{ 0 };
+	uint32_t batch = 0;
 };
 
 // comb filter: output[i] = input[i] + gain * output[i - delay]
@@ -712,6 +996,12 @@ public:
 	std::vector<float> outbuffer;
 	size_t bufferpos = 0;
 
+	void clear()
+	{
+		memset(outbuffer.data(), 0, outbuffer.size() * sizeof(float));
+		bufferpos = 0;
+	}
+
 	void filter(float* data, size_t samples, size_t delay, float gain)
 	{
 		if (delay > 0x7fff)
@@ -737,13 +1027,244 @@ public:
 	}
 };
 
+class ReverbSettings
+{
+public:
+	static const int MaxFilters = 8;
+
+	float volume = 0.0f;
+	int hfcutoff = 44100;
+	int count = 0;
+	float time[MaxFilters] = {};
+	float gain[MaxFilters] = {};
+
+	bool operator==(const ReverbSettings& other) const
+	{
+		if (volume != other.volume || hfcutoff != other.hfcutoff || count != other.count)
+			return false;
+		for (int i = 0; i < count; i++)
+		{
+			if (time[i] != other.time[i] || gain[i] != other.gain[i])
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const ReverbSettings& other) const { return !(*this == other); }
+};
+
+// Decodes music ahead of the mixer on its own thread, so that a slow module tick, ogg page or resampler pass never
+// holds up the mixer thread. The mixer thread only copies samples out of the ring buffer.
+class MusicStream
+{
+public:
+	MusicStream(std::unique_ptr<AudioSource> source) : source(std::move(source))
+	{
+		buffer.resize(BufferSize, 0.0f);
+		thread = std::thread([this]() { DecoderMain(); });
+	}
+
+	~MusicStream()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+		lock.unlock();
+		condition.notify_all();
+		thread.join();
+	}
+
+	// Copies up to samples decoded samples to output and returns how many it copied. Only called by the mixer thread.
+	size_t Read(float* output, size_t samples)
+	{
+		if (!Started())
+			return 0;
+
+		size_t pos = readpos.load(std::memory_order_relaxed);
+		size_t available = std::min(writepos.load(std::memory_order_acquire) - pos, samples);
+		size_t offset = pos & (BufferSize - 1);
+		size_t first = std::min(available, BufferSize - offset);
+		memcpy(output, buffer.data() + offset, first * sizeof(float));
+		memcpy(output + first, buffer.data(), (available - first) * sizeof(float));
+		readpos.store(pos + available, std::memory_order_seq_cst);
+
+		// The decoder only holds the lock to check for room, never while decoding, so this doesn't wait on it
+		if (sleeping.load(std::memory_order_seq_cst) && HasRoom())
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.notify_one();
+		}
+		return available;
+	}
+
+	// False until the decoder thread has primed the ring. The music plays silence until then rather than stuttering.
+	bool Started() const
+	{
+		return started.load(std::memory_order_acquire);
+	}
+
+	// True once the source has no more samples. A short read before that is an underrun.
+	bool Ended() const
+	{
+		return ended.load(std::memory_order_acquire);
+	}
+
+private:
+	MusicStream(const MusicStream&) = delete;
+	MusicStream& operator=(const MusicStream&) = delete;
+
+	bool HasRoom() const
+	{
+		size_t filled = writepos.load(std::memory_order_relaxed) - readpos.load(std::memory_order_seq_cst);
+		return BufferSize - filled >= ChunkSize;
+	}
+
+	void DecoderMain()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stop)
+		{
+			if (!ended.load(std::memory_order_relaxed) && HasRoom())
+			{
+				lock.unlock();
+				Decode();
+
+				// Priming happens here rather than on the game thread, so that starting music doesn't stall a level change
+				if (!started.load(std::memory_order_relaxed) && (ended.load(std::memory_order_relaxed) || writepos.load(std::memory_order_relaxed) >= PrimeSize))
+					started.store(true, std::memory_order_release);
+				lock.lock();
+			}
+			else
+			{
+				// Set before the room check so that either the mixer thread sees it and notifies, or the check sees the mixer's read
+				sleeping.store(true, std::memory_order_seq_cst);
+				condition.wait(lock, [&]() { return stop || (!ended.load(std::memory_order_relaxed) && HasRoom()); });
+				sleeping.store(false, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Decodes the next chunk into the free part of the ring, up to where it wraps around
+	void Decode()
+	{
+		size_t pos = writepos.load(std::memory_order_relaxed);
+		size_t offset = pos & (BufferSize - 1);
+		size_t count = std::min(ChunkSize, BufferSize - offset);
+		size_t read = 0;
+		try
+		{
+			read = source->ReadSamples(buffer.data() + offset, count);
+		}
+		catch (const std::exception&)
+		{
+		}
+		writepos.store(pos + read, std::memory_order_release);
+		if (read == 0)
+			ended.store(true, std::memory_order_release);
+	}
+
+	static const size_t BufferSize = 0x8000; // About 370 ms of stereo at 44.1 kHz
+	static const size_t ChunkSize = 0x800;
+	static const size_t PrimeSize = BufferSize / 4;
+
+	std::unique_ptr<AudioSource> source;
+	std::vector<float> buffer;
+	std::atomic<size_t> writepos{ 0 };
+	std::atomic<size_t> readpos{ 0 };
+	std::atomic<bool> started{ false };
+	std::atomic<bool> ended{ false };
+	std::atomic<bool> sleeping{ false };
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stop = false;
+};
+
+// Message from the game thread to the mixer thread
+class MixerCommand
+{
+public:
+	enum Type { Sound, Music, Volume, Reverb };
+	Type type = Sound;
+
+	ActiveSound sound; // Play, update or stop, as told by its play and update flags
+	MusicStream* music = nullptr; // Ownership passes to the mixer thread, which sends it back in a MusicReleased event once replaced
+	float soundvolume = 1.0f;
+	float musicvolume = 1.0f;
+	ReverbSettings reverb;
+};
+
+// Message from the mixer thread to the game thread
+class MixerEvent
+{
+public:
+	enum Type { SoundStopped, MusicReleased, Stats };
+	Type type = SoundStopped;
+
+	int channel = 0;
+	AudioSound* sound = nullptr; // The sound that stopped. The game thread releases its reference to it.
+	MusicStream* music = nullptr; // Deleted by the game thread so that the mixer thread never frees memory or waits for the decoder thread
+	AudioMixerStats stats;
+};
+
+// Wait-free queue with a single producer thread and a single consumer thread. Neither side blocks or allocates.
+template<typename T, size_t Capacity>
+class SPSCQueue
+{
+public:
+	bool Push(const T& item)
+	{
+		size_t pos = writepos.load(std::memory_order_relaxed);
+		if (pos - readpos.load(std::memory_order_acquire) == Capacity)
+			return false;
+		items[pos & (Capacity - 1)] = item;
+		writepos.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& item)
+	{
+		size_t pos = readpos.load(std::memory_order_relaxed);
+		if (pos == writepos.load(std::memory_order_acquire))
+			return false;
+		item = items[pos & (Capacity - 1)];
+		readpos.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only meaningful to the producer. The consumer can make room at any time, but never take it away.
+	size_t FreeSpace() const
+	{
+		return Capacity - (writepos.load(std::memory_order_relaxed) - readpos.load(std::memory_order_acquire));
+	}
+
+private:
+	static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+	// The items sit between the two positions so that each thread's position is on its own cache line
+	std::atomic<size_t> writepos{ 0 };
+	T items[Capacity];
+	std::atomic<size_t> readpos{ 0 };
+};
+
 class AudioMixerSource : public AudioSource
 {
 public:
-	AudioMixerSource(AudioMixerImpl* mixer, ZipReader *zip) : mixer(mixer), hrtf(zip)
+	AudioMixerSource(AudioMixerImpl* mixer, ZipReader *zip, int blocksize, int maxchannels, int maxsounds) : mixer(mixer), maxsounds(maxsounds), hrtf(zip, blocksize)
 	{
-		size_t framesize = HRTF_Direction::nfft / 2;
+		size_t framesize = hrtf.blocksize;
 		soundframe.resize(framesize * 2);
+
+		// All channels, sound slots and filters are created up front so that the mixer thread never allocates.
+		// A sound is in at most one channel's list as the current channel and one as the previous one, so no list can hold more than maxsounds.
+		for (int i = 0; i < maxchannels; i++)
+		{
+			hrtfchannels.push_back(std::make_unique<HRTFAudioChannel>(&hrtf));
+			hrtfchannels.back()->sounds.reserve(maxsounds);
+		}
+		activechannels.reserve(maxchannels);
+		sounds.reserve(maxsounds);
+		reverbfilters.resize(ReverbSettings::MaxFilters);
 	}
 
 	int GetFrequency() override;
@@ -753,54 +1274,94 @@ public:
 	size_t ReadSamples(float* output, size_t samples) override;
 
 	void TransferFromClient();
+	void ApplySoundCommand(const ActiveSound& s);
 	void CopyMusic(float* output, size_t samples);
 	void MixSounds(float* output, size_t samples);
 
 	void MixFrame();
+	void PlaceSounds();
+	HRTFAudioChannel* FindChannel(kiss_fft_cpx* leftHRTF, kiss_fft_cpx* rightHRTF);
+
+	// Playing a sound can stop the one already on its channel and be refused when all sound slots are in use
+	static const size_t MaxEventsPerCommand = 2;
 
 	AudioMixerImpl* mixer = nullptr;
-	std::map<int, ActiveSound> sounds;
-	std::vector<int> stoppedsounds;
-	std::unique_ptr<AudioSource> music;
+	size_t maxsounds = 0;
+	std::vector<ActiveSound> sounds; // Sorted by channel
+	std::unique_ptr<MusicStream> music;
 	float soundvolume = 1.0f;
 	float musicvolume = 1.0f;
-	struct
-	{
-		float volume = 0.0f;
-		int hfcutoff = 44100;
-		std::vector<float> time;
-		std::vector<float> gain;
-		std::vector<ReverbCombFilter> filters;
-	} reverb;
+	ReverbSettings reverb;
+	std::vector<ReverbCombFilter> reverbfilters;
 
 	HRTF_Data hrtf;
 	std::vector<std::unique_ptr<HRTFAudioChannel>> hrtfchannels;
+	std::vector<HRTFAudioChannel*> activechannels;
+	HRTFWorkerPool workers;
 	std::vector<float> soundframe;
 	size_t playPos = 0;
+
+	struct
+	{
+		int frames = 0;
+		int channelFrames = 0;
+		int clusteredSounds = 0;
+		double hrtfSeconds = 0.0;
+		double frameSeconds = 0.0;
+		int musicReads = 0;
+		double musicSeconds = 0.0;
+		int musicUnderruns = 0;
+		AudioMixerStats published;
+		bool publish = false;
+	} stats;
 };
 
 class AudioMixerImpl : public AudioMixer
 {
 public:
-	AudioMixerImpl(const void *zipData, size_t zipSize)
+	AudioMixerImpl(const void *zipData, size_t zipSize, int blockSize, int maxHrtfChannels, int maxSounds)
 	{
 		ZipReader zip(zipData, zipSize);
-		player = AudioPlayer::Create(std::make_unique<AudioMixerSource>(this, &zip));
+		player = AudioPlayer::Create(std::make_unique<AudioMixerSource>(this, &zip, blockSize, maxHrtfChannels, maxSounds));
 	}
 
 	~AudioMixerImpl()
 	{
 		player.reset();
+
+		// Music still on its way to or from the mixer thread is owned by the queues
+		for (MixerCommand& cmd : pending)
+		{
+			if (cmd.type == MixerCommand::Music)
+				delete cmd.music;
+		}
+		MixerCommand cmd;
+		while (commands.Pop(cmd))
+		{
+			if (cmd.type == MixerCommand::Music)
+				delete cmd.music;
+		}
+		MixerEvent e;
+		while (events.Pop(e))
+		{
+			if (e.type == MixerEvent::MusicReleased)
+				delete e.music;
+		}
 	}
 
 	AudioSound* AddSound(std::unique_ptr<AudioSource> source, const AudioLoopInfo& loopinfo) override
 	{
-		sounds.push_back(std::make_unique<AudioSound>(mixing_frequency, std::move(source), loopinfo));
-		return sounds.back().get();
+		auto sound = std::make_unique<AudioSound>(&samplepool, mixing_frequency, std::move(source), loopinfo);
+		AudioSound* handle = sound.get();
+		sounds[handle] = std::move(sound);
+		loader.Add(handle);
+		return handle;
 	}
 
+	// The sound is destroyed once the mixer thread reported every play of it as stopped
 	void RemoveSound(AudioSound* sound) override
 	{
+		ReleaseSound(sound);
 	}
 
 	float GetSoundDuration(AudioSound* sound) override
@@ -810,45 +1371,50 @@ public:
 
 	int PlaySound(int channel, AudioSound* sound, float volume, float pan, float pitch, float x, float y, float z) override
 	{
-		ActiveSound s;
-		s.channel = channel;
-		s.play = true;
-		s.update = false;
-		s.sound = sound;
-		s.volume = volume;
-		s.pan = pan;
-		s.pitch = pitch;
-		s.x = x;
-		s.y = y;
-		s.z = z;
-		client.sounds.push_back(std::move(s));
+		MixerCommand cmd;
+		cmd.type = MixerCommand::Sound;
+		cmd.sound.channel = channel;
+		cmd.sound.play = true;
+		cmd.sound.update = false;
+		cmd.sound.sound = sound;
+		cmd.sound.volume = volume;
+		cmd.sound.pan = pan;
+		cmd.sound.pitch = pitch;
+		cmd.sound.x = x;
+		cmd.sound.y = y;
+		cmd.sound.z = z;
+		pending.push_back(cmd);
 		channelplaying[channel]++;
+		if (sound)
+			sound->refcount++;
 		return channel;
 	}
 
 	void UpdateSound(int channel, AudioSound* sound, float volume, float pan, float pitch, float x, float y, float z) override
 	{
-		ActiveSound s;
-		s.channel = channel;
-		s.play = false;
-		s.update = true;
-		s.sound = sound;
-		s.volume = volume;
-		s.pan = pan;
-		s.pitch = pitch;
-		s.x = x;
-		s.y = y;
-		s.z = z;
-		client.sounds.push_back(std::move(s));
+		MixerCommand cmd;
+		cmd.type = MixerCommand::Sound;
+		cmd.sound.channel = channel;
+		cmd.sound.play = false;
+		cmd.sound.update = true;
+		cmd.sound.sound = sound;
+		cmd.sound.volume = volume;
+		cmd.sound.pan = pan;
+		cmd.sound.pitch = pitch;
+		cmd.sound.x = x;
+		cmd.sound.y = y;
+		cmd.sound.z = z;
+		pending.push_back(cmd);
 	}
 
 	void StopSound(int channel) override
 	{
-		ActiveSound s;
-		s.channel = channel;
-		s.play = false;
-		s.update = false;
-		client.sounds.push_back(std::move(s));
+		MixerCommand cmd;
+		cmd.type = MixerCommand::Sound;
+		cmd.sound.channel = channel;
+		cmd.sound.play = false;
+		cmd.sound.update = false;
+		pending.push_back(cmd);
 	}
 
 	bool SoundFinished(int channel) override
@@ -866,88 +1432,137 @@ public:
 		{
 			source = AudioSource::CreateResampler(mixing_frequency, std::move(source));
 		}
-		client.music = std::move(source);
-		client.musicupdate = true;
+
+		MixerCommand cmd;
+		cmd.type = MixerCommand::Music;
+		cmd.music = source ? new MusicStream(std::move(source)) : nullptr;
+		pending.push_back(cmd);
 	}
 
 	void SetMusicVolume(float volume) override
 	{
-		client.musicvolume = volume;
+		if (musicvolume != volume)
+		{
+			musicvolume = volume;
+			SendVolume();
+		}
 	}
 
 	void SetSoundVolume(float volume) override
 	{
-		client.soundvolume = volume;
+		if (soundvolume != volume)
+		{
+			soundvolume = volume;
+			SendVolume();
+		}
 	}
 
 	void SetReverb(float volume, float hfcutoff, std::vector<float> time, std::vector<float> gain)
 	{
-		client.reverb.volume = volume;
-		client.reverb.hfcutoff = hfcutoff;
-		client.reverb.time = std::move(time);
-		client.reverb.gain = std::move(gain);
+		MixerCommand cmd;
+		cmd.type = MixerCommand::Reverb;
+		cmd.reverb.volume = volume;
+		cmd.reverb.hfcutoff = (int)hfcutoff;
+		cmd.reverb.count = (int)std::min(std::min(time.size(), gain.size()), (size_t)ReverbSettings::MaxFilters);
+		for (int i = 0; i < cmd.reverb.count; i++)
+		{
+			cmd.reverb.time[i] = time[i];
+			cmd.reverb.gain[i] = gain[i];
+		}
+
+		// The zone reverb is set every tick. Only changes are worth sending.
+		if (cmd.reverb != reverb)
+		{
+			reverb = cmd.reverb;
+			pending.push_back(cmd);
+		}
 	}
 
 	void Update() override
 	{
-		std::unique_lock<std::mutex> lock(mutex);
-		for (ActiveSound& s : client.sounds)
-			transfer.sounds.push_back(s);
-		client.sounds.clear();
-		if (client.musicupdate)
+		// Whatever doesn't fit in the queue is sent next time, in the same order
+		size_t sent = 0;
+		while (sent < pending.size() && commands.Push(pending[sent]))
+			sent++;
+		pending.erase(pending.begin(), pending.begin() + sent);
+
+		MixerEvent e;
+		while (events.Pop(e))
 		{
-			transfer.music = std::move(client.music);
-			transfer.musicupdate = true;
+			if (e.type == MixerEvent::SoundStopped)
+			{
+				auto it = channelplaying.find(e.channel);
+				it->second--;
+				if (it->second == 0)
+					channelplaying.erase(it);
+				ReleaseSound(e.sound);
+			}
+			else if (e.type == MixerEvent::MusicReleased)
+			{
+				delete e.music;
+			}
+			else if (e.type == MixerEvent::Stats)
+			{
+				stats = e.stats;
+			}
 		}
-		client.music = {};
-		client.musicupdate = false;
-
-		transfer.musicvolume = client.musicvolume;
-		transfer.soundvolume = client.soundvolume;
-		transfer.reverb = client.reverb;
+	}
 
-		for (int c : channelstopped)
-		{
-			auto it = channelplaying.find(c);
-			it->second--;
-			if (it->second == 0)
-				channelplaying.erase(it);
-		}
-		channelstopped.clear();
+	AudioMixerStats GetStats() override
+	{
+		AudioMixerStats result = stats;
+		result.Sounds = (int)sounds.size();
+		samplepool.GetUsage(result.SoundBytes, result.PooledBytes);
+		double loadSeconds = 0.0;
+		loader.GetStats(loadSeconds, result.LoadingSounds);
+		result.LoadMilliseconds = (float)(loadSeconds * 1000.0);
+		return result;
 	}
 
 	int mixing_frequency = 44100;
 
-	std::vector<std::unique_ptr<AudioSound>> sounds;
+	SamplePool samplepool;
+	std::map<AudioSound*, std::unique_ptr<AudioSound>> sounds;
+	SoundLoader loader;
 	std::unique_ptr<AudioPlayer> player;
 	std::map<int, int> channelplaying;
 
-	struct
+	// Game thread state
+	std::vector<MixerCommand> pending;
+	float soundvolume = 1.0f;
+	float musicvolume = 1.0f;
+	ReverbSettings reverb;
+	AudioMixerStats stats;
+
+	// The game thread is the only producer of commands and the mixer thread the only producer of events
+	SPSCQueue<MixerCommand, 1024> commands;
+	SPSCQueue<MixerEvent, 1024> events;
+
+private:
+	void ReleaseSound(AudioSound* sound)
 	{
-		std::vector<ActiveSound> sounds;
-		std::unique_ptr<AudioSource> music;
-		bool musicupdate = false;
-		float soundvolume = 1.0f;
-		float musicvolume = 1.0f;
-		struct
+		if (sound && --sound->refcount == 0)
 		{
-			float volume = 0.0f;
-			int hfcutoff = 44100;
-			std::vector<float> time;
-			std::vector<float> gain;
-		} reverb;
-	} client, transfer;
-	std::vector<int> channelstopped;
+			loader.Cancel(sound);
+			sounds.erase(sound);
+		}
+	}
 
-	std::mutex mutex;
-	int nextid = 1;
+	void SendVolume()
+	{
+		MixerCommand cmd;
+		cmd.type = MixerCommand::Volume;
+		cmd.soundvolume = soundvolume;
+		cmd.musicvolume = musicvolume;
+		pending.push_back(cmd);
+	}
 };
 
 /////////////////////////////////////////////////////////////////////////////
 
-std::unique_ptr<AudioMixer> AudioMixer::Create(const void* zipData, size_t zipSize)
+std::unique_ptr<AudioMixer> AudioMixer::Create(const void* zipData, size_t zipSize, int blockSize, int maxHrtfChannels, int maxSounds)
 {
-	return std::make_unique<AudioMixerImpl>(zipData, zipSize);
+	return std::make_unique<AudioMixerImpl>(zipData, zipSize, blockSize, maxHrtfChannels, maxSounds);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -960,69 +1575,115 @@ int AudioMixerSource::GetFrequency()
 size_t AudioMixerSource::ReadSamples(float* output, size_t samples)
 {
 	TransferFromClient();
+
+	auto musicStart = std::chrono::steady_clock::now();
 	CopyMusic(output, samples);
+	stats.musicSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - musicStart).count();
+	stats.musicReads++;
+
 	MixSounds(output, samples);
 	return samples;
 }
 
 void AudioMixerSource::TransferFromClient()
 {
-	std::unique_lock<std::mutex> lock(mixer->mutex);
-	for (ActiveSound& s : mixer->transfer.sounds)
+	// Leaving commands in the queue while their events can't be sent keeps every stop reported
+	MixerCommand cmd;
+	while (mixer->events.FreeSpace() >= MaxEventsPerCommand && mixer->commands.Pop(cmd))
 	{
-		if (!s.update) // if play or stop
+		if (cmd.type == MixerCommand::Sound)
 		{
-			auto it = sounds.find(s.channel);
-			if (it != sounds.end())
-			{
-				stoppedsounds.push_back(s.channel);
-				sounds.erase(it);
-			}
+			ApplySoundCommand(cmd.sound);
 		}
-
-		if (s.play)
+		else if (cmd.type == MixerCommand::Music)
 		{
-			sounds[s.channel] = s;
+			MixerEvent e;
+			e.type = MixerEvent::MusicReleased;
+			e.music = music.release();
+			music.reset(cmd.music);
+			if (e.music)
+				mixer->events.Push(e);
 		}
-		else if (s.update)
+		else if (cmd.type == MixerCommand::Volume)
 		{
-			auto it = sounds.find(s.channel);
-			if (it != sounds.end())
-			{
-				it->second.volume = s.volume;
-				it->second.pan = s.pan;
-				it->second.pitch = s.pitch;
-				it->second.x = s.x;
-				it->second.y = s.y;
-				it->second.z = s.z;
-			}
+			soundvolume = cmd.soundvolume;
+			musicvolume = cmd.musicvolume;
+		}
+		else if (cmd.type == MixerCommand::Reverb)
+		{
+			// Filters that are switched off lose their echo, as if they were new when switched on again
+			for (int i = cmd.reverb.count; i < reverb.count; i++)
+				reverbfilters[i].clear();
+			reverb = cmd.reverb;
 		}
 	}
-	mixer->transfer.sounds.clear();
 
-	if (mixer->transfer.musicupdate)
-		music = std::move(mixer->transfer.music);
-	mixer->transfer.musicupdate = false;
+	if (stats.publish)
+	{
+		MixerEvent e;
+		e.type = MixerEvent::Stats;
+		e.stats = stats.published;
+		if (mixer->events.Push(e))
+			stats.publish = false;
+	}
+}
 
-	mixer->channelstopped.insert(mixer->channelstopped.end(), stoppedsounds.begin(), stoppedsounds.end());
-	stoppedsounds.clear();
+void AudioMixerSource::ApplySoundCommand(const ActiveSound& s)
+{
+	auto it = std::lower_bound(sounds.begin(), sounds.end(), s.channel, [](const ActiveSound& a, int channel) { return a.channel < channel; });
+	bool found = it != sounds.end() && it->channel == s.channel;
 
-	soundvolume = mixer->transfer.soundvolume;
-	musicvolume = mixer->transfer.musicvolume;
+	// TransferFromClient leaves room for MaxEventsPerCommand events, so neither push below can fail
+	if (!s.update) // if play or stop
+	{
+		if (found)
+		{
+			MixerEvent e;
+			e.type = MixerEvent::SoundStopped;
+			e.channel = s.channel;
+			e.sound = it->sound;
+			mixer->events.Push(e);
+			it = sounds.erase(it);
+			found = false;
+		}
+	}
 
-	reverb.volume = mixer->transfer.reverb.volume;
-	reverb.hfcutoff = mixer->transfer.reverb.hfcutoff;
-	reverb.time = mixer->transfer.reverb.time;
-	reverb.gain = mixer->transfer.reverb.gain;
+	if (s.play)
+	{
+		if (sounds.size() < maxsounds)
+		{
+			sounds.insert(it, s);
+		}
+		else
+		{
+			// All sound slots are in use. The new sound is reported as stopped right away, like one that ended.
+			MixerEvent e;
+			e.type = MixerEvent::SoundStopped;
+			e.channel = s.channel;
+			e.sound = s.sound;
+			mixer->events.Push(e);
+		}
+	}
+	else if (s.update && found)
+	{
+		it->volume = s.volume;
+		it->pan = s.pan;
+		it->pitch = s.pitch;
+		it->x = s.x;
+		it->y = s.y;
+		it->z = s.z;
+	}
 }
 
 void AudioMixerSource::CopyMusic(float* output, size_t samples)
 {
 	size_t pos = 0;
 
-	if (music && music->GetChannels() == 2) // Only support stereo music for now
+	if (music)
 	{
-		pos = music->ReadSamples(output, samples);
+		pos = music->Read(output, samples);
+		if (pos < samples && music->Started() && !music->Ended())
+			stats.musicUnderruns++;
 	}
 
 	for (size_t i = pos; i < samples; i++)
@@ -1047,13 +1708,8 @@ void AudioMixerSource::MixSounds(float* output, size_t samples)
 		size_t available = std::min(framesize - playPos, samples);
 		if (available > 0)
 		{
-			const float* input = soundframe.data() + playPos * 2;
-			float vol = soundvolume;
-			for (size_t i = 0; i < available; i++)
-			{
-				*(output++) += *(input++) * vol;
-				*(output++) += *(input++) * vol;
-			}
+			MixKernels::Get().MixMono(output, soundframe.data() + playPos * 2, soundvolume, available * 2);
+			output += available * 2;
 			playPos += available;
 			samples -= available;
 		}
@@ -1065,63 +1721,137 @@ void AudioMixerSource::MixSounds(float* output, size_t samples)
 	}
 }
 
-void AudioMixerSource::MixFrame()
+HRTFAudioChannel* AudioMixerSource::FindChannel(kiss_fft_cpx* leftHRTF, kiss_fft_cpx* rightHRTF)
 {
-	size_t framesize = soundframe.size() / 2;
+	for (auto& c : hrtfchannels)
+	{
+		if (c->leftHRTF == leftHRTF && c->rightHRTF == rightHRTF)
+			return c.get();
+	}
+	return nullptr;
+}
 
-	// Place sounds into directional channels
-	for (auto& it : sounds)
+void AudioMixerSource::PlaceSounds()
+{
+	for (auto& c : hrtfchannels)
+		c->used = false;
+
+	// Sounds keep the channel they played in last frame for the crossfade, and reuse any channel already pointing their way.
+	// Sounds still loading get no channel.
+	for (ActiveSound& sound : sounds)
 	{
-		ActiveSound& sound = it.second;
+		sound.nextHrtfChannel = nullptr;
+		if (!sound.sound->IsLoaded())
+			continue;
+
 
 		float elev = Clamp(std::atan2(sound.y, std::abs(sound.z)) * 180.0f / 3.14159265359f, -90.0f, 90.0f);
 		float azim = Clamp(std::atan2(sound.x, sound.z) * 180.0f / 3.14159265359f, -180.0f, 180.0f);
+		hrtf.get_hrtf(elev, azim, &sound.leftHRTF, &sound.rightHRTF);
 
-		kiss_fft_cpx* leftHRTF = nullptr;
-		kiss_fft_cpx* rightHRTF = nullptr;
-		hrtf.get_hrtf(elev, azim, &leftHRTF, &rightHRTF);
+		if (sound.curHrtfChannel)
+			sound.curHrtfChannel->used = true;
+
+		sound.nextHrtfChannel = FindChannel(sound.leftHRTF, sound.rightHRTF);
+		if (sound.nextHrtfChannel)
+			sound.nextHrtfChannel->used = true;
+	}
 
-		HRTFAudioChannel* hrtfchannel = nullptr;
-		for (auto& c : hrtfchannels)
+	// New directions get a free channel. Once all are taken the sound joins the channel pointing closest to it.
+	for (ActiveSound& sound : sounds)
+	{
+		if (sound.nextHrtfChannel || !sound.sound->IsLoaded())
+			continue;
+
+		float dir[3] = { sound.x, sound.y, sound.z };
+		float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		if (length > 0.0f)
 		{
-			if (c->leftHRTF == leftHRTF && c->rightHRTF == rightHRTF)
+			dir[0] /= length;
+			dir[1] /= length;
+			dir[2] /= length;
+		}
+		else
+		{
+			dir[2] = 1.0f;
+		}
+
+		HRTFAudioChannel* hrtfchannel = FindChannel(sound.leftHRTF, sound.rightHRTF);
+		if (!hrtfchannel)
+		{
+			for (auto& c : hrtfchannels)
 			{
-				hrtfchannel = c.get();
-				break;
+				if (!c->used)
+				{
+					hrtfchannel = c.get();
+					hrtfchannel->Bind(sound.leftHRTF, sound.rightHRTF, dir);
+					break;
+				}
 			}
 		}
 		if (!hrtfchannel)
 		{
-			hrtfchannels.push_back(std::make_unique<HRTFAudioChannel>(leftHRTF, rightHRTF, &hrtf));
-			hrtfchannel = hrtfchannels.back().get();
+			// Slightly favor the current channel so the sound doesn't keep crossfading between two that are about as close
+			float bestDot = -2.0f;
+			for (auto& c : hrtfchannels)
+			{
+				float dot = c->direction[0] * dir[0] + c->direction[1] * dir[1] + c->direction[2] * dir[2];
+				if (c.get() == sound.curHrtfChannel)
+					dot += 0.05f;
+				if (dot > bestDot)
+				{
+					bestDot = dot;
+					hrtfchannel = c.get();
+				}
+			}
+			stats.clusteredSounds++;
 		}
 
+		hrtfchannel->used = true;
+		sound.nextHrtfChannel = hrtfchannel;
+	}
+
+	for (ActiveSound& sound : sounds)
+	{
+		if (!sound.nextHrtfChannel)
+			continue;
+
 		sound.prevHrtfChannel = sound.curHrtfChannel;
-		sound.curHrtfChannel = hrtfchannel;
+		sound.curHrtfChannel = sound.nextHrtfChannel;
 
 		if (sound.prevHrtfChannel && sound.prevHrtfChannel != sound.curHrtfChannel)
 			sound.prevHrtfChannel->sounds.push_back(&sound);
-		hrtfchannel->sounds.push_back(&sound);
+		sound.curHrtfChannel->sounds.push_back(&sound);
 	}
 
-	// Remove unused channels
-	auto itHrtf = hrtfchannels.begin();
-	while (itHrtf != hrtfchannels.end())
+	// Channels without sounds are released. Their history would be stale by the time they are used again.
+	activechannels.clear();
+	for (auto& c : hrtfchannels)
 	{
-		if ((*itHrtf)->sounds.empty())
-			itHrtf = hrtfchannels.erase(itHrtf);
+		if (!c->sounds.empty())
+			activechannels.push_back(c.get());
 		else
-			++itHrtf;
+			c->Unbind();
 	}
+}
+
+void AudioMixerSource::MixFrame()
+{
+	auto frameStart = std::chrono::steady_clock::now();
+	size_t framesize = soundframe.size() / 2;
+
+	PlaceSounds();
 
 	// Mix a frame of audio
 
-	for (auto& hrtfchannel : hrtfchannels)
+	for (HRTFAudioChannel* hrtfchannel : activechannels)
 		hrtfchannel->BeginFrame();
 
-	for (auto& it : sounds)
+	for (ActiveSound& sound : sounds)
 	{
-		ActiveSound& sound = it.second;
+		if (!sound.curHrtfChannel)
+			continue;
+
 		if (!sound.prevHrtfChannel || sound.prevHrtfChannel == sound.curHrtfChannel)
 		{
 			sound.MixInto(sound.curHrtfChannel->GetBuffer(), framesize);
@@ -1132,24 +1862,26 @@ void AudioMixerSource::MixFrame()
 		}
 	}
 
-	for (auto& hrtfchannel : hrtfchannels)
-	{
-		hrtfchannel->EndFrame();
+	auto hrtfStart = std::chrono::steady_clock::now();
+	workers.EndFrame(activechannels.data(), activechannels.size());
+	for (HRTFAudioChannel* hrtfchannel : activechannels)
 		hrtfchannel->sounds.clear();
-	}
+	auto hrtfEnd = std::chrono::steady_clock::now();
 
 	memset(soundframe.data(), 0, soundframe.size() * sizeof(float));
-	for (auto& hrtfchannel : hrtfchannels)
+	for (HRTFAudioChannel* hrtfchannel : activechannels)
 		hrtfchannel->MixInto(soundframe.data());
 
-	// Remove sounds that finished playing
+	// Remove sounds that finished playing. If the game thread is behind on events they stay silent until they can be reported.
 	auto it = sounds.begin();
 	while (it != sounds.end())
 	{
-		ActiveSound& sound = it->second;
-		if (sound.SoundEnded())
+		MixerEvent e;
+		e.type = MixerEvent::SoundStopped;
+		e.channel = it->channel;
+		e.sound = it->sound;
+		if (it->SoundEnded() && mixer->events.Push(e))
 		{
-			stoppedsounds.push_back(sound.channel);
 			it = sounds.erase(it);
 		}
 		else
@@ -1159,11 +1891,33 @@ void AudioMixerSource::MixFrame()
 	}
 
 	// Apply reverb effect
-	reverb.filters.resize(reverb.time.size());
-	for (size_t i = 0; i < reverb.filters.size(); i++)
+	for (int i = 0; i < reverb.count; i++)
 	{
 		size_t delay = std::max(std::min((int)std::round(reverb.time[i] * mixer->mixing_frequency), 0x7fff / 2), 1);
 		float gain = reverb.gain[i] * reverb.volume;
-		reverb.filters[i].filter(soundframe.data(), framesize * 2, delay * 2, gain);
+		reverbfilters[i].filter(soundframe.data(), framesize * 2, delay * 2, gain);
+	}
+
+	// Publish averages about once per second
+	stats.frames++;
+	stats.channelFrames += (int)activechannels.size();
+	stats.hrtfSeconds += std::chrono::duration<double>(hrtfEnd - hrtfStart).count();
+	stats.frameSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+	if (stats.frames * framesize >= (size_t)mixer->mixing_frequency)
+	{
+		stats.published.HrtfChannels = (float)stats.channelFrames / stats.frames;
+		stats.published.ClusteredSounds = (float)stats.clusteredSounds / stats.frames;
+		stats.published.HrtfChannelMicroseconds = stats.channelFrames > 0 ? (float)(stats.hrtfSeconds * 1000000.0 / stats.channelFrames) : 0.0f;
+		stats.published.FrameMicroseconds = (float)(stats.frameSeconds * 1000000.0 / stats.frames);
+		stats.published.MusicMicroseconds = stats.musicReads > 0 ? (float)(stats.musicSeconds * 1000000.0 / stats.musicReads) : 0.0f;
+		stats.published.MusicUnderruns = stats.musicUnderruns;
+		stats.publish = true;
+		stats.frames = 0;
+		stats.channelFrames = 0;
+		stats.clusteredSounds = 0;
+		stats.hrtfSeconds = 0.0;
+		stats.frameSeconds = 0.0;
+		stats.musicReads = 0;
+		stats.musicSeconds = 0.0;
 	}
 }
@@ -14,10 +14,26 @@ public:
 	uint64_t LoopEnd = 0;
 };
 
+class AudioMixerStats
+{
+public:
+	float HrtfChannels = 0.0f; // Average number of HRTF channels per frame
+	float ClusteredSounds = 0.0f; // Average number of sounds per frame that had to share a channel pointing in a nearby direction
+	float HrtfChannelMicroseconds = 0.0f; // Average convolution time for one HRTF channel
+	float FrameMicroseconds = 0.0f; // Average time to mix one frame
+	float MusicMicroseconds = 0.0f; // Average time the mixer thread spends getting music for one output buffer
+	int MusicUnderruns = 0; // Output buffers the music decoder didn't keep up with since the mixer was created
+	int Sounds = 0; // Loaded sounds, including removed ones that are still playing
+	size_t SoundBytes = 0; // Sample memory held by the loaded sounds
+	size_t PooledBytes = 0; // Freed sample memory kept for the next sounds loaded
+	int LoadingSounds = 0; // Sounds still waiting to be decoded
+	float LoadMilliseconds = 0.0f; // Total time spent decoding sounds, summed over the loader threads
+};
+
 class AudioMixer
 {
 public:
-	static std::unique_ptr<AudioMixer> Create(const void* zipData, size_t zipSize);
+	static std::unique_ptr<AudioMixer> Create(const void* zipData, size_t zipSize, int blockSize, int maxHrtfChannels, int maxSounds);
 
 	virtual ~AudioMixer() = default;
 	virtual AudioSound* AddSound(std::unique_ptr<AudioSource> source, const AudioLoopInfo& loopinfo = {}) = 0;
@@ -32,4 +48,5 @@ public:
 	virtual void SetSoundVolume(float volume) = 0;
 	virtual void SetReverb(float volume, float hfcutoff, std::vector<float> time, std::vector<float> gain) = 0;
 	virtual void Update() = 0;
+	virtual AudioMixerStats GetStats() = 0;
 };
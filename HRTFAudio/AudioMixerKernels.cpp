@@ -0,0 +1,767 @@
+
+#include "Precomp.h"
+#include "AudioMixerKernels.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#include <cpuid.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	// Integer samples are scaled to the -1 to 1 range of float samples
+	inline float SampleScale(const float*) { return 1.0f; }
+	inline float SampleScale(const int16_t*) { return 1.0f / 32768.0f; }
+	inline float SampleScale(const int8_t*) { return 1.0f / 128.0f; }
+
+	/////////////////////////////////////////////////////////////////////////
+	// Scalar
+
+	// Sample i is at srcpos + i * pitch rather than at an accumulated position, so that every kernel lands on exactly the same positions
+	template<typename T>
+	double ResampleScalarFrom(float* dest, const T* src, int srcmax, double srcpos, double pitch, size_t start, size_t count)
+	{
+		float scale = SampleScale(src);
+		for (size_t i = start; i < count; i++)
+		{
+			double p = srcpos + (double)i * pitch;
+			int pos = (int)p;
+			int pos2 = pos + 1;
+			float t = (float)(p - pos);
+
+			pos = std::min(pos, srcmax);
+			pos2 = std::min(pos2, srcmax);
+
+			dest[i] = (src[pos] * (1.0f - t) + src[pos2] * t) * scale;
+		}
+		return srcpos + (double)count * pitch;
+	}
+
+	template<typename T>
+	double ResampleScalar(float* dest, const void* samples, int srcmax, double srcpos, double pitch, size_t count)
+	{
+		return ResampleScalarFrom(dest, (const T*)samples, srcmax, srcpos, pitch, 0, count);
+	}
+
+	void MixMonoScalar(float* dest, const float* src, float volume, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			dest[i] += src[i] * volume;
+	}
+
+	void MixCrossfadeScalar(float* outputOld, float* outputNew, const float* src, float volume, size_t start, float rcpLength, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			float value = src[i] * volume;
+			float tt = (start + i) * rcpLength;
+			outputOld[i] += value * (1.0f - tt);
+			outputNew[i] += value * tt;
+		}
+	}
+
+	void MixStereoScalar(float* dest, const float* src, float leftVolume, float rightVolume, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			dest[i << 1] += src[i] * leftVolume;
+			dest[(i << 1) + 1] += src[i] * rightVolume;
+		}
+	}
+
+	void AddStereoScalar(float* dest, const float* left, const float* right, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			*(dest++) += *(left++);
+			*(dest++) += *(right++);
+		}
+	}
+
+	void ComplexMultiplyAddScalar(const kiss_fft_cpx* a, const kiss_fft_cpx* b, kiss_fft_cpx* c, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			c[i].r += a[i].r * b[i].r - a[i].i * b[i].i;
+			c[i].i += a[i].i * b[i].r + a[i].r * b[i].i;
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+	// SSE2
+
+	// Interpolates four samples at p01 and p23
+	template<typename T>
+	inline __m128 Interpolate4(const T* src, __m128i srcmax, __m128d p01, __m128d p23)
+	{
+		__m128i i01 = _mm_cvttpd_epi32(p01);
+		__m128i i23 = _mm_cvttpd_epi32(p23);
+		__m128 t = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(p01, _mm_cvtepi32_pd(i01))), _mm_cvtpd_ps(_mm_sub_pd(p23, _mm_cvtepi32_pd(i23))));
+
+		__m128i pos = _mm_unpacklo_epi64(i01, i23);
+		__m128i pos2 = _mm_add_epi32(pos, _mm_set1_epi32(1));
+
+		// No _mm_min_epi32 before SSE4.1
+		__m128i mask = _mm_cmpgt_epi32(pos, srcmax);
+		pos = _mm_or_si128(_mm_and_si128(mask, srcmax), _mm_andnot_si128(mask, pos));
+		mask = _mm_cmpgt_epi32(pos2, srcmax);
+		pos2 = _mm_or_si128(_mm_and_si128(mask, srcmax), _mm_andnot_si128(mask, pos2));
+
+		alignas(16) int index[4];
+		alignas(16) int index2[4];
+		_mm_store_si128((__m128i*)index, pos);
+		_mm_store_si128((__m128i*)index2, pos2);
+		__m128 s0 = _mm_setr_ps((float)src[index[0]], (float)src[index[1]], (float)src[index[2]], (float)src[index[3]]);
+		__m128 s1 = _mm_setr_ps((float)src[index2[0]], (float)src[index2[1]], (float)src[index2[2]], (float)src[index2[3]]);
+
+		return _mm_add_ps(_mm_mul_ps(s0, _mm_sub_ps(_mm_set1_ps(1.0f), t)), _mm_mul_ps(s1, t));
+	}
+
+	template<typename T>
+	double ResampleSSE2(float* dest, const void* samples, int srcmax, double srcpos, double pitch, size_t count)
+	{
+		const T* src = (const T*)samples;
+		__m128 scale = _mm_set1_ps(SampleScale(src));
+		__m128i max = _mm_set1_epi32(srcmax);
+		__m128d base = _mm_set1_pd(srcpos);
+		__m128d step = _mm_set1_pd(pitch);
+		__m128d lanes01 = _mm_setr_pd(0.0, 1.0);
+		__m128d lanes23 = _mm_setr_pd(2.0, 3.0);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128d index = _mm_set1_pd((double)i);
+			__m128d p01 = _mm_add_pd(base, _mm_mul_pd(_mm_add_pd(index, lanes01), step));
+			__m128d p23 = _mm_add_pd(base, _mm_mul_pd(_mm_add_pd(index, lanes23), step));
+			_mm_storeu_ps(dest + i, _mm_mul_ps(Interpolate4(src, max, p01, p23), scale));
+		}
+		return ResampleScalarFrom(dest, src, srcmax, srcpos, pitch, i, count);
+	}
+
+	void MixMonoSSE2(float* dest, const float* src, float volume, size_t count)
+	{
+		__m128 vol = _mm_set1_ps(volume);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), _mm_mul_ps(_mm_loadu_ps(src + i), vol)));
+		MixMonoScalar(dest + i, src + i, volume, count - i);
+	}
+
+	void MixCrossfadeSSE2(float* outputOld, float* outputNew, const float* src, float volume, size_t start, float rcpLength, size_t count)
+	{
+		__m128 vol = _mm_set1_ps(volume);
+		__m128 rcp = _mm_set1_ps(rcpLength);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), vol);
+			__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(start + i)), lanes), rcp);
+			_mm_storeu_ps(outputOld + i, _mm_add_ps(_mm_loadu_ps(outputOld + i), _mm_mul_ps(value, _mm_sub_ps(one, tt))));
+			_mm_storeu_ps(outputNew + i, _mm_add_ps(_mm_loadu_ps(outputNew + i), _mm_mul_ps(value, tt)));
+		}
+		MixCrossfadeScalar(outputOld + i, outputNew + i, src + i, volume, start + i, rcpLength, count - i);
+	}
+
+	void MixStereoSSE2(float* dest, const float* src, float leftVolume, float rightVolume, size_t count)
+	{
+		__m128 vol = _mm_setr_ps(leftVolume, rightVolume, leftVolume, rightVolume);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 value = _mm_loadu_ps(src + i);
+			float* d = dest + (i << 1);
+			_mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_mul_ps(_mm_unpacklo_ps(value, value), vol)));
+			_mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_mul_ps(_mm_unpackhi_ps(value, value), vol)));
+		}
+		MixStereoScalar(dest + (i << 1), src + i, leftVolume, rightVolume, count - i);
+	}
+
+	void AddStereoSSE2(float* dest, const float* left, const float* right, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 l = _mm_loadu_ps(left + i);
+			__m128 r = _mm_loadu_ps(right + i);
+			float* d = dest + (i << 1);
+			_mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_unpacklo_ps(l, r)));
+			_mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_unpackhi_ps(l, r)));
+		}
+		AddStereoScalar(dest + (i << 1), left + i, right + i, count - i);
+	}
+
+	void ComplexMultiplyAddSSE2(const kiss_fft_cpx* a, const kiss_fft_cpx* b, kiss_fft_cpx* c, size_t count)
+	{
+		// [ar*br - ai*bi, ai*br + ar*bi] for two complex numbers at a time
+		__m128 negateReal = _mm_castsi128_ps(_mm_setr_epi32(0x80000000, 0, 0x80000000, 0));
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128 va = _mm_loadu_ps(&a[i].r);
+			__m128 vb = _mm_loadu_ps(&b[i].r);
+			__m128 bre = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 2, 0, 0));
+			__m128 bim = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 3, 1, 1));
+			__m128 aswap = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 product = _mm_add_ps(_mm_mul_ps(va, bre), _mm_xor_ps(_mm_mul_ps(aswap, bim), negateReal));
+			_mm_storeu_ps(&c[i].r, _mm_add_ps(_mm_loadu_ps(&c[i].r), product));
+		}
+		ComplexMultiplyAddScalar(a + i, b + i, c + i, count - i);
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+	// AVX2
+
+	AVX2_TARGET inline __m256 Gather8(const float* src, __m256i pos)
+	{
+		return _mm256_i32gather_ps(src, pos, 4);
+	}
+
+	// There are no 8 or 16 bit gathers. The 32 bits starting at each sample are gathered and sign extended from the low bits.
+	AVX2_TARGET inline __m256 Gather8(const int16_t* src, __m256i pos)
+	{
+		__m256i v = _mm256_i32gather_epi32((const int*)src, pos, 2);
+		return _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+	}
+
+	AVX2_TARGET inline __m256 Gather8(const int8_t* src, __m256i pos)
+	{
+		__m256i v = _mm256_i32gather_epi32((const int*)src, pos, 1);
+		return _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 24), 24));
+	}
+
+	template<typename T>
+	AVX2_TARGET double ResampleAVX2(float* dest, const void* samples, int srcmax, double srcpos, double pitch, size_t count)
+	{
+		const T* src = (const T*)samples;
+		__m256 scale = _mm256_set1_ps(SampleScale(src));
+		__m256i max = _mm256_set1_epi32(srcmax);
+		__m256i one = _mm256_set1_epi32(1);
+		__m256 onef = _mm256_set1_ps(1.0f);
+		__m256d base = _mm256_set1_pd(srcpos);
+		__m256d step = _mm256_set1_pd(pitch);
+		__m256d lanesLow = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+		__m256d lanesHigh = _mm256_setr_pd(4.0, 5.0, 6.0, 7.0);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256d index = _mm256_set1_pd((double)i);
+			__m256d pLow = _mm256_add_pd(base, _mm256_mul_pd(_mm256_add_pd(index, lanesLow), step));
+			__m256d pHigh = _mm256_add_pd(base, _mm256_mul_pd(_mm256_add_pd(index, lanesHigh), step));
+			__m128i iLow = _mm256_cvttpd_epi32(pLow);
+			__m128i iHigh = _mm256_cvttpd_epi32(pHigh);
+			__m128 tLow = _mm256_cvtpd_ps(_mm256_sub_pd(pLow, _mm256_cvtepi32_pd(iLow)));
+			__m128 tHigh = _mm256_cvtpd_ps(_mm256_sub_pd(pHigh, _mm256_cvtepi32_pd(iHigh)));
+			__m256 t = _mm256_insertf128_ps(_mm256_castps128_ps256(tLow), tHigh, 1);
+
+			__m256i pos = _mm256_inserti128_si256(_mm256_castsi128_si256(iLow), iHigh, 1);
+			__m256i pos2 = _mm256_min_epi32(_mm256_add_epi32(pos, one), max);
+			pos = _mm256_min_epi32(pos, max);
+
+			__m256 s0 = Gather8(src, pos);
+			__m256 s1 = Gather8(src, pos2);
+			_mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s0, _mm256_sub_ps(onef, t)), _mm256_mul_ps(s1, t)), scale));
+		}
+		_mm256_zeroupper();
+		return ResampleScalarFrom(dest, src, srcmax, srcpos, pitch, i, count);
+	}
+
+	AVX2_TARGET void MixMonoAVX2(float* dest, const float* src, float volume, size_t count)
+	{
+		__m256 vol = _mm256_set1_ps(volume);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_loadu_ps(dest + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), vol)));
+		_mm256_zeroupper();
+		MixMonoScalar(dest + i, src + i, volume, count - i);
+	}
+
+	AVX2_TARGET void MixCrossfadeAVX2(float* outputOld, float* outputNew, const float* src, float volume, size_t start, float rcpLength, size_t count)
+	{
+		__m256 vol = _mm256_set1_ps(volume);
+		__m256 rcp = _mm256_set1_ps(rcpLength);
+		__m256 one = _mm256_set1_ps(1.0f);
+		__m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 value = _mm256_mul_ps(_mm256_loadu_ps(src + i), vol);
+			__m256 tt = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps((float)(start + i)), lanes), rcp);
+			_mm256_storeu_ps(outputOld + i, _mm256_add_ps(_mm256_loadu_ps(outputOld + i), _mm256_mul_ps(value, _mm256_sub_ps(one, tt))));
+			_mm256_storeu_ps(outputNew + i, _mm256_add_ps(_mm256_loadu_ps(outputNew + i), _mm256_mul_ps(value, tt)));
+		}
+		_mm256_zeroupper();
+		MixCrossfadeScalar(outputOld + i, outputNew + i, src + i, volume, start + i, rcpLength, count - i);
+	}
+
+	AVX2_TARGET void MixStereoAVX2(float* dest, const float* src, float leftVolume, float rightVolume, size_t count)
+	{
+		__m256 vol = _mm256_setr_ps(leftVolume, rightVolume, leftVolume, rightVolume, leftVolume, rightVolume, leftVolume, rightVolume);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 value = _mm256_loadu_ps(src + i);
+			__m256 lo = _mm256_unpacklo_ps(value, value); // s0 s0 s1 s1 | s4 s4 s5 s5
+			__m256 hi = _mm256_unpackhi_ps(value, value); // s2 s2 s3 s3 | s6 s6 s7 s7
+			float* d = dest + (i << 1);
+			__m256 low = _mm256_permute2f128_ps(lo, hi, 0x20);
+			__m256 high = _mm256_permute2f128_ps(lo, hi, 0x31);
+			_mm256_storeu_ps(d, _mm256_add_ps(_mm256_loadu_ps(d), _mm256_mul_ps(low, vol)));
+			_mm256_storeu_ps(d + 8, _mm256_add_ps(_mm256_loadu_ps(d + 8), _mm256_mul_ps(high, vol)));
+		}
+		_mm256_zeroupper();
+		MixStereoScalar(dest + (i << 1), src + i, leftVolume, rightVolume, count - i);
+	}
+
+	AVX2_TARGET void AddStereoAVX2(float* dest, const float* left, const float* right, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 l = _mm256_loadu_ps(left + i);
+			__m256 r = _mm256_loadu_ps(right + i);
+			__m256 lo = _mm256_unpacklo_ps(l, r); // l0 r0 l1 r1 | l4 r4 l5 r5
+			__m256 hi = _mm256_unpackhi_ps(l, r); // l2 r2 l3 r3 | l6 r6 l7 r7
+			float* d = dest + (i << 1);
+			_mm256_storeu_ps(d, _mm256_add_ps(_mm256_loadu_ps(d), _mm256_permute2f128_ps(lo, hi, 0x20)));
+			_mm256_storeu_ps(d + 8, _mm256_add_ps(_mm256_loadu_ps(d + 8), _mm256_permute2f128_ps(lo, hi, 0x31)));
+		}
+		_mm256_zeroupper();
+		AddStereoScalar(dest + (i << 1), left + i, right + i, count - i);
+	}
+
+	AVX2_TARGET void ComplexMultiplyAddAVX2(const kiss_fft_cpx* a, const kiss_fft_cpx* b, kiss_fft_cpx* c, size_t count)
+	{
+		__m256 negateReal = _mm256_castsi256_ps(_mm256_setr_epi32(0x80000000, 0, 0x80000000, 0, 0x80000000, 0, 0x80000000, 0));
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m256 va = _mm256_loadu_ps(&a[i].r);
+			__m256 vb = _mm256_loadu_ps(&b[i].r);
+			__m256 bre = _mm256_moveldup_ps(vb);
+			__m256 bim = _mm256_movehdup_ps(vb);
+			__m256 aswap = _mm256_permute_ps(va, _MM_SHUFFLE(2, 3, 0, 1));
+			__m256 product = _mm256_add_ps(_mm256_mul_ps(va, bre), _mm256_xor_ps(_mm256_mul_ps(aswap, bim), negateReal));
+			_mm256_storeu_ps(&c[i].r, _mm256_add_ps(_mm256_loadu_ps(&c[i].r), product));
+		}
+		_mm256_zeroupper();
+		ComplexMultiplyAddScalar(a + i, b + i, c + i, count - i);
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+
+	void CpuId(int* info, int leaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(info, leaf, 0);
+#else
+		__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	// AVX2 needs both the CPU and the OS saving the YMM registers
+	bool CpuSupportsAVX2()
+	{
+		int info[4];
+		CpuId(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		CpuId(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx)
+			return false;
+
+#ifdef _MSC_VER
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+		if ((xcr0 & 6) != 6)
+			return false;
+
+		CpuId(info, 7);
+		return (info[1] & (1 << 5)) != 0;
+	}
+
+	bool CpuSupportsSSE2()
+	{
+		int info[4];
+		CpuId(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+	}
+
+	template<typename T>
+	double ResampleLoopedT(const MixKernels& kernels, MixSampleFormat format, float* dest, const void* samples, int srcmax, double srcpos, double pitch, double loopEnd, double loopLen, size_t count)
+	{
+		const T* src = (const T*)samples;
+		float scale = SampleScale(src);
+		while (count > 0)
+		{
+			// Run the plain kernel up to the first sample that has to read across the loop end
+			size_t span = 0;
+			double remaining = loopEnd - 1.0 - srcpos;
+			if (remaining > 0.0)
+				span = pitch > 0.0 ? (size_t)std::min(std::ceil(remaining / pitch), (double)count) : count;
+
+			if (span > 0)
+			{
+				srcpos = kernels.Resample[format](dest, src, srcmax, srcpos, pitch, span);
+				dest += span;
+				count -= span;
+			}
+			else
+			{
+				double p0 = srcpos;
+				double p1 = srcpos + 1;
+				if (p0 >= loopEnd) p0 -= loopLen;
+				if (p1 >= loopEnd) p1 -= loopLen;
+
+				int pos = (int)p0;
+				int pos2 = (int)p1;
+				float t = (float)(p0 - pos);
+
+				pos = std::min(pos, srcmax);
+				pos2 = std::min(pos2, srcmax);
+
+				*(dest++) = (src[pos] * (1.0f - t) + src[pos2] * t) * scale;
+				count--;
+				srcpos += pitch;
+			}
+
+			while (srcpos >= loopEnd)
+				srcpos -= loopLen;
+		}
+		return srcpos;
+	}
+
+	MixKernels ScalarKernels()
+	{
+		MixKernels kernels;
+		kernels.Name = "Scalar";
+		kernels.Resample[MixSampleFloat] = ResampleScalar<float>;
+		kernels.Resample[MixSampleS16] = ResampleScalar<int16_t>;
+		kernels.Resample[MixSampleS8] = ResampleScalar<int8_t>;
+		kernels.MixMono = MixMonoScalar;
+		kernels.MixCrossfade = MixCrossfadeScalar;
+		kernels.MixStereo = MixStereoScalar;
+		kernels.AddStereo = AddStereoScalar;
+		kernels.ComplexMultiplyAdd = ComplexMultiplyAddScalar;
+		return kernels;
+	}
+
+	MixKernels SSE2Kernels()
+	{
+		MixKernels kernels;
+		kernels.Name = "SSE2";
+		kernels.Resample[MixSampleFloat] = ResampleSSE2<float>;
+		kernels.Resample[MixSampleS16] = ResampleSSE2<int16_t>;
+		kernels.Resample[MixSampleS8] = ResampleSSE2<int8_t>;
+		kernels.MixMono = MixMonoSSE2;
+		kernels.MixCrossfade = MixCrossfadeSSE2;
+		kernels.MixStereo = MixStereoSSE2;
+		kernels.AddStereo = AddStereoSSE2;
+		kernels.ComplexMultiplyAdd = ComplexMultiplyAddSSE2;
+		return kernels;
+	}
+
+	MixKernels AVX2Kernels()
+	{
+		MixKernels kernels;
+		kernels.Name = "AVX2";
+		kernels.Resample[MixSampleFloat] = ResampleAVX2<float>;
+		kernels.Resample[MixSampleS16] = ResampleAVX2<int16_t>;
+		kernels.Resample[MixSampleS8] = ResampleAVX2<int8_t>;
+		kernels.MixMono = MixMonoAVX2;
+		kernels.MixCrossfade = MixCrossfadeAVX2;
+		kernels.MixStereo = MixStereoAVX2;
+		kernels.AddStereo = AddStereoAVX2;
+		kernels.ComplexMultiplyAdd = ComplexMultiplyAddAVX2;
+		return kernels;
+	}
+
+	MixKernels SelectKernels()
+	{
+		if (CpuSupportsAVX2())
+			return AVX2Kernels();
+		else if (CpuSupportsSSE2())
+			return SSE2Kernels();
+		else
+			return ScalarKernels();
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+	// Self test
+
+	class KernelTest
+	{
+	public:
+		KernelTest(MixKernels kernels, std::vector<std::string>& results) : kernels(kernels), scalar(ScalarKernels()), results(results)
+		{
+		}
+
+		bool Run()
+		{
+			bool passed = true;
+			passed = TestResample(MixSampleFloat, "float") && passed;
+			passed = TestResample(MixSampleS16, "S16") && passed;
+			passed = TestResample(MixSampleS8, "S8") && passed;
+			passed = TestResampleLooped(MixSampleFloat, "float") && passed;
+			passed = TestResampleLooped(MixSampleS16, "S16") && passed;
+			passed = TestResampleLooped(MixSampleS8, "S8") && passed;
+			passed = TestMixMono() && passed;
+			passed = TestMixCrossfade() && passed;
+			passed = TestMixStereo() && passed;
+			passed = TestAddStereo() && passed;
+			passed = TestComplexMultiplyAdd() && passed;
+			return passed;
+		}
+
+	private:
+		enum
+		{
+			Trials = 500,
+			SourceLength = 1000,
+			MaxCount = 1200
+		};
+
+		// Resampling must land on the same positions and weights as the scalar version, so only rounding in the other kernels is allowed
+		static constexpr float ResampleTolerance = 0.0f;
+		static constexpr float MixTolerance = 1e-5f;
+
+		bool TestResample(MixSampleFormat format, const char* formatName)
+		{
+			std::vector<uint8_t> source = RandomSource(format);
+			std::vector<float> expected(MaxCount), actual(MaxCount);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				double srcpos = RandomDouble(0.0, 20.0);
+				double pitch = RandomDouble(0.05, 4.0);
+				size_t count = RandomCount();
+				double end1 = scalar.Resample[format](expected.data(), source.data(), SourceLength - 1, srcpos, pitch, count);
+				double end2 = kernels.Resample[format](actual.data(), source.data(), SourceLength - 1, srcpos, pitch, count);
+				passed = Compare(expected.data(), actual.data(), count, ResampleTolerance, maxError) && end1 == end2 && passed;
+			}
+			return Report("Resample", formatName, passed, maxError);
+		}
+
+		bool TestResampleLooped(MixSampleFormat format, const char* formatName)
+		{
+			std::vector<uint8_t> source = RandomSource(format);
+			std::vector<float> expected(MaxCount), actual(MaxCount);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				double loopEnd = RandomDouble(100.0, SourceLength - 1.0);
+				double loopLen = RandomDouble(10.0, loopEnd);
+				double srcpos = RandomDouble(0.0, loopEnd);
+				double pitch = RandomDouble(0.05, 4.0);
+				size_t count = RandomCount();
+				double end1 = scalar.ResampleLooped(format, expected.data(), source.data(), SourceLength - 1, srcpos, pitch, loopEnd, loopLen, count);
+				double end2 = kernels.ResampleLooped(format, actual.data(), source.data(), SourceLength - 1, srcpos, pitch, loopEnd, loopLen, count);
+				passed = Compare(expected.data(), actual.data(), count, ResampleTolerance, maxError) && end1 == end2 && passed;
+			}
+			return Report("ResampleLooped", formatName, passed, maxError);
+		}
+
+		bool TestMixMono()
+		{
+			std::vector<float> src = RandomFloats(MaxCount);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				std::vector<float> expected = RandomFloats(MaxCount), actual = expected;
+				float volume = RandomFloat(0.0f, 1.0f);
+				size_t count = RandomCount();
+				scalar.MixMono(expected.data(), src.data(), volume, count);
+				kernels.MixMono(actual.data(), src.data(), volume, count);
+				passed = Compare(expected.data(), actual.data(), MaxCount, MixTolerance, maxError) && passed;
+			}
+			return Report("MixMono", nullptr, passed, maxError);
+		}
+
+		bool TestMixCrossfade()
+		{
+			std::vector<float> src = RandomFloats(MaxCount);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				std::vector<float> expectedOld = RandomFloats(MaxCount), actualOld = expectedOld;
+				std::vector<float> expectedNew = RandomFloats(MaxCount), actualNew = expectedNew;
+				float volume = RandomFloat(0.0f, 1.0f);
+				size_t count = RandomCount();
+				size_t start = RandomCount();
+				float rcpLength = 1.0f / (float)(start + count + 1);
+				scalar.MixCrossfade(expectedOld.data(), expectedNew.data(), src.data(), volume, start, rcpLength, count);
+				kernels.MixCrossfade(actualOld.data(), actualNew.data(), src.data(), volume, start, rcpLength, count);
+				passed = Compare(expectedOld.data(), actualOld.data(), MaxCount, MixTolerance, maxError) && passed;
+				passed = Compare(expectedNew.data(), actualNew.data(), MaxCount, MixTolerance, maxError) && passed;
+			}
+			return Report("MixCrossfade", nullptr, passed, maxError);
+		}
+
+		bool TestMixStereo()
+		{
+			std::vector<float> src = RandomFloats(MaxCount);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				std::vector<float> expected = RandomFloats(MaxCount * 2), actual = expected;
+				float leftVolume = RandomFloat(0.0f, 1.0f);
+				float rightVolume = RandomFloat(0.0f, 1.0f);
+				size_t count = RandomCount();
+				scalar.MixStereo(expected.data(), src.data(), leftVolume, rightVolume, count);
+				kernels.MixStereo(actual.data(), src.data(), leftVolume, rightVolume, count);
+				passed = Compare(expected.data(), actual.data(), MaxCount * 2, MixTolerance, maxError) && passed;
+			}
+			return Report("MixStereo", nullptr, passed, maxError);
+		}
+
+		bool TestAddStereo()
+		{
+			std::vector<float> left = RandomFloats(MaxCount), right = RandomFloats(MaxCount);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				std::vector<float> expected = RandomFloats(MaxCount * 2), actual = expected;
+				size_t count = RandomCount();
+				scalar.AddStereo(expected.data(), left.data(), right.data(), count);
+				kernels.AddStereo(actual.data(), left.data(), right.data(), count);
+				passed = Compare(expected.data(), actual.data(), MaxCount * 2, MixTolerance, maxError) && passed;
+			}
+			return Report("AddStereo", nullptr, passed, maxError);
+		}
+
+		bool TestComplexMultiplyAdd()
+		{
+			std::vector<float> a = RandomFloats(MaxCount * 2), b = RandomFloats(MaxCount * 2);
+			float maxError = 0.0f;
+			bool passed = true;
+			for (int trial = 0; trial < Trials; trial++)
+			{
+				std::vector<float> expected = RandomFloats(MaxCount * 2), actual = expected;
+				size_t count = RandomCount();
+				scalar.ComplexMultiplyAdd((const kiss_fft_cpx*)a.data(), (const kiss_fft_cpx*)b.data(), (kiss_fft_cpx*)expected.data(), count);
+				kernels.ComplexMultiplyAdd((const kiss_fft_cpx*)a.data(), (const kiss_fft_cpx*)b.data(), (kiss_fft_cpx*)actual.data(), count);
+				passed = Compare(expected.data(), actual.data(), MaxCount * 2, MixTolerance, maxError) && passed;
+			}
+			return Report("ComplexMultiplyAdd", nullptr, passed, maxError);
+		}
+
+		// Source samples, with room for the bytes the integer kernels may read past the end
+		std::vector<uint8_t> RandomSource(MixSampleFormat format)
+		{
+			std::vector<uint8_t> source((SourceLength + 1) * sizeof(float));
+			for (int i = 0; i < SourceLength; i++)
+			{
+				if (format == MixSampleFloat)
+					((float*)source.data())[i] = RandomFloat(-1.0f, 1.0f);
+				else if (format == MixSampleS16)
+					((int16_t*)source.data())[i] = (int16_t)std::uniform_int_distribution<int>(-32768, 32767)(random);
+				else
+					((int8_t*)source.data())[i] = (int8_t)std::uniform_int_distribution<int>(-128, 127)(random);
+			}
+			return source;
+		}
+
+		std::vector<float> RandomFloats(size_t count)
+		{
+			std::vector<float> values(count);
+			for (float& v : values)
+				v = RandomFloat(-1.0f, 1.0f);
+			return values;
+		}
+
+		// Mostly short blocks, so that the tails after the vector loops get tested as much as the loops
+		size_t RandomCount()
+		{
+			if (std::uniform_int_distribution<int>(0, 1)(random) == 0)
+				return std::uniform_int_distribution<size_t>(0, 20)(random);
+			return std::uniform_int_distribution<size_t>(0, MaxCount)(random);
+		}
+
+		double RandomDouble(double low, double high) { return std::uniform_real_distribution<double>(low, high)(random); }
+		float RandomFloat(float low, float high) { return std::uniform_real_distribution<float>(low, high)(random); }
+
+		static bool Compare(const float* expected, const float* actual, size_t count, float tolerance, float& maxError)
+		{
+			bool passed = true;
+			for (size_t i = 0; i < count; i++)
+			{
+				float error = std::fabs(expected[i] - actual[i]);
+				maxError = std::max(maxError, error);
+				if (!(error <= tolerance * std::max(1.0f, std::fabs(expected[i]))))
+					passed = false;
+			}
+			return passed;
+		}
+
+		bool Report(const char* test, const char* formatName, bool passed, float maxError)
+		{
+			char line[256];
+			if (formatName)
+				snprintf(line, sizeof(line), "%s %s %s: %s (max error %g)", kernels.Name, test, formatName, passed ? "passed" : "FAILED", maxError);
+			else
+				snprintf(line, sizeof(line), "%s %s: %s (max error %g)", kernels.Name, test, passed ? "passed" : "FAILED", maxError);
+			results.push_back(line);
+			return passed;
+		}
+
+		MixKernels kernels;
+		MixKernels scalar;
+		std::vector<std::string>& results;
+		std::mt19937 random{ 12345 };
+	};
+}
+
+const MixKernels& MixKernels::Get()
+{
+	static MixKernels kernels = SelectKernels();
+	return kernels;
+}
+
+bool MixKernels::SelfTest(std::vector<std::string>& results)
+{
+	bool passed = true;
+	if (CpuSupportsSSE2())
+		passed = KernelTest(SSE2Kernels(), results).Run() && passed;
+	else
+		results.push_back("SSE2 skipped: not supported by this CPU");
+	if (CpuSupportsAVX2())
+		passed = KernelTest(AVX2Kernels(), results).Run() && passed;
+	else
+		results.push_back("AVX2 skipped: not supported by this CPU");
+	return passed;
+}
+
+double MixKernels::ResampleLooped(MixSampleFormat format, float* dest, const void* src, int srcmax, double srcpos, double pitch, double loopEnd, double loopLen, size_t count) const
+{
+	switch (format)
+	{
+	default:
+	case MixSampleFloat: return ResampleLoopedT<float>(*this, format, dest, src, srcmax, srcpos, pitch, loopEnd, loopLen, count);
+	case MixSampleS16: return ResampleLoopedT<int16_t>(*this, format, dest, src, srcmax, srcpos, pitch, loopEnd, loopLen, count);
+	case MixSampleS8: return ResampleLoopedT<int8_t>(*this, format, dest, src, srcmax, srcpos, pitch, loopEnd, loopLen, count);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "kissfft/kiss_fft.h"
+#include <string>
+#include <vector>
+
+// How the samples of a sound are stored
+enum MixSampleFormat
+{
+	MixSampleFloat,
+	MixSampleS16,
+	MixSampleS8,
+	MixSampleFormatCount
+};
+
+// Inner loops of the mixer. Get() picks the AVX2, SSE2 or scalar versions once, based on what the CPU supports.
+class MixKernels
+{
+public:
+	static const MixKernels& Get();
+
+	// Runs every SSE2 and AVX2 kernel the CPU supports against the scalar versions on random input, for every sample format.
+	// Adds one line per kernel to results and returns false if any of them differ by more than rounding.
+	static bool SelfTest(std::vector<std::string>& results);
+
+	const char* Name = "";
+
+	// dest[i] = linear interpolation of src at srcpos + i * pitch converted to float, with positions clamped to srcmax. Returns the position after the last sample.
+	// There is one for each MixSampleFormat. The integer versions may read up to three bytes past the sample at srcmax.
+	double (*Resample[MixSampleFormatCount])(float* dest, const void* src, int srcmax, double srcpos, double pitch, size_t count) = {};
+
+	// dest[i] += src[i] * volume
+	void (*MixMono)(float* dest, const float* src, float volume, size_t count) = nullptr;
+
+	// Fades src out of outputOld and into outputNew. The fade is at (start + i) * rcpLength for sample i.
+	void (*MixCrossfade)(float* outputOld, float* outputNew, const float* src, float volume, size_t start, float rcpLength, size_t count) = nullptr;
+
+	// Adds src to interleaved stereo output
+	void (*MixStereo)(float* dest, const float* src, float leftVolume, float rightVolume, size_t count) = nullptr;
+
+	// Adds left and right to interleaved stereo output
+	void (*AddStereo)(float* dest, const float* left, const float* right, size_t count) = nullptr;
+
+	// c[i] += a[i] * b[i] for complex numbers
+	void (*ComplexMultiplyAdd)(const kiss_fft_cpx* a, const kiss_fft_cpx* b, kiss_fft_cpx* c, size_t count) = nullptr;
+
+	// Like Resample, except positions wrap around to loopEnd - loopLen when they reach loopEnd
+	double ResampleLooped(MixSampleFormat format, float* dest, const void* src, int srcmax, double srcpos, double pitch, double loopEnd, double loopLen, size_t count) const;
+};
@@ -4,6 +4,7 @@
 #include "resample/CDSPResampler.h"
 #include <stdexcept>
 #include <functional>
+#include <cmath>
 
 #ifdef _MSC_VER
 #pragma warning(disable: 4267)
@@ -257,6 +258,28 @@ public:
 		}
 	}
 
+	int GetBitsPerSample() override
+	{
+		if (decoder.translatedFormatTag == DR_WAVE_FORMAT_PCM && decoder.bitsPerSample <= 16)
+			return decoder.bitsPerSample;
+		else
+			return 32;
+	}
+
+	size_t ReadSamples(int16_t* output, size_t samples) override
+	{
+		if (!eofdata)
+		{
+			size_t samplesread = drwav_read_pcm_frames_s16(&decoder, samples / decoder.channels, output) * decoder.channels;
+			eofdata = (samplesread != samples);
+			return samplesread;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
 	size_t InputRead(void* pBufferOut, size_t bytesToRead)
 	{
 		size_t available = filedata.size() - inputpos;
@@ -556,6 +579,22 @@ public:
 	DUH_SIGRENDERER* renderer = nullptr;
 };
 
+size_t AudioSource::ReadSamples(int16_t* output, size_t samples)
+{
+	float buffer[1024];
+	size_t total = 0;
+	while (total < samples)
+	{
+		size_t count = ReadSamples(buffer, std::min(samples - total, (size_t)1024));
+		for (size_t i = 0; i < count; i++)
+			output[total + i] = (int16_t)std::max(std::min((int)std::round(buffer[i] * 32768.0f), 32767), -32768);
+		total += count;
+		if (count == 0)
+			break;
+	}
+	return total;
+}
+
 std::unique_ptr<AudioSource> AudioSource::CreateMp3(std::vector<uint8_t> filedata)
 {
 	return std::make_unique<Mp3AudioSource>(std::move(filedata));
@@ -20,4 +20,10 @@ public:
 	virtual int GetSamples() = 0;
 	virtual void SeekToSample(uint64_t position) = 0;
 	virtual size_t ReadSamples(float* output, size_t samples) = 0;
+
+	// Bits per sample of the data before it is decoded to float. 32 unless the source is 8 or 16 bit PCM.
+	virtual int GetBitsPerSample() { return 32; }
+
+	// Reads samples as 16 bit integers. The default converts from ReadSamples(float*).
+	virtual size_t ReadSamples(int16_t* output, size_t samples);
 };
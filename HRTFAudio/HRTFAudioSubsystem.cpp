@@ -2,6 +2,7 @@
 #include "Precomp.h"
 #include "HRTFAudioSubsystem.h"
 #include "AudioSource.h"
+#include "AudioMixerKernels.h"
 #include "resource.h"
 
 IMPLEMENT_CLASS(UHRTFAudioSubsystem);
@@ -16,6 +17,10 @@ void UHRTFAudioSubsystem::StaticConstructor()
 {
 	guard(UHRTFAudioSubsystem::StaticConstructor);
 
+	HRTFBlockSize = 128;
+	HRTFChannels = 16;
+	HRTFMaxSounds = 256;
+
 	UEnum* OutputRates = new(GetClass(), TEXT("OutputRates"))UEnum(nullptr);
 	new(OutputRates->Names)FName(TEXT("8000Hz"));
 	new(OutputRates->Names)FName(TEXT("11025Hz"));
@@ -37,6 +42,9 @@ void UHRTFAudioSubsystem::StaticConstructor()
 	new(GetClass(), TEXT("SoundVolume"), RF_Public)UByteProperty(CPP_PROPERTY(SoundVolume), TEXT("Audio"), CPF_Config);
 	new(GetClass(), TEXT("AmbientFactor"), RF_Public)UFloatProperty(CPP_PROPERTY(AmbientFactor), TEXT("Audio"), CPF_Config);
 	new(GetClass(), TEXT("DopplerSpeed"), RF_Public)UFloatProperty(CPP_PROPERTY(DopplerSpeed), TEXT("Audio"), CPF_Config);
+	new(GetClass(), TEXT("HRTFBlockSize"), RF_Public)UIntProperty(CPP_PROPERTY(HRTFBlockSize), TEXT("Audio"), CPF_Config);
+	new(GetClass(), TEXT("HRTFChannels"), RF_Public)UIntProperty(CPP_PROPERTY(HRTFChannels), TEXT("Audio"), CPF_Config);
+	new(GetClass(), TEXT("HRTFMaxSounds"), RF_Public)UIntProperty(CPP_PROPERTY(HRTFMaxSounds), TEXT("Audio"), CPF_Config);
 
 	unguard;
 }
@@ -65,7 +73,7 @@ UBOOL UHRTFAudioSubsystem::Init()
 				throw std::runtime_error("LockResource(IDR_HRTF, Zip) failed");
 			}
 
-			Mixer = AudioMixer::Create(zipData, zipSize);
+			Mixer = AudioMixer::Create(zipData, zipSize, Clamp(HRTFBlockSize, 64, 256), Clamp(HRTFChannels, 1, 64), Clamp(HRTFMaxSounds, 32, 1024));
 
 			UnlockResource(resource);
 			FreeResource(resource);
@@ -100,6 +108,9 @@ void UHRTFAudioSubsystem::PostEditChange()
 	Channels = Clamp(Channels, 0, 32);
 	DopplerSpeed = Clamp(DopplerSpeed, 1.0f, 100000.0f);
 	AmbientFactor = Clamp(AmbientFactor, 0.0f, 10.0f);
+	HRTFBlockSize = Clamp(HRTFBlockSize, 64, 256);
+	HRTFChannels = Clamp(HRTFChannels, 1, 64);
+	HRTFMaxSounds = Clamp(HRTFMaxSounds, 32, 1024);
 
 	unguard;
 }
@@ -116,6 +127,15 @@ UBOOL UHRTFAudioSubsystem::Exec(const TCHAR* Cmd, FOutputDevice& Ar)
 			return 1;
 		}
 	}
+	else if (ParseCommand(&Str, TEXT("HRTFTestKernels")))
+	{
+		std::vector<std::string> results;
+		bool passed = MixKernels::SelfTest(results);
+		for (const std::string& line : results)
+			Ar.Log(appFromAnsi(line.c_str()));
+		Ar.Logf(TEXT("Mixer kernels %s, using %s"), passed ? TEXT("passed") : TEXT("FAILED"), appFromAnsi(MixKernels::Get().Name));
+		return 1;
+	}
 	return 0;
 	unguard;
 }
@@ -476,6 +496,24 @@ void UHRTFAudioSubsystem::PostRender(FSceneNode* Frame)
 				Frame->Viewport->Canvas->WrappedPrintf(Frame->Viewport->Canvas->SmallFont, 0, TEXT("Not in a reverb zone"));
 			}
 		}
+
+		if (Mixer)
+		{
+			INT Factor = 8;
+
+			AudioMixerStats Stats = Mixer->GetStats();
+			Frame->Viewport->Canvas->CurX = 10;
+			Frame->Viewport->Canvas->CurY = 24 + Factor * (Channels + 2 + ARRAY_COUNT(AZoneInfo::Delay));
+			Frame->Viewport->Canvas->WrappedPrintf(Frame->Viewport->Canvas->SmallFont, 0, TEXT("Mixer: %05.2f HRTF channels, %05.2f clustered sounds, %06.1f us per channel, %06.1f us per frame"), Stats.HrtfChannels, Stats.ClusteredSounds, Stats.HrtfChannelMicroseconds, Stats.FrameMicroseconds);
+
+			Frame->Viewport->Canvas->CurX = 10;
+			Frame->Viewport->Canvas->CurY = 24 + Factor * (Channels + 3 + ARRAY_COUNT(AZoneInfo::Delay));
+			Frame->Viewport->Canvas->WrappedPrintf(Frame->Viewport->Canvas->SmallFont, 0, TEXT("Sounds: %i loaded, %i loading, %05.2f MB in use, %05.2f MB pooled, %.1f ms spent loading"), Stats.Sounds, Stats.LoadingSounds, Stats.SoundBytes / (1024.0f * 1024.0f), Stats.PooledBytes / (1024.0f * 1024.0f), Stats.LoadMilliseconds);
+
+			Frame->Viewport->Canvas->CurX = 10;
+			Frame->Viewport->Canvas->CurY = 24 + Factor * (Channels + 4 + ARRAY_COUNT(AZoneInfo::Delay));
+			Frame->Viewport->Canvas->WrappedPrintf(Frame->Viewport->Canvas->SmallFont, 0, TEXT("Music: %06.1f us per buffer, %i underruns"), Stats.MusicMicroseconds, Stats.MusicUnderruns);
+		}
 	}
 
 	unguard;
@@ -88,6 +88,9 @@ private:
 	BYTE SoundVolume;
 	FLOAT AmbientFactor;
 	FLOAT DopplerSpeed;
+	INT HRTFBlockSize;
+	INT HRTFChannels;
+	INT HRTFMaxSounds;
 
 	std::unique_ptr<AudioMixer> Mixer;
 	std::vector<PlayingSound> PlayingSounds;
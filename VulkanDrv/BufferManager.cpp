@@ -5,51 +5,191 @@
 
 BufferManager::BufferManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
+	StagingVertices = ShouldStageVertices();
+	debugf(TEXT("Vulkan scene vertices: %s"), StagingVertices ? TEXT("staged to device local memory") : TEXT("read from host visible memory"));
+
 	CreateSceneVertexBuffer();
 	CreateSceneIndexBuffer();
+	CreateTileInstanceBuffer();
 	CreateUploadBuffer();
+
+	SceneMemoryCached = IsHostCached(StagingVertices ? SceneVertexStaging.get() : SceneVertexBuffer.get());
 }
 
 BufferManager::~BufferManager()
 {
-	if (SceneVertices) { SceneVertexBuffer->Unmap(); SceneVertices = nullptr; }
-	if (SceneIndexes) { SceneIndexBuffer->Unmap(); SceneIndexes = nullptr; }
+	VulkanBuffer* vertexMapping = StagingVertices ? SceneVertexStaging.get() : SceneVertexBuffer.get();
+	VulkanBuffer* indexMapping = StagingVertices ? SceneIndexStaging.get() : SceneIndexBuffer.get();
+	VulkanBuffer* tileMapping = StagingVertices ? TileInstanceStaging.get() : TileInstanceBuffer.get();
+	if (SceneVertices) { vertexMapping->Unmap(); SceneVertices = nullptr; }
+	if (SceneIndexes) { indexMapping->Unmap(); SceneIndexes = nullptr; }
+	if (TileInstances) { tileMapping->Unmap(); TileInstances = nullptr; }
+}
+
+bool BufferManager::ShouldStageVertices()
+{
+	if (renderer->VkVertexStreaming == 1)
+		return false;
+	else if (renderer->VkVertexStreaming == 2)
+		return true;
+
+	// Integrated GPUs read system memory just as fast as any other memory
+	const auto& props = renderer->Device->PhysicalDevice.Properties;
+	if (props.Properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+		return false;
+
+	// With resizable BAR the GPU has a large device local heap the CPU can write into directly.
+	// Without it, only a small window is host visible and reads of system memory go over the bus on every draw.
+	const VkPhysicalDeviceMemoryProperties& memory = props.Memory;
+	const VkMemoryPropertyFlags barFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	for (uint32_t i = 0; i < memory.memoryTypeCount; i++)
+	{
+		const VkMemoryType& type = memory.memoryTypes[i];
+		if ((type.propertyFlags & barFlags) == barFlags && memory.memoryHeaps[type.heapIndex].size > 256 * 1024 * 1024)
+			return false;
+	}
+	return true;
+}
+
+bool BufferManager::IsHostCached(VulkanBuffer* buffer)
+{
+	VkMemoryPropertyFlags flags = 0;
+	vmaGetAllocationMemoryProperties(renderer->Device->allocator, buffer->allocation, &flags);
+	return (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+}
+
+void BufferManager::CopyStagedVertices(VulkanCommandBuffer* cmdbuffer, size_t vcount, size_t icount, size_t tcount)
+{
+	// Everything drawn since the last submit is copied in one transfer ahead of the draw commands
+	if (vcount == 0 && icount == 0 && tcount == 0)
+		return;
+
+	if (vcount > 0)
+		cmdbuffer->copyBuffer(SceneVertexStaging.get(), SceneVertexBuffer.get(), 0, 0, vcount * sizeof(SceneVertex));
+	if (icount > 0)
+		cmdbuffer->copyBuffer(SceneIndexStaging.get(), SceneIndexBuffer.get(), 0, 0, icount * sizeof(uint32_t));
+	if (tcount > 0)
+		cmdbuffer->copyBuffer(TileInstanceStaging.get(), TileInstanceBuffer.get(), 0, 0, tcount * sizeof(TileInstance));
+
+	PipelineBarrier()
+		.AddMemory(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 }
 
 void BufferManager::CreateSceneVertexBuffer()
 {
 	size_t size = sizeof(SceneVertex) * SceneVertexBufferSize;
 
-	SceneVertexBuffer = BufferBuilder()
-		.Usage(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VMA_MEMORY_USAGE_UNKNOWN, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT)
-		.MemoryType(
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-		.Size(size)
-		.DebugName("SceneVertexBuffer")
-		.Create(renderer->Device.get());
+	if (StagingVertices)
+	{
+		SceneVertexBuffer = CreateSceneBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, "SceneVertexBuffer");
+		SceneVertexStaging = CreateStagingBuffer(size, "SceneVertexStaging");
+		SceneVertices = (SceneVertex*)SceneVertexStaging->Map(0, size);
+	}
+	else
+	{
+		SceneVertexBuffer = BufferBuilder()
+			.Usage(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VMA_MEMORY_USAGE_UNKNOWN, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT)
+			.MemoryType(
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+			.Size(size)
+			.DebugName("SceneVertexBuffer")
+			.Create(renderer->Device.get());
 
-	SceneVertices = (SceneVertex*)SceneVertexBuffer->Map(0, size);
+		SceneVertices = (SceneVertex*)SceneVertexBuffer->Map(0, size);
+	}
 }
 
 void BufferManager::CreateSceneIndexBuffer()
 {
 	size_t size = sizeof(uint32_t) * SceneIndexBufferSize;
 
-	SceneIndexBuffer = BufferBuilder()
+	if (StagingVertices)
+	{
+		SceneIndexBuffer = CreateSceneBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, "SceneIndexBuffer");
+		SceneIndexStaging = CreateStagingBuffer(size, "SceneIndexStaging");
+		SceneIndexes = (uint32_t*)SceneIndexStaging->Map(0, size);
+	}
+	else
+	{
+		SceneIndexBuffer = BufferBuilder()
+			.Usage(
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VMA_MEMORY_USAGE_UNKNOWN, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT)
+			.MemoryType(
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+			.Size(size)
+			.DebugName("SceneIndexBuffer")
+			.Create(renderer->Device.get());
+
+		SceneIndexes = (uint32_t*)SceneIndexBuffer->Map(0, size);
+	}
+}
+
+void BufferManager::CreateTileInstanceBuffer()
+{
+	size_t size = sizeof(TileInstance) * TileInstanceBufferSize;
+
+	if (StagingVertices)
+	{
+		TileInstanceBuffer = CreateSceneBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, "TileInstanceBuffer");
+		TileInstanceStaging = CreateStagingBuffer(size, "TileInstanceStaging");
+		TileInstances = (TileInstance*)TileInstanceStaging->Map(0, size);
+	}
+	else
+	{
+		TileInstanceBuffer = BufferBuilder()
+			.Usage(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VMA_MEMORY_USAGE_UNKNOWN, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT)
+			.MemoryType(
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+			.Size(size)
+			.DebugName("TileInstanceBuffer")
+			.Create(renderer->Device.get());
+
+		TileInstances = (TileInstance*)TileInstanceBuffer->Map(0, size);
+	}
+}
+
+std::unique_ptr<VulkanBuffer> BufferManager::CreateSceneBuffer(VkBufferUsageFlags usage, size_t size, const char* name)
+{
+	return BufferBuilder()
+		.Usage(usage, VMA_MEMORY_USAGE_GPU_ONLY, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT)
+		.Size(size)
+		.DebugName(name)
+		.Create(renderer->Device.get());
+}
+
+std::unique_ptr<VulkanBuffer> BufferManager::CreateStagingBuffer(size_t size, const char* name)
+{
+	// The CPU only ever writes the staging buffers, with non-temporal stores, and the copy engine reads them.
+	// Write-combined system memory suits that best. It also keeps them out of the small BAR heap.
+	// If the device has no such type, any coherent host visible memory is used and SceneMemoryCached picks plain stores.
+	const VkPhysicalDeviceMemoryProperties& memory = renderer->Device->PhysicalDevice.Properties.Memory;
+	const VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	const VkMemoryPropertyFlags avoidFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	uint32_t writeCombinedTypes = 0;
+	for (uint32_t i = 0; i < memory.memoryTypeCount; i++)
+	{
+		VkMemoryPropertyFlags flags = memory.memoryTypes[i].propertyFlags;
+		if ((flags & hostFlags) == hostFlags && (flags & avoidFlags) == 0)
+			writeCombinedTypes |= 1 << i;
+	}
+
+	return BufferBuilder()
 		.Usage(
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VMA_MEMORY_USAGE_UNKNOWN, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT)
-		.MemoryType(
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+		.MemoryType(hostFlags, hostFlags, writeCombinedTypes)
 		.Size(size)
-		.DebugName("SceneIndexBuffer")
+		.DebugName(name)
 		.Create(renderer->Device.get());
-
-	SceneIndexes = (uint32_t*)SceneIndexBuffer->Map(0, size);
 }
 
 void BufferManager::CreateUploadBuffer()
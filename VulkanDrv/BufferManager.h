@@ -13,20 +13,40 @@ public:
 
 	std::unique_ptr<VulkanBuffer> SceneVertexBuffer;
 	std::unique_ptr<VulkanBuffer> SceneIndexBuffer;
+	std::unique_ptr<VulkanBuffer> TileInstanceBuffer;
 	std::unique_ptr<VulkanBuffer> UploadBuffer;
 
+	// When staging, SceneVertices and SceneIndexes point into system memory and the
+	// used range is copied to the device local scene buffers before each submit.
+	std::unique_ptr<VulkanBuffer> SceneVertexStaging;
+	std::unique_ptr<VulkanBuffer> SceneIndexStaging;
+	std::unique_ptr<VulkanBuffer> TileInstanceStaging;
+	bool StagingVertices = false;
+
+	// Whether the mapped scene buffers are cached host memory rather than write-combined memory
+	bool SceneMemoryCached = false;
+
+	void CopyStagedVertices(VulkanCommandBuffer* cmdbuffer, size_t vcount, size_t icount, size_t tcount);
+
 	SceneVertex* SceneVertices = nullptr;
 	uint32_t* SceneIndexes = nullptr;
+	TileInstance* TileInstances = nullptr;
 	uint8_t* UploadData = nullptr;
 
 	static const int SceneVertexBufferSize = 1 * 1024 * 1024;
 	static const int SceneIndexBufferSize = 1 * 1024 * 1024;
+	static const int TileInstanceBufferSize = 64 * 1024;
 
 	static const int UploadBufferSize = 64 * 1024 * 1024;
 
 private:
+	bool ShouldStageVertices();
+	bool IsHostCached(VulkanBuffer* buffer);
 	void CreateSceneVertexBuffer();
 	void CreateSceneIndexBuffer();
+	void CreateTileInstanceBuffer();
+	std::unique_ptr<VulkanBuffer> CreateSceneBuffer(VkBufferUsageFlags usage, size_t size, const char* name);
+	std::unique_ptr<VulkanBuffer> CreateStagingBuffer(size_t size, const char* name);
 	void CreateUploadBuffer();
 
 	UVulkanRenderDevice* renderer = nullptr;
@@ -10,6 +10,17 @@ public:
 	int BindlessIndex[4] = { -1, -1, -1, -1 };
 	int RealtimeChangeCount = 0;
 
+	// What the texture was converted from. A Flush only rechecks these instead of throwing the texture away.
+	void* Source = nullptr;
+	int USize = 0;
+	int VSize = 0;
+	int NumMips = 0;
+	int Format = 0;
+	void* MipData = nullptr;
+	uint32_t PaletteHash = 0;
+	int ValidatedFlush = 0;
+	int LastUsedFlush = 0;
+
 	std::vector<VkBufferImageCopy> pendingUploads[2];
 	bool inPendingUploads = false;
 };
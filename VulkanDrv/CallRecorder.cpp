@@ -0,0 +1,852 @@
+
+#include "Precomp.h"
+#include "CallRecorder.h"
+#include "UVulkanRenderDevice.h"
+#include "TextureUploader.h"
+#include <chrono>
+
+static int GetMipDataSize(ETextureFormat format, int width, int height)
+{
+	// The uploaders report the size of the converted data. Only a few formats differ from their source size.
+	if (format == TEXF_P8)
+		return width * height;
+#if defined(OLDUNREAL469SDK)
+	if (format == TEXF_RGB10A2 || format == TEXF_RGB10A2_UI || format == TEXF_RGB10A2_LM)
+		return width * height * 4;
+#endif
+	TextureUploader* uploader = TextureUploader::GetUploader(format);
+	return uploader ? uploader->GetUploadSize(0, 0, width, height) : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CallRecorder::CallRecorder(FArchive* file) : File(file)
+{
+	DWORD magic = FileMagic;
+	INT version = FileVersion;
+	*File << magic << version;
+}
+
+CallRecorder::~CallRecorder()
+{
+	File->Close();
+}
+
+void CallRecorder::WriteCall(RecordedCall call)
+{
+	BYTE type = (BYTE)call;
+	*File << type;
+}
+
+void CallRecorder::Lock(FPlane FlashScale, FPlane FlashFog, FPlane ScreenClear, DWORD RenderLockFlags)
+{
+	InFrame = true;
+	LastFrame = nullptr;
+
+	WriteCall(RecordedCall::Lock);
+	*File << FlashScale << FlashFog << ScreenClear << RenderLockFlags;
+}
+
+void CallRecorder::Unlock(UBOOL Blit)
+{
+	if (!InFrame)
+		return;
+
+	WriteCall(RecordedCall::Unlock);
+	*File << Blit;
+
+	InFrame = false;
+	FrameCount++;
+}
+
+void CallRecorder::WriteSceneNode(const FSceneNode* Frame)
+{
+	INT X = Frame->X, Y = Frame->Y, XB = Frame->XB, YB = Frame->YB;
+	FLOAT FX = Frame->FX, FY = Frame->FY, FX2 = Frame->FX2, FY2 = Frame->FY2;
+	FLOAT Zoom = Frame->Zoom, Mirror = Frame->Mirror;
+	FPlane NearClip = Frame->NearClip;
+	FCoords Coords = Frame->Coords, Uncoords = Frame->Uncoords;
+	*File << X << Y << XB << YB << FX << FY << FX2 << FY2 << Zoom << Mirror << NearClip << Coords << Uncoords;
+	LastFrame = Frame;
+}
+
+void CallRecorder::UseFrame(const FSceneNode* Frame)
+{
+	if (Frame != LastFrame)
+	{
+		WriteCall(RecordedCall::SceneNode);
+		FLOAT FovAngle = 0.0f;
+		*File << FovAngle;
+		WriteSceneNode(Frame);
+	}
+}
+
+void CallRecorder::SetSceneNode(FSceneNode* Frame, FLOAT FovAngle)
+{
+	if (!InFrame)
+		return;
+
+	WriteCall(RecordedCall::SetSceneNode);
+	*File << FovAngle;
+	WriteSceneNode(Frame);
+}
+
+QWORD CallRecorder::UseTexture(const FTextureInfo* Info)
+{
+	if (!Info)
+		return 0;
+
+	// Realtime textures (fire, water, scripted) are written again every time they change
+	if (KnownTextures.find(Info->CacheID) == KnownTextures.end() || Info->bRealtimeChanged)
+	{
+		WriteTexture(*Info);
+		KnownTextures.insert(Info->CacheID);
+	}
+	return Info->CacheID;
+}
+
+void CallRecorder::WriteTexture(const FTextureInfo& Info)
+{
+	WriteCall(RecordedCall::Texture);
+
+	QWORD CacheID = Info.CacheID;
+	BYTE Format = (BYTE)Info.Format;
+	FLOAT UScale = Info.UScale, VScale = Info.VScale;
+	INT USize = Info.USize, VSize = Info.VSize, UClamp = Info.UClamp, VClamp = Info.VClamp;
+	FVector Pan = Info.Pan;
+	INT NumMips = Info.NumMips;
+	*File << CacheID << Format << UScale << VScale << USize << VSize << UClamp << VClamp << Pan << NumMips;
+
+	for (INT level = 0; level < NumMips; level++)
+	{
+		FMipmapBase* Mip = Info.Mips[level];
+		INT MipUSize = Mip->USize, MipVSize = Mip->VSize;
+		BYTE UBits = Mip->UBits, VBits = Mip->VBits;
+		INT DataSize = Mip->DataPtr ? GetMipDataSize(Info.Format, MipUSize, MipVSize) : 0;
+		*File << MipUSize << MipVSize << UBits << VBits << DataSize;
+		if (DataSize > 0)
+			File->Serialize(Mip->DataPtr, DataSize);
+	}
+
+	UBOOL HasPalette = Info.Palette ? 1 : 0;
+	*File << HasPalette;
+	if (HasPalette)
+		File->Serialize(Info.Palette, 256 * sizeof(FColor));
+}
+
+void CallRecorder::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet)
+{
+	if (!InFrame)
+		return;
+
+	FTextureInfo* textures[5] =
+	{
+		Surface.Texture,
+		Surface.LightMap,
+		Surface.MacroTexture,
+		Surface.DetailTexture,
+		(Surface.FogMap && Surface.FogMap->Mips[0] && Surface.FogMap->Mips[0]->DataPtr) ? Surface.FogMap : nullptr
+	};
+	QWORD cacheIDs[5];
+	for (int i = 0; i < 5; i++)
+		cacheIDs[i] = UseTexture(textures[i]);
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::DrawComplexSurface);
+
+	DWORD PolyFlags = Surface.PolyFlags;
+	FColor FlatColor = Surface.FlatColor;
+	*File << PolyFlags << FlatColor;
+	for (int i = 0; i < 5; i++)
+	{
+		UBOOL HasTexture = textures[i] ? 1 : 0;
+		*File << HasTexture << cacheIDs[i];
+	}
+
+	FCoords MapCoords = Facet.MapCoords;
+	*File << MapCoords;
+
+	INT NumPolys = 0;
+	for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next)
+		NumPolys++;
+	*File << NumPolys;
+
+	for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next)
+	{
+		INT NumPts = Poly->NumPts;
+		*File << NumPts;
+		for (INT i = 0; i < NumPts; i++)
+			*File << Poly->Pts[i]->Point;
+	}
+}
+
+void CallRecorder::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, int NumPts, DWORD PolyFlags)
+{
+	if (!InFrame)
+		return;
+
+	QWORD CacheID = UseTexture(&Info);
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::DrawGouraudPolygon);
+
+	INT Count = NumPts;
+	*File << CacheID << PolyFlags << Count;
+	for (INT i = 0; i < Count; i++)
+	{
+		FTransTexture* P = Pts[i];
+		*File << P->Point << P->Light << P->Fog << P->U << P->V;
+	}
+}
+
+void CallRecorder::DrawGouraudTriangles(const FSceneNode* Frame, const FTextureInfo& Info, FTransTexture* const Pts, INT NumPts, DWORD PolyFlags, DWORD DataFlags)
+{
+	if (!InFrame)
+		return;
+
+	QWORD CacheID = UseTexture(&Info);
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::DrawGouraudTriangles);
+
+	*File << CacheID << PolyFlags << DataFlags << NumPts;
+	for (INT i = 0; i < NumPts; i++)
+	{
+		FTransTexture* P = &Pts[i];
+		*File << P->Point << P->Flags << P->Normal << P->Light << P->Fog << P->U << P->V;
+	}
+}
+
+void CallRecorder::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags)
+{
+	if (!InFrame)
+		return;
+
+	QWORD CacheID = UseTexture(&Info);
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::DrawTile);
+	*File << CacheID << X << Y << XL << YL << U << V << UL << VL << Z << Color << Fog << PolyFlags;
+}
+
+#if defined(OLDUNREAL469SDK)
+void CallRecorder::DrawTileList(const FSceneNode* Frame, const FTextureInfo& Info, const FTileRect* Tiles, INT NumTiles, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags)
+{
+	if (!InFrame)
+		return;
+
+	QWORD CacheID = UseTexture(&Info);
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::DrawTileList);
+	*File << CacheID << NumTiles;
+	for (INT i = 0; i < NumTiles; i++)
+	{
+		FTileRect Tile = Tiles[i];
+		*File << Tile.X << Tile.Y << Tile.XL << Tile.YL << Tile.U << Tile.V << Tile.UL << Tile.VL;
+	}
+	*File << Z << Color << Fog << PolyFlags;
+}
+#endif
+
+void CallRecorder::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2)
+{
+	if (!InFrame)
+		return;
+
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::Draw3DLine);
+	*File << Color << LineFlags << P1 << P2;
+}
+
+void CallRecorder::Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2)
+{
+	if (!InFrame)
+		return;
+
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::Draw2DLine);
+	*File << Color << LineFlags << P1 << P2;
+}
+
+void CallRecorder::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z)
+{
+	if (!InFrame)
+		return;
+
+	UseFrame(Frame);
+
+	WriteCall(RecordedCall::Draw2DPoint);
+	*File << Color << LineFlags << X1 << Y1 << X2 << Y2 << Z;
+}
+
+void CallRecorder::ClearZ(FSceneNode* Frame)
+{
+	if (!InFrame)
+		return;
+
+	WriteCall(RecordedCall::ClearZ);
+}
+
+void CallRecorder::Flush()
+{
+	// The engine flushes when texture data changed under the same CacheID (lightmaps, gamma), so every texture is written again on its next use.
+	// Flushes between frames are recorded too and replayed at the start of the next frame.
+	WriteCall(RecordedCall::Flush);
+	KnownTextures.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Like FBufferReader, except that reading past the end of a truncated recording flags an error instead of asserting
+class RecordingReader : public FArchive
+{
+public:
+	RecordingReader(const TArray<BYTE>& bytes) : Bytes(bytes)
+	{
+		ArIsLoading = ArIsTrans = 1;
+	}
+
+	void Serialize(void* Data, INT Num) override
+	{
+		if (Num < 0 || Num > Bytes.Num() - Pos)
+		{
+			appMemzero(Data, Max(Num, 0));
+			Pos = Bytes.Num();
+			ArIsError = 1;
+			return;
+		}
+		if (Num > 0)
+			appMemcpy(Data, &Bytes(Pos), Num);
+		Pos += Num;
+	}
+
+	INT Tell() override { return Pos; }
+	INT TotalSize() override { return Bytes.Num(); }
+	void SetError() { ArIsError = 1; }
+
+private:
+	const TArray<BYTE>& Bytes;
+	INT Pos = 0;
+};
+
+// Counts are checked against the bytes left in the recording before anything is allocated for them
+static bool IsValidCount(FArchive& Ar, INT count, size_t minBytesPerItem)
+{
+	return count >= 0 && (size_t)count <= (size_t)(Ar.TotalSize() - Ar.Tell()) / minBytesPerItem;
+}
+
+CallReplayer::CallReplayer(UVulkanRenderDevice* renderer) : renderer(renderer)
+{
+}
+
+CallReplayer::~CallReplayer()
+{
+}
+
+bool CallReplayer::Load(const TCHAR* filename)
+{
+	TArray<BYTE> filedata;
+	if (!appLoadFileToArray(filedata, filename))
+		return false;
+
+	RecordingReader Ar(filedata);
+
+	DWORD magic = 0;
+	INT version = 0;
+	if (filedata.Num() < 8)
+		return false;
+	Ar << magic << version;
+	// Newer versions only add calls, so older recordings still load
+	if (magic != CallRecorder::FileMagic || version < 1 || version > CallRecorder::FileVersion)
+		return false;
+
+	FSceneNode* frame = nullptr;
+	ReplayFrame current;
+	bool inFrame = false;
+	bool pendingFlush = false;
+
+	while (Ar.Tell() < Ar.TotalSize())
+	{
+		BYTE type = 0;
+		Ar << type;
+
+		// Everything drawn needs a scene node recorded before it
+		bool isDraw = type != (BYTE)RecordedCall::Lock && type != (BYTE)RecordedCall::Unlock && type != (BYTE)RecordedCall::SceneNode &&
+			type != (BYTE)RecordedCall::SetSceneNode && type != (BYTE)RecordedCall::Texture && type != (BYTE)RecordedCall::Flush;
+		if (isDraw && !frame)
+		{
+			debugf(TEXT("VulkanDrv: call %d without a scene node in recording %s"), (INT)type, filename);
+			return false;
+		}
+
+		bool missingTexture = false;
+		switch ((RecordedCall)type)
+		{
+		case RecordedCall::Lock:
+		{
+			FPlane FlashScale, FlashFog, ScreenClear;
+			DWORD RenderLockFlags = 0;
+			Ar << FlashScale << FlashFog << ScreenClear << RenderLockFlags;
+			current = {};
+			if (pendingFlush)
+				current.Calls.push_back([=]() { FlushRenderer(); });
+			pendingFlush = false;
+			current.Calls.push_back([=]() { renderer->Lock(FlashScale, FlashFog, ScreenClear, RenderLockFlags, nullptr, nullptr); });
+			inFrame = true;
+			break;
+		}
+		case RecordedCall::Unlock:
+		{
+			UBOOL Blit = 0;
+			Ar << Blit;
+			current.Calls.push_back([=]() { renderer->Unlock(Blit); });
+			if (inFrame)
+				Frames.push_back(std::move(current));
+			current = {};
+			inFrame = false;
+			break;
+		}
+		case RecordedCall::SceneNode:
+		{
+			FLOAT fov = 0.0f;
+			frame = ReadSceneNode(Ar, &fov);
+			break;
+		}
+		case RecordedCall::SetSceneNode:
+		{
+			FLOAT fov = 0.0f;
+			frame = ReadSceneNode(Ar, &fov);
+			current.Calls.push_back([=]()
+			{
+				// SetSceneNode reads the field of view from the viewport actor
+				APlayerPawn* actor = renderer->Viewport->Actor;
+				FLOAT savedFov = actor->FovAngle;
+				actor->FovAngle = fov;
+				renderer->SetSceneNode(frame);
+				actor->FovAngle = savedFov;
+			});
+			break;
+		}
+		case RecordedCall::Texture:
+		{
+			if (!ReadTexture(Ar, current))
+			{
+				debugf(TEXT("VulkanDrv: invalid texture in recording %s"), filename);
+				return false;
+			}
+			break;
+		}
+		case RecordedCall::DrawComplexSurface:
+		{
+			struct ComplexSurface
+			{
+				FSurfaceInfo Surface;
+				FSurfaceFacet Facet;
+				std::vector<FTransform> Points;
+				std::vector<std::vector<BYTE>> Polys;
+			};
+
+			auto data = std::make_shared<ComplexSurface>();
+			appMemzero(&data->Surface, sizeof(FSurfaceInfo));
+			Ar << data->Surface.PolyFlags << data->Surface.FlatColor;
+
+			FTextureInfo** textures[5] = { &data->Surface.Texture, &data->Surface.LightMap, &data->Surface.MacroTexture, &data->Surface.DetailTexture, &data->Surface.FogMap };
+			for (int i = 0; i < 5; i++)
+			{
+				UBOOL HasTexture = 0;
+				QWORD CacheID = 0;
+				Ar << HasTexture << CacheID;
+				*textures[i] = HasTexture ? GetTexture(CacheID) : nullptr;
+				missingTexture = missingTexture || (HasTexture && !*textures[i]);
+			}
+
+			Ar << data->Facet.MapCoords;
+			data->Facet.MapUncoords = data->Facet.MapCoords.Inverse();
+			data->Facet.Span = nullptr;
+
+			INT NumPolys = 0;
+			Ar << NumPolys;
+			if (!IsValidCount(Ar, NumPolys, sizeof(INT)))
+			{
+				Ar.SetError();
+				break;
+			}
+
+			std::vector<INT> counts(NumPolys);
+			std::vector<FVector> points;
+			for (INT i = 0; i < NumPolys; i++)
+			{
+				Ar << counts[i];
+				if (!IsValidCount(Ar, counts[i], sizeof(FVector)))
+				{
+					Ar.SetError();
+					break;
+				}
+				for (INT j = 0; j < counts[i]; j++)
+				{
+					FVector point;
+					Ar << point;
+					points.push_back(point);
+				}
+			}
+			if (Ar.IsError())
+				break;
+
+			data->Points.resize(points.size());
+			data->Polys.resize(NumPolys);
+			FSavedPoly* prev = nullptr;
+			size_t pointIndex = 0;
+			for (INT i = 0; i < NumPolys; i++)
+			{
+				INT NumPts = counts[i];
+				data->Polys[i].resize(sizeof(FSavedPoly) + NumPts * sizeof(FTransform*));
+				FSavedPoly* poly = (FSavedPoly*)data->Polys[i].data();
+				poly->Next = nullptr;
+				poly->iNode = 0;
+				poly->User = nullptr;
+				poly->NumPts = NumPts;
+				for (INT j = 0; j < NumPts; j++)
+				{
+					FTransform* point = &data->Points[pointIndex];
+					appMemzero(point, sizeof(FTransform));
+					point->Point = points[pointIndex++];
+					poly->Pts[j] = point;
+				}
+				if (prev)
+					prev->Next = poly;
+				else
+					data->Facet.Polys = poly;
+				prev = poly;
+			}
+			if (!prev)
+				data->Facet.Polys = nullptr;
+
+			current.Calls.push_back([=]() { renderer->DrawComplexSurface(frame, data->Surface, data->Facet); });
+			break;
+		}
+		case RecordedCall::DrawGouraudPolygon:
+		{
+			QWORD CacheID = 0;
+			DWORD PolyFlags = 0;
+			INT NumPts = 0;
+			Ar << CacheID << PolyFlags << NumPts;
+			if (!IsValidCount(Ar, NumPts, sizeof(FVector)))
+			{
+				Ar.SetError();
+				break;
+			}
+
+			auto points = std::make_shared<std::vector<FTransTexture>>(NumPts);
+			auto pointers = std::make_shared<std::vector<FTransTexture*>>(NumPts);
+			for (INT i = 0; i < NumPts; i++)
+			{
+				FTransTexture& P = (*points)[i];
+				appMemzero(&P, sizeof(FTransTexture));
+				Ar << P.Point << P.Light << P.Fog << P.U << P.V;
+				(*pointers)[i] = &P;
+			}
+
+			FTextureInfo* info = GetTexture(CacheID);
+			missingTexture = !info;
+			current.Calls.push_back([=]() { renderer->DrawGouraudPolygon(frame, *info, pointers->data(), NumPts, PolyFlags, nullptr); });
+			break;
+		}
+		case RecordedCall::DrawGouraudTriangles:
+		{
+			QWORD CacheID = 0;
+			DWORD PolyFlags = 0, DataFlags = 0;
+			INT NumPts = 0;
+			Ar << CacheID << PolyFlags << DataFlags << NumPts;
+			if (!IsValidCount(Ar, NumPts, sizeof(FVector)))
+			{
+				Ar.SetError();
+				break;
+			}
+
+			auto points = std::make_shared<std::vector<FTransTexture>>(NumPts);
+			for (INT i = 0; i < NumPts; i++)
+			{
+				FTransTexture& P = (*points)[i];
+				appMemzero(&P, sizeof(FTransTexture));
+				Ar << P.Point << P.Flags << P.Normal << P.Light << P.Fog << P.U << P.V;
+			}
+
+			FTextureInfo* info = GetTexture(CacheID);
+			missingTexture = !info;
+#if defined(OLDUNREAL469SDK)
+			current.Calls.push_back([=]() { renderer->DrawGouraudTriangles(frame, *info, points->data(), NumPts, PolyFlags, DataFlags, nullptr); });
+#endif
+			break;
+		}
+		case RecordedCall::DrawTile:
+		{
+			QWORD CacheID = 0;
+			FLOAT X, Y, XL, YL, U, V, UL, VL, Z;
+			FPlane Color, Fog;
+			DWORD PolyFlags = 0;
+			Ar << CacheID << X << Y << XL << YL << U << V << UL << VL << Z << Color << Fog << PolyFlags;
+
+			FTextureInfo* info = GetTexture(CacheID);
+			missingTexture = !info;
+			current.Calls.push_back([=]() { renderer->DrawTile(frame, *info, X, Y, XL, YL, U, V, UL, VL, nullptr, Z, Color, Fog, PolyFlags); });
+			break;
+		}
+#if defined(OLDUNREAL469SDK)
+		case RecordedCall::DrawTileList:
+		{
+			QWORD CacheID = 0;
+			INT NumTiles = 0;
+			Ar << CacheID << NumTiles;
+			if (!IsValidCount(Ar, NumTiles, 8 * sizeof(FLOAT)))
+			{
+				Ar.SetError();
+				break;
+			}
+
+			auto tiles = std::make_shared<std::vector<FTileRect>>(NumTiles);
+			for (INT i = 0; i < NumTiles; i++)
+			{
+				FTileRect& Tile = (*tiles)[i];
+				Ar << Tile.X << Tile.Y << Tile.XL << Tile.YL << Tile.U << Tile.V << Tile.UL << Tile.VL;
+			}
+
+			FLOAT Z;
+			FPlane Color, Fog;
+			DWORD PolyFlags = 0;
+			Ar << Z << Color << Fog << PolyFlags;
+
+			FTextureInfo* info = GetTexture(CacheID);
+			missingTexture = !info;
+			current.Calls.push_back([=]() { renderer->DrawTileList(frame, *info, tiles->data(), NumTiles, nullptr, Z, Color, Fog, PolyFlags); });
+			break;
+		}
+#endif
+		case RecordedCall::Draw3DLine:
+		{
+			FPlane Color;
+			DWORD LineFlags = 0;
+			FVector P1, P2;
+			Ar << Color << LineFlags << P1 << P2;
+			current.Calls.push_back([=]() { renderer->Draw3DLine(frame, Color, LineFlags, P1, P2); });
+			break;
+		}
+		case RecordedCall::Draw2DLine:
+		{
+			FPlane Color;
+			DWORD LineFlags = 0;
+			FVector P1, P2;
+			Ar << Color << LineFlags << P1 << P2;
+			current.Calls.push_back([=]() { renderer->Draw2DLine(frame, Color, LineFlags, P1, P2); });
+			break;
+		}
+		case RecordedCall::Draw2DPoint:
+		{
+			FPlane Color;
+			DWORD LineFlags = 0;
+			FLOAT X1, Y1, X2, Y2, Z;
+			Ar << Color << LineFlags << X1 << Y1 << X2 << Y2 << Z;
+			current.Calls.push_back([=]() { renderer->Draw2DPoint(frame, Color, LineFlags, X1, Y1, X2, Y2, Z); });
+			break;
+		}
+		case RecordedCall::ClearZ:
+		{
+			current.Calls.push_back([=]() { renderer->ClearZ(frame); });
+			break;
+		}
+		case RecordedCall::Flush:
+		{
+			if (inFrame)
+				current.Calls.push_back([=]() { FlushRenderer(); });
+			else
+				pendingFlush = true;
+			break;
+		}
+		default:
+			debugf(TEXT("VulkanDrv: unknown call %d in recording %s"), (INT)type, filename);
+			return false;
+		}
+
+		if (Ar.IsError())
+		{
+			debugf(TEXT("VulkanDrv: recording %s is truncated or corrupt"), filename);
+			return false;
+		}
+		if (missingTexture)
+		{
+			debugf(TEXT("VulkanDrv: call %d uses a texture not in recording %s"), (INT)type, filename);
+			return false;
+		}
+	}
+
+	return !Frames.empty();
+}
+
+FSceneNode* CallReplayer::ReadSceneNode(FArchive& Ar, FLOAT* FovAngle)
+{
+	std::unique_ptr<FSceneNode> node(new FSceneNode);
+	appMemzero(node.get(), sizeof(FSceneNode));
+
+	FSceneNode* Frame = node.get();
+	Ar << *FovAngle;
+	Ar << Frame->X << Frame->Y << Frame->XB << Frame->YB << Frame->FX << Frame->FY << Frame->FX2 << Frame->FY2 << Frame->Zoom << Frame->Mirror << Frame->NearClip << Frame->Coords << Frame->Uncoords;
+	Frame->Viewport = renderer->Viewport;
+
+	SceneNodes.push_back(std::move(node));
+	return Frame;
+}
+
+bool CallReplayer::ReadTexture(FArchive& Ar, ReplayFrame& frame)
+{
+	auto texture = std::make_unique<ReplayTexture>();
+	FTextureInfo& Info = texture->Info;
+	appMemzero(&Info, sizeof(FTextureInfo));
+
+	BYTE Format = 0;
+	Ar << Info.CacheID << Format << Info.UScale << Info.VScale << Info.USize << Info.VSize << Info.UClamp << Info.VClamp << Info.Pan << Info.NumMips;
+	Info.Format = (ETextureFormat)Format;
+	if (Info.NumMips < 0 || Info.NumMips > MAX_MIPS)
+		return false;
+
+	// Read everything first so that the data pointers stay valid
+	std::vector<INT> offsets;
+	texture->Mips.resize(Info.NumMips);
+	for (INT level = 0; level < Info.NumMips; level++)
+	{
+		FMipmapBase& Mip = texture->Mips[level];
+		INT DataSize = 0;
+		Ar << Mip.USize << Mip.VSize << Mip.UBits << Mip.VBits << DataSize;
+
+		// The texture manager reads as much data as the mip size says, so the sizes must agree with what was recorded
+		if (Mip.USize <= 0 || Mip.VSize <= 0 || Mip.USize > 32768 || Mip.VSize > 32768 || !IsValidCount(Ar, DataSize, 1))
+			return false;
+		if (DataSize > 0 && DataSize != GetMipDataSize(Info.Format, Mip.USize, Mip.VSize))
+			return false;
+
+		offsets.push_back(DataSize > 0 ? (INT)texture->Data.size() : -1);
+		if (DataSize > 0)
+		{
+			size_t pos = texture->Data.size();
+			texture->Data.resize(pos + DataSize);
+			Ar.Serialize(texture->Data.data() + pos, DataSize);
+		}
+	}
+
+	for (INT level = 0; level < Info.NumMips; level++)
+	{
+		texture->Mips[level].DataPtr = offsets[level] != -1 ? texture->Data.data() + offsets[level] : nullptr;
+		Info.Mips[level] = &texture->Mips[level];
+	}
+
+	UBOOL HasPalette = 0;
+	Ar << HasPalette;
+	if (HasPalette)
+	{
+		texture->Palette.resize(256);
+		Ar.Serialize(texture->Palette.data(), 256 * sizeof(FColor));
+		Info.Palette = texture->Palette.data();
+	}
+	else if (Info.Format == TEXF_P8)
+	{
+		return false;
+	}
+	if (Ar.IsError())
+		return false;
+
+	// A texture seen again in the stream is a realtime update. Tell the texture manager at the same point in the frame as when it was recorded.
+	ReplayTexture* tex = texture.get();
+	if (CurrentTextures.find(Info.CacheID) != CurrentTextures.end())
+		frame.Calls.push_back([=]() { tex->Info.bRealtimeChanged = 1; });
+
+	CurrentTextures[Info.CacheID] = tex;
+	Textures.push_back(std::move(texture));
+	return true;
+}
+
+void CallReplayer::FlushRenderer()
+{
+#if defined(UNREALGOLD)
+	renderer->Flush();
+#else
+	renderer->Flush(0);
+#endif
+}
+
+FTextureInfo* CallReplayer::GetTexture(QWORD cacheID)
+{
+	auto it = CurrentTextures.find(cacheID);
+	return it != CurrentTextures.end() ? &it->second->Info : nullptr;
+}
+
+QWORD CallReplayer::HashFrames()
+{
+	std::vector<FColor> pixels;
+	QWORD combinedHash = 14695981039346656037ULL;
+
+	renderer->ClearTextureCache();
+
+	for (size_t i = 0; i < Frames.size(); i++)
+	{
+		for (auto& call : Frames[i].Calls)
+			call();
+
+		pixels.resize(renderer->Viewport->SizeX * renderer->Viewport->SizeY);
+		renderer->ReadPixels(pixels.data());
+
+		// FNV-1a
+		QWORD hash = 14695981039346656037ULL;
+		const BYTE* data = (const BYTE*)pixels.data();
+		size_t size = pixels.size() * sizeof(FColor);
+		for (size_t j = 0; j < size; j++)
+		{
+			hash ^= data[j];
+			hash *= 1099511628211ULL;
+		}
+		debugf(TEXT("VkReplay frame %d hash: %08x%08x"), (INT)i, (DWORD)(hash >> 32), (DWORD)hash);
+
+		combinedHash ^= hash;
+		combinedHash *= 1099511628211ULL;
+	}
+	return combinedHash;
+}
+
+void CallReplayer::Run(int loops, bool hashImages, FOutputDevice& Ar)
+{
+	std::vector<double> frameTimes;
+
+	for (int loop = 0; loop < loops; loop++)
+	{
+		// Start each loop with a cold texture cache so that uploads are part of the measurement.
+		// A regular Flush keeps textures whose source did not change, so this throws them away like VkFlushTextures.
+		renderer->ClearTextureCache();
+
+		for (size_t i = 0; i < Frames.size(); i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for (auto& call : Frames[i].Calls)
+				call();
+			auto end = std::chrono::steady_clock::now();
+			frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+	}
+
+	// Reading the pixels back waits for the GPU after every frame, so the hashes come from a separate pass that is not timed
+	QWORD combinedHash = hashImages ? HashFrames() : 0;
+
+	if (frameTimes.empty())
+		return;
+
+	std::vector<double> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0.0;
+	for (double t : sorted)
+		total += t;
+	auto percentile = [&](double p) { return sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)]; };
+
+	Ar.Logf(TEXT("VkReplay: %d frames, %d loops at %dx%d, %s vertices"), (INT)Frames.size(), loops, renderer->Viewport->SizeX, renderer->Viewport->SizeY, renderer->Buffers->StagingVertices ? TEXT("staged") : TEXT("direct"));
+	Ar.Logf(TEXT("VkReplay: avg %.3f ms, min %.3f ms, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms"), total / sorted.size(), sorted.front(), percentile(0.50), percentile(0.95), percentile(0.99), sorted.back());
+	if (hashImages)
+		Ar.Logf(TEXT("VkReplay: image hash %08x%08x"), (DWORD)(combinedHash >> 32), (DWORD)combinedHash);
+}
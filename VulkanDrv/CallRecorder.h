@@ -0,0 +1,106 @@
+#pragma once
+
+#include <functional>
+#include <unordered_set>
+
+class UVulkanRenderDevice;
+
+// Packet types in a recorded call stream
+enum class RecordedCall : uint8_t
+{
+	Lock,
+	Unlock,
+	SceneNode,
+	SetSceneNode,
+	Texture,
+	DrawComplexSurface,
+	DrawGouraudPolygon,
+	DrawGouraudTriangles,
+	DrawTile,
+	Draw3DLine,
+	ClearZ,
+	DrawTileList,
+	Flush,
+	Draw2DLine,
+	Draw2DPoint
+};
+
+// Serializes the URenderDevice calls made between Lock and Unlock, including the texture data they reference
+class CallRecorder
+{
+public:
+	CallRecorder(FArchive* file);
+	~CallRecorder();
+
+	void Lock(FPlane FlashScale, FPlane FlashFog, FPlane ScreenClear, DWORD RenderLockFlags);
+	void Unlock(UBOOL Blit);
+	void SetSceneNode(FSceneNode* Frame, FLOAT FovAngle);
+	void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet);
+	void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, FTransTexture** Pts, int NumPts, DWORD PolyFlags);
+	void DrawGouraudTriangles(const FSceneNode* Frame, const FTextureInfo& Info, FTransTexture* const Pts, INT NumPts, DWORD PolyFlags, DWORD DataFlags);
+	void DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT X, FLOAT Y, FLOAT XL, FLOAT YL, FLOAT U, FLOAT V, FLOAT UL, FLOAT VL, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags);
+#if defined(OLDUNREAL469SDK)
+	void DrawTileList(const FSceneNode* Frame, const FTextureInfo& Info, const FTileRect* Tiles, INT NumTiles, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags);
+#endif
+	void Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2);
+	void Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2);
+	void Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FLOAT X1, FLOAT Y1, FLOAT X2, FLOAT Y2, FLOAT Z);
+	void ClearZ(FSceneNode* Frame);
+	void Flush();
+
+	int FrameCount = 0;
+
+	static const DWORD FileMagic = 0x50524b56; // "VKRP"
+	static const INT FileVersion = 3;
+
+private:
+	void WriteCall(RecordedCall call);
+	void WriteSceneNode(const FSceneNode* Frame);
+	void UseFrame(const FSceneNode* Frame);
+	QWORD UseTexture(const FTextureInfo* Info);
+	void WriteTexture(const FTextureInfo& Info);
+
+	std::unique_ptr<FArchive> File;
+	bool InFrame = false;
+	const FSceneNode* LastFrame = nullptr;
+	std::unordered_set<QWORD> KnownTextures;
+};
+
+// Pushes a recorded call stream back through the render device and measures it
+class CallReplayer
+{
+public:
+	CallReplayer(UVulkanRenderDevice* renderer);
+	~CallReplayer();
+
+	bool Load(const TCHAR* filename);
+	void Run(int loops, bool hashImages, FOutputDevice& Ar);
+
+private:
+	struct ReplayTexture
+	{
+		FTextureInfo Info;
+		std::vector<FMipmapBase> Mips;
+		std::vector<BYTE> Data;
+		std::vector<FColor> Palette;
+	};
+
+	struct ReplayFrame
+	{
+		std::vector<std::function<void()>> Calls;
+	};
+
+	FSceneNode* ReadSceneNode(FArchive& Ar, FLOAT* FovAngle);
+	bool ReadTexture(FArchive& Ar, ReplayFrame& frame);
+	FTextureInfo* GetTexture(QWORD cacheID);
+	void FlushRenderer();
+	QWORD HashFrames();
+
+	UVulkanRenderDevice* renderer = nullptr;
+
+	std::vector<ReplayFrame> Frames;
+	std::vector<std::unique_ptr<FSceneNode>> SceneNodes;
+	std::vector<std::unique_ptr<ReplayTexture>> Textures;
+	std::unordered_map<QWORD, ReplayTexture*> CurrentTextures;
+	FLOAT FovAngle = 90.0f;
+};
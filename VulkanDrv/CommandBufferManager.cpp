@@ -5,8 +5,11 @@
 
 CommandBufferManager::CommandBufferManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
-	SwapChain = VulkanSwapChainBuilder()
-		.Create(renderer->Device.get());
+	if (renderer->Device->Surface)
+	{
+		SwapChain = VulkanSwapChainBuilder()
+			.Create(renderer->Device.get());
+	}
 
 	ImageAvailableSemaphore = SemaphoreBuilder()
 		.DebugName("ImageAvailableSemaphore")
@@ -60,16 +63,31 @@ void CommandBufferManager::SubmitCommands(bool present, int presentWidth, int pr
 
 	if (present)
 	{
-		if (SwapChain->Lost() || SwapChain->Width() != presentWidth || SwapChain->Height() != presentHeight || UsingVsync != renderer->UseVSync || UsingHdr != renderer->Hdr)
+		if (IsHeadless())
 		{
-			UsingVsync = renderer->UseVSync;
-			UsingHdr = renderer->Hdr;
-			renderer->Framebuffers->DestroySwapChainFramebuffers();
-			SwapChain->Create(presentWidth, presentHeight, renderer->UseVSync ? 2 : 3, renderer->UseVSync, renderer->Hdr, renderer->VkExclusiveFullscreen && presentFullscreen);
-			renderer->Framebuffers->CreateSwapChainFramebuffers();
+			if (Offscreen.Images.empty() || Offscreen.Width != presentWidth || Offscreen.Height != presentHeight || UsingVsync != renderer->UseVSync)
+			{
+				UsingVsync = renderer->UseVSync;
+				renderer->Framebuffers->DestroySwapChainFramebuffers();
+				CreateOffscreenImages(presentWidth, presentHeight, renderer->UseVSync ? 2 : 3);
+				renderer->Framebuffers->CreateSwapChainFramebuffers();
+			}
+
+			PresentImageIndex = AcquireOffscreenImage();
+		}
+		else
+		{
+			if (SwapChain->Lost() || SwapChain->Width() != presentWidth || SwapChain->Height() != presentHeight || UsingVsync != renderer->UseVSync || UsingHdr != renderer->Hdr)
+			{
+				UsingVsync = renderer->UseVSync;
+				UsingHdr = renderer->Hdr;
+				renderer->Framebuffers->DestroySwapChainFramebuffers();
+				SwapChain->Create(presentWidth, presentHeight, renderer->UseVSync ? 2 : 3, renderer->UseVSync, renderer->Hdr, renderer->VkExclusiveFullscreen && presentFullscreen);
+				renderer->Framebuffers->CreateSwapChainFramebuffers();
+			}
+
+			PresentImageIndex = SwapChain->AcquireImage(ImageAvailableSemaphore.get());
 		}
-
-		PresentImageIndex = SwapChain->AcquireImage(ImageAvailableSemaphore.get());
 		if (PresentImageIndex != -1)
 		{
 			renderer->DrawPresentTexture(presentWidth, presentHeight);
@@ -98,14 +116,14 @@ void CommandBufferManager::SubmitCommands(bool present, int presentWidth, int pr
 	{
 		submit.AddWait(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, TransferSemaphore.get());
 	}
-	if (present && PresentImageIndex != -1)
+	if (present && PresentImageIndex != -1 && !IsHeadless())
 	{
 		submit.AddWait(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, ImageAvailableSemaphore.get());
 		submit.AddSignal(RenderFinishedSemaphore.get());
 	}
 	submit.Execute(renderer->Device.get(), renderer->Device.get()->GraphicsQueue, RenderFinishedFence.get());
 
-	if (present && PresentImageIndex != -1)
+	if (present && PresentImageIndex != -1 && !IsHeadless())
 	{
 		SwapChain->QueuePresent(PresentImageIndex, RenderFinishedSemaphore.get());
 	}
@@ -142,3 +160,73 @@ void CommandBufferManager::DeleteFrameObjects()
 {
 	FrameDeleteList = std::make_unique<DeleteList>();
 }
+
+VkSurfaceFormatKHR CommandBufferManager::GetPresentFormat() const
+{
+	if (SwapChain)
+		return SwapChain->Format();
+
+	VkSurfaceFormatKHR format = {};
+	format.format = VK_FORMAT_B8G8R8A8_UNORM;
+	format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	return format;
+}
+
+int CommandBufferManager::GetPresentWidth() const
+{
+	return SwapChain ? SwapChain->Width() : Offscreen.Width;
+}
+
+int CommandBufferManager::GetPresentHeight() const
+{
+	return SwapChain ? SwapChain->Height() : Offscreen.Height;
+}
+
+int CommandBufferManager::GetPresentImageCount() const
+{
+	return SwapChain ? SwapChain->ImageCount() : (int)Offscreen.Images.size();
+}
+
+VulkanImage* CommandBufferManager::GetPresentImage(int index)
+{
+	return SwapChain ? SwapChain->GetImage(index) : Offscreen.Images[index].get();
+}
+
+VulkanImageView* CommandBufferManager::GetPresentImageView(int index)
+{
+	return SwapChain ? SwapChain->GetImageView(index) : Offscreen.Views[index].get();
+}
+
+void CommandBufferManager::CreateOffscreenImages(int width, int height, int imageCount)
+{
+	Offscreen.Views.clear();
+	Offscreen.Images.clear();
+	Offscreen.Width = std::max(width, 1);
+	Offscreen.Height = std::max(height, 1);
+	Offscreen.NextImage = 0;
+
+	VkFormat format = GetPresentFormat().format;
+	for (int i = 0; i < imageCount; i++)
+	{
+		Offscreen.Images.push_back(ImageBuilder()
+			.Size(Offscreen.Width, Offscreen.Height)
+			.Format(format)
+			.Usage(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+			.DebugName("OffscreenPresentImage")
+			.Create(renderer->Device.get()));
+
+		Offscreen.Views.push_back(ImageViewBuilder()
+			.Image(Offscreen.Images.back().get(), format)
+			.DebugName("OffscreenPresentImageView")
+			.Create(renderer->Device.get()));
+	}
+}
+
+int CommandBufferManager::AcquireOffscreenImage()
+{
+	// The previous frame's fence has already been waited on, so any image in the chain is free to reuse.
+	// Cycling through them anyway keeps the same image rotation a swap chain would give.
+	int index = Offscreen.NextImage;
+	Offscreen.NextImage = (Offscreen.NextImage + 1) % (int)Offscreen.Images.size();
+	return index;
+}
@@ -14,6 +14,15 @@ public:
 	VulkanCommandBuffer* GetDrawCommands();
 	void DeleteFrameObjects();
 
+	// The image chain the present pass renders into. This is the swap chain, or an offscreen chain when running headless.
+	bool IsHeadless() const { return !SwapChain; }
+	VkSurfaceFormatKHR GetPresentFormat() const;
+	int GetPresentWidth() const;
+	int GetPresentHeight() const;
+	int GetPresentImageCount() const;
+	VulkanImage* GetPresentImage(int index);
+	VulkanImageView* GetPresentImageView(int index);
+
 	struct DeleteList
 	{
 		std::vector<std::unique_ptr<VulkanImage>> images;
@@ -29,8 +38,20 @@ public:
 	BITFIELD UsingHdr = 0;
 
 private:
+	void CreateOffscreenImages(int width, int height, int imageCount);
+	int AcquireOffscreenImage();
+
 	UVulkanRenderDevice* renderer = nullptr;
 
+	struct
+	{
+		std::vector<std::unique_ptr<VulkanImage>> Images;
+		std::vector<std::unique_ptr<VulkanImageView>> Views;
+		int Width = 0;
+		int Height = 0;
+		int NextImage = 0;
+	} Offscreen;
+
 	std::unique_ptr<VulkanSemaphore> ImageAvailableSemaphore;
 	std::unique_ptr<VulkanSemaphore> RenderFinishedSemaphore;
 	std::unique_ptr<VulkanSemaphore> TransferSemaphore;
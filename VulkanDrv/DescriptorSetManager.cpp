@@ -11,6 +11,8 @@ DescriptorSetManager::DescriptorSetManager(UVulkanRenderDevice* renderer) : rend
 	CreatePresentSet();
 	CreateBloomLayout();
 	CreateBloomSets();
+	CreateUpscaleLayout();
+	CreateUpscaleSet();
 }
 
 DescriptorSetManager::~DescriptorSetManager()
@@ -97,44 +99,80 @@ void DescriptorSetManager::CreatePresentLayout()
 	Present.Layout = DescriptorSetLayoutBuilder()
 		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
 		.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
+		.AddBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
 		.DebugName("PresentLayout")
 		.Create(renderer->Device.get());
+
+	Present.LutLayout = DescriptorSetLayoutBuilder()
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.DebugName("PresentLutLayout")
+		.Create(renderer->Device.get());
 }
 
 void DescriptorSetManager::CreatePresentSet()
 {
 	Present.Pool = DescriptorPoolBuilder()
-		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
-		.MaxSets(1)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2)
+		.MaxSets(4)
 		.DebugName("PresentPool")
 		.Create(renderer->Device.get());
-	Present.Set = Present.Pool->allocate(Present.Layout.get());
+
+	WriteDescriptors write;
+	for (int i = 0; i < 2; i++)
+	{
+		Present.Set[i] = Present.Pool->allocate(Present.Layout.get());
+		Present.LutSet[i] = Present.Pool->allocate(Present.LutLayout.get());
+		write.AddStorageImage(Present.LutSet[i].get(), 0, renderer->Textures->PresentLutView[i].get(), VK_IMAGE_LAYOUT_GENERAL);
+	}
+	write.Execute(renderer->Device.get());
 }
 
 void DescriptorSetManager::CreateBloomLayout()
 {
 	Bloom.Layout = DescriptorSetLayoutBuilder()
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-		.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
 		.DebugName("BloomLayout")
 		.Create(renderer->Device.get());
 }
 
 void DescriptorSetManager::CreateBloomSets()
 {
+	// One set per dispatch: down into each level, back up into every level but the last, and the combine
+	const int setCount = NumBloomLevels * 2;
 	Bloom.Pool = DescriptorPoolBuilder()
-		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (NumBloomLevels * 2 + 1) * 2)
-		.MaxSets(NumBloomLevels * 2 + 1)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount)
+		.MaxSets(setCount)
 		.DebugName("BloomPool")
 		.Create(renderer->Device.get());
 
 	for (int level = 0; level < NumBloomLevels; level++)
-	{
-		Bloom.HTextureSets[level] = Bloom.Pool->allocate(Bloom.Layout.get());
-		Bloom.VTextureSets[level] = Bloom.Pool->allocate(Bloom.Layout.get());
-	}
+		Bloom.DownSets[level] = Bloom.Pool->allocate(Bloom.Layout.get());
+	for (int level = 0; level < NumBloomLevels - 1; level++)
+		Bloom.UpSets[level] = Bloom.Pool->allocate(Bloom.Layout.get());
+	Bloom.CombineSet = Bloom.Pool->allocate(Bloom.Layout.get());
+}
 
-	Bloom.PPImageSet = Bloom.Pool->allocate(Bloom.Layout.get());
+void DescriptorSetManager::CreateUpscaleLayout()
+{
+	Upscale.Layout = DescriptorSetLayoutBuilder()
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.DebugName("UpscaleLayout")
+		.Create(renderer->Device.get());
+}
+
+void DescriptorSetManager::CreateUpscaleSet()
+{
+	Upscale.Pool = DescriptorPoolBuilder()
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1)
+		.MaxSets(1)
+		.DebugName("UpscalePool")
+		.Create(renderer->Device.get());
+	Upscale.Set = Upscale.Pool->allocate(Upscale.Layout.get());
 }
 
 void DescriptorSetManager::UpdateFrameDescriptors()
@@ -143,13 +181,31 @@ void DescriptorSetManager::UpdateFrameDescriptors()
 	auto samplers = renderer->Samplers.get();
 
 	WriteDescriptors write;
-	write.AddCombinedImageSampler(Present.Set.get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	write.AddCombinedImageSampler(Present.Set.get(), 1, textures->DitherImageView.get(), samplers->PPNearestRepeat.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	for (int i = 0; i < 2; i++)
+	{
+		write.AddCombinedImageSampler(Present.Set[i].get(), 0, textures->Scene->GetOutputView(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		write.AddCombinedImageSampler(Present.Set[i].get(), 1, textures->DitherImageView.get(), samplers->PPNearestRepeat.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		write.AddCombinedImageSampler(Present.Set[i].get(), 2, textures->PresentLutView[i].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	auto& bloomLevels = textures->Scene->BloomBlurLevels;
+	write.AddCombinedImageSampler(Bloom.DownSets[0].get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	for (int level = 0; level < NumBloomLevels; level++)
 	{
-		write.AddCombinedImageSampler(GetBloomHTextureSet(level), 0, textures->Scene->BloomBlurLevels[level].HTextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		write.AddCombinedImageSampler(GetBloomVTextureSet(level), 0, textures->Scene->BloomBlurLevels[level].VTextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		if (level > 0)
+			write.AddCombinedImageSampler(Bloom.DownSets[level].get(), 0, bloomLevels[level - 1].View.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_GENERAL);
+		write.AddStorageImage(Bloom.DownSets[level].get(), 1, bloomLevels[level].View.get(), VK_IMAGE_LAYOUT_GENERAL);
+	}
+	for (int level = 0; level < NumBloomLevels - 1; level++)
+	{
+		write.AddCombinedImageSampler(Bloom.UpSets[level].get(), 0, bloomLevels[level + 1].View.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_GENERAL);
+		write.AddStorageImage(Bloom.UpSets[level].get(), 1, bloomLevels[level].View.get(), VK_IMAGE_LAYOUT_GENERAL);
+	}
+	write.AddCombinedImageSampler(Bloom.CombineSet.get(), 0, bloomLevels[0].View.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_GENERAL);
+	write.AddStorageImage(Bloom.CombineSet.get(), 1, textures->Scene->PPImageView[0].get(), VK_IMAGE_LAYOUT_GENERAL);
+	if (textures->Scene->UpscaleImage)
+	{
+		write.AddCombinedImageSampler(Upscale.Set.get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		write.AddStorageImage(Upscale.Set.get(), 1, textures->Scene->UpscaleImageView.get(), VK_IMAGE_LAYOUT_GENERAL);
 	}
-	write.AddCombinedImageSampler(Bloom.PPImageSet.get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	write.Execute(renderer->Device.get());
 }
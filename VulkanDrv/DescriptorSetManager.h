@@ -56,10 +56,12 @@ public:
 	int GetTextureArrayIndex(DWORD PolyFlags, CachedTexture* tex, bool clamp = false);
 
 	VulkanDescriptorSet* GetBindlessSet() { return Textures.BindlessSet.get(); }
-	VulkanDescriptorSet* GetPresentSet() { return Present.Set.get(); }
-	VulkanDescriptorSet* GetBloomPPImageSet() { return Bloom.PPImageSet.get(); }
-	VulkanDescriptorSet* GetBloomVTextureSet(int level) { return Bloom.VTextureSets[level].get(); }
-	VulkanDescriptorSet* GetBloomHTextureSet(int level) { return Bloom.HTextureSets[level].get(); }
+	VulkanDescriptorSet* GetPresentSet(int lut) { return Present.Set[lut].get(); }
+	VulkanDescriptorSet* GetPresentLutSet(int lut) { return Present.LutSet[lut].get(); }
+	VulkanDescriptorSet* GetBloomDownSet(int level) { return Bloom.DownSets[level].get(); }
+	VulkanDescriptorSet* GetBloomUpSet(int level) { return Bloom.UpSets[level].get(); }
+	VulkanDescriptorSet* GetBloomCombineSet() { return Bloom.CombineSet.get(); }
+	VulkanDescriptorSet* GetUpscaleSet() { return Upscale.Set.get(); }
 
 	void UpdateBindlessSet();
 	void UpdateFrameDescriptors();
@@ -68,7 +70,9 @@ public:
 
 	VulkanDescriptorSetLayout* GetTextureBindlessLayout() { return Textures.BindlessLayout.get(); }
 	VulkanDescriptorSetLayout* GetPresentLayout() { return Present.Layout.get(); }
+	VulkanDescriptorSetLayout* GetPresentLutLayout() { return Present.LutLayout.get(); }
 	VulkanDescriptorSetLayout* GetBloomLayout() { return Bloom.Layout.get(); }
+	VulkanDescriptorSetLayout* GetUpscaleLayout() { return Upscale.Layout.get(); }
 
 private:
 	void CreateBindlessTextureSet();
@@ -76,6 +80,8 @@ private:
 	void CreatePresentSet();
 	void CreateBloomLayout();
 	void CreateBloomSets();
+	void CreateUpscaleLayout();
+	void CreateUpscaleSet();
 
 	UVulkanRenderDevice* renderer = nullptr;
 
@@ -92,16 +98,25 @@ private:
 	struct
 	{
 		std::unique_ptr<VulkanDescriptorSetLayout> Layout;
+		std::unique_ptr<VulkanDescriptorSetLayout> LutLayout;
 		std::unique_ptr<VulkanDescriptorPool> Pool;
-		std::unique_ptr<VulkanDescriptorSet> Set;
+		std::unique_ptr<VulkanDescriptorSet> Set[2]; // One for each present LUT
+		std::unique_ptr<VulkanDescriptorSet> LutSet[2];
 	} Present;
 
 	struct
 	{
 		std::unique_ptr<VulkanDescriptorSetLayout> Layout;
 		std::unique_ptr<VulkanDescriptorPool> Pool;
-		std::unique_ptr<VulkanDescriptorSet> VTextureSets[NumBloomLevels];
-		std::unique_ptr<VulkanDescriptorSet> HTextureSets[NumBloomLevels];
-		std::unique_ptr<VulkanDescriptorSet> PPImageSet;
+		std::unique_ptr<VulkanDescriptorSet> DownSets[NumBloomLevels];
+		std::unique_ptr<VulkanDescriptorSet> UpSets[NumBloomLevels - 1];
+		std::unique_ptr<VulkanDescriptorSet> CombineSet;
 	} Bloom;
+
+	struct
+	{
+		std::unique_ptr<VulkanDescriptorSetLayout> Layout;
+		std::unique_ptr<VulkanDescriptorPool> Pool;
+		std::unique_ptr<VulkanDescriptorSet> Set;
+	} Upscale;
 };
@@ -50,6 +50,52 @@ std::string FileResource::readAllText(const std::string& filename)
 			}
 		)";
 	}
+	else if (filename == "shaders/Tile.vert")
+	{
+		return R"(
+			layout(push_constant) uniform ScenePushConstants
+			{
+				mat4 objectToProjection;
+				vec4 nearClip;
+				uint uHitIndex;
+				uint padding1, padding2, padding3;
+			};
+
+			layout(location = 0) in vec4 aRect;
+			layout(location = 1) in vec4 aTexRect;
+			layout(location = 2) in vec4 aColor;
+			layout(location = 3) in float aZ;
+			layout(location = 4) in int aTextureBind;
+
+			layout(location = 0) flat out uint flags;
+			layout(location = 1) out vec2 texCoord;
+			layout(location = 2) out vec2 texCoord2;
+			layout(location = 3) out vec2 texCoord3;
+			layout(location = 4) out vec2 texCoord4;
+			layout(location = 5) out vec4 color;
+			layout(location = 6) flat out uint hitIndex;
+			layout(location = 7) flat out ivec4 textureBinds;
+
+			void main()
+			{
+				// Triangle strip corner order: top left, top right, bottom left, bottom right
+				bool right = (gl_VertexIndex & 1) != 0;
+				bool bottom = (gl_VertexIndex & 2) != 0;
+				vec4 position = vec4(right ? aRect.z : aRect.x, bottom ? aRect.w : aRect.y, aZ, 1.0);
+
+				gl_Position = objectToProjection * position;
+				gl_ClipDistance[0] = dot(nearClip, position);
+				flags = 0;
+				texCoord = vec2(right ? aTexRect.z : aTexRect.x, bottom ? aTexRect.w : aTexRect.y);
+				texCoord2 = vec2(0.0);
+				texCoord3 = vec2(0.0);
+				texCoord4 = vec2(0.0);
+				color = aColor;
+				hitIndex = uHitIndex;
+				textureBinds = ivec4(aTextureBind, 0, 0, 0);
+			}
+		)";
+	}
 	else if (filename == "shaders/Scene.frag")
 	{
 		return R"(
@@ -67,6 +113,9 @@ std::string FileResource::readAllText(const std::string& filename)
 			layout(location = 0) out vec4 outColor;
 			layout(location = 1) out uint outHitIndex;
 
+			// Pipelines specialized for a single surface type set this to its flags. ~0 reads the flags per vertex instead.
+			layout(constant_id = 0) const uint SpecializedFlags = 0xffffffff;
+
 			vec4 darkClamp(vec4 c)
 			{
 				// Make all textures a little darker as some of the textures (i.e coronas) never become completely black as they should have
@@ -81,35 +130,37 @@ std::string FileResource::readAllText(const std::string& filename)
 
 			void main()
 			{
-				float actorXBlending = (flags & 32) != 0 ? 1.5 : 1.0;
-				float oneXBlending = (flags & 64) != 0 ? 1.0 : 2.0;
+				uint surfaceFlags = SpecializedFlags != 0xffffffff ? SpecializedFlags : flags;
+
+				float actorXBlending = (surfaceFlags & 32) != 0 ? 1.5 : 1.0;
+				float oneXBlending = (surfaceFlags & 64) != 0 ? 1.0 : 2.0;
 
 				outColor = darkClamp(textureTex(texCoord)) * color;
 				outColor.rgb *= actorXBlending;
 
-				if ((flags & 2) != 0) // Macro texture
+				if ((surfaceFlags & 2) != 0) // Macro texture
 				{
 					outColor *= darkClamp(textureMacro(texCoord3));
 				}
 
-				if ((flags & 1) != 0) // Lightmap
+				if ((surfaceFlags & 1) != 0) // Lightmap
 				{
 					outColor.rgb *= clamp(textureLightmap(texCoord2).rgb, 0.0, 1.0) * oneXBlending;
 				}
 
-				if ((flags & 4) != 0) // Detail texture
+				if ((surfaceFlags & 4) != 0) // Detail texture
 				{
 					float fadedistance = 380.0f;
 					float a = clamp(2.0f - (1.0f / gl_FragCoord.w) / fadedistance, 0.0f, 1.0f);
 					vec4 detailColor = (textureDetail(texCoord4) - 0.5) * 0.8 + 1.0;
 					outColor.rgb = mix(outColor.rgb, outColor.rgb * detailColor.rgb, a);
 				}
-				else if ((flags & 8) != 0) // Fog map
+				else if ((surfaceFlags & 8) != 0) // Fog map
 				{
 					vec4 fogcolor = textureDetail(texCoord4);
 					outColor.rgb = fogcolor.rgb + outColor.rgb * (1.0 - fogcolor.a);
 				}
-				else if ((flags & 16) != 0) // Fog color
+				else if ((surfaceFlags & 16) != 0) // Fog color
 				{
 					vec4 fogcolor = vec4(texCoord2, texCoord3);
 					outColor.rgb = fogcolor.rgb + outColor.rgb * (1.0 - fogcolor.a);
@@ -152,15 +203,15 @@ std::string FileResource::readAllText(const std::string& filename)
 		return R"(
 			layout(push_constant) uniform PresentPushConstants
 			{
-				float Contrast;
-				float Saturation;
-				float Brightness;
-				float HdrScale;
-				vec4 GammaCorrection;
+				float LutMaxValue;
+				float LutSize;
+				int Dither;
+				int Padding;
 			};
 
 			layout(binding = 0) uniform sampler2D texSampler;
 			layout(binding = 1) uniform sampler2D texDither;
+			layout(binding = 2) uniform sampler3D texLut;
 			layout(location = 0) in vec2 texCoord;
 			layout(location = 0) out vec4 outColor;
 
@@ -171,29 +222,48 @@ std::string FileResource::readAllText(const std::string& filename)
 				return floor(c.rgb * 255.0 + threshold) / 255.0;
 			}
 
-			vec3 linearHdr(vec3 c)
+			void main()
 			{
-				return pow(c, vec3(2.2)) * HdrScale;
+				// The LUT is indexed in a gamma 2.2 space to keep precision in the dark range
+				vec3 c = texture(texSampler, texCoord).rgb;
+				vec3 lutCoord = pow(clamp(c / LutMaxValue, 0.0, 1.0), vec3(1.0 / 2.2));
+				vec3 color = texture(texLut, lutCoord * ((LutSize - 1.0) / LutSize) + 0.5 / LutSize).rgb;
+				if (Dither != 0)
+					color = dither(color);
+				outColor = vec4(color, 1.0f);
 			}
+		)";
+	}
+	else if (filename == "shaders/PresentLut.comp")
+	{
+		return R"(
+			layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+			layout(push_constant) uniform PresentLutPushConstants
+			{
+				float Contrast;
+				float Saturation;
+				float Brightness;
+				float HdrScale;
+				vec4 GammaCorrection;
+				float LutMaxValue;
+				int GammaMode;
+				int ColorCorrectMode;
+				int HdrMode;
+			};
 
-			#if defined(GAMMA_MODE_D3D9)
+			layout(binding = 0, rgba16f) uniform writeonly image3D lutImage;
 
-			vec3 gammaCorrect(vec3 c)
+			vec3 linearHdr(vec3 c)
 			{
-				return pow(c, GammaCorrection.xyz);
+				return pow(c, vec3(2.2)) * HdrScale;
 			}
 
-			#elif defined(GAMMA_MODE_XOPENGL)
-
 			// Returns maximum of first 3 components
 			float max3(vec3 v)
 			{
 				return max(max(v.x, v.y), v.z);
 			}
-			float max3(vec4 v)
-			{
-				return max(max(v.x, v.y), v.z);
-			}
 
 			// Returns square of argument
 			float square_f( float f)
@@ -201,7 +271,12 @@ std::string FileResource::readAllText(const std::string& filename)
 				return f*f;
 			}
 
-			vec3 gammaCorrect(vec3 c)
+			vec3 gammaCorrectD3D9(vec3 c)
+			{
+				return pow(c, GammaCorrection.xyz);
+			}
+
+			vec3 gammaCorrectXOpenGL(vec3 c)
 			{
 				c = clamp(c, 0.0, 1.0); // XOpenGLDrv doesn't use a half-float scene buffer
 
@@ -223,53 +298,57 @@ std::string FileResource::readAllText(const std::string& filename)
 				return pow(c, GammaCorrection.xyz);
 			}
 
-			#endif
-
-			#if defined(COLOR_CORRECT_MODE0)
-			vec3 colorCorrect(vec3 c)
-			{
-				float v = c.r + c.g + c.b;
-				vec3 valgray = vec3(v, v, v) * (1 - Saturation) / 3 + c * Saturation;
-				vec3 val = valgray * Contrast - (Contrast - 1.0) * 0.5;
-				val += Brightness * 0.5;
-				return max(val, vec3(0.0, 0.0, 0.0));
-			}
-			#elif defined(COLOR_CORRECT_MODE1)
 			vec3 colorCorrect(vec3 c)
 			{
-				float v = dot(c, vec3(0.3, 0.56, 0.14));
-				vec3 valgray = mix(vec3(v, v, v), c, Saturation);
-				vec3 val = valgray * Contrast - (Contrast - 1.0) * 0.5;
-				val += Brightness * 0.5;
-				return max(val, vec3(0.0, 0.0, 0.0));
-			}
-			#elif defined(COLOR_CORRECT_MODE2)
-			vec3 colorCorrect(vec3 c)
-			{
-				float v = pow(dot(pow(c, vec3(2.2, 2.2, 2.2)), vec3(0.2126, 0.7152, 0.0722)), 1.0/2.2);
-				vec3 valgray = mix(vec3(v, v, v), c, Saturation);
+				vec3 valgray;
+				if (ColorCorrectMode == 1)
+				{
+					float v = c.r + c.g + c.b;
+					valgray = vec3(v, v, v) * (1 - Saturation) / 3 + c * Saturation;
+				}
+				else if (ColorCorrectMode == 2)
+				{
+					float v = dot(c, vec3(0.3, 0.56, 0.14));
+					valgray = mix(vec3(v, v, v), c, Saturation);
+				}
+				else if (ColorCorrectMode == 3)
+				{
+					float v = pow(dot(pow(c, vec3(2.2, 2.2, 2.2)), vec3(0.2126, 0.7152, 0.0722)), 1.0/2.2);
+					valgray = mix(vec3(v, v, v), c, Saturation);
+				}
+				else
+				{
+					return c;
+				}
 				vec3 val = valgray * Contrast - (Contrast - 1.0) * 0.5;
 				val += Brightness * 0.5;
 				return max(val, vec3(0.0, 0.0, 0.0));
 			}
-			#else
-			vec3 colorCorrect(vec3 c) { return c; }
-			#endif
 
 			void main()
 			{
-				vec3 color = gammaCorrect(colorCorrect(texture(texSampler, texCoord).rgb));
-			#if defined(HDR_MODE)
-				outColor = vec4(linearHdr(color), 1.0f);
-			#else
-				outColor = vec4(dither(color), 1.0f);
-			#endif
+				ivec3 size = imageSize(lutImage);
+				ivec3 pos = ivec3(gl_GlobalInvocationID);
+				if (any(greaterThanEqual(pos, size)))
+					return;
+
+				// Inverse of the lookup coordinate used by Present.frag
+				vec3 c = pow(vec3(pos) / vec3(size - 1), vec3(2.2)) * LutMaxValue;
+
+				c = colorCorrect(c);
+				c = GammaMode == 1 ? gammaCorrectXOpenGL(c) : gammaCorrectD3D9(c);
+				if (HdrMode != 0)
+					c = linearHdr(c);
+
+				imageStore(lutImage, pos, vec4(c, 1.0));
 			}
 		)";
 	}
-	else if (filename == "shaders/BloomExtract.frag")
+	else if (filename == "shaders/BloomBlur.comp")
 	{
 		return R"(
+			layout(local_size_x = 16, local_size_y = 16) in;
+
 			layout(push_constant) uniform BloomPushConstants
 			{
 				float SampleWeights0;
@@ -283,80 +362,197 @@ std::string FileResource::readAllText(const std::string& filename)
 			};
 
 			layout(binding = 0) uniform sampler2D texSampler;
-			layout(location = 0) in vec2 texCoord;
-			layout(location = 0) out vec4 outColor;
+			layout(binding = 1, rgba16f) uniform writeonly image2D outputImage;
+
+			// A 16x16 tile of output texels plus the three texels on each side the gaussian blur reads
+			shared vec3 inputTile[22][22];
+			shared vec3 verticalTile[16][22];
+
+			// Scales the input to the output size the same way a fullscreen draw with a linear sampler would
+			vec3 fetchInput(ivec2 pos, ivec2 size)
+			{
+				pos = clamp(pos, ivec2(0), size - 1);
+				vec3 color = textureLod(texSampler, (vec2(pos) + 0.5) / vec2(size), 0.0).rgb;
+			#if defined(BLOOM_EXTRACT)
+				color = max(color - 1.0, 0.0);
+			#endif
+				return color;
+			}
 
 			void main()
 			{
-				outColor = vec4(max(texture(texSampler, texCoord).rgb - 1.0, 0.0), 0.0);
+				ivec2 size = imageSize(outputImage);
+				ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * 16 - 3;
+
+				for (int i = int(gl_LocalInvocationIndex); i < 22 * 22; i += 16 * 16)
+				{
+					ivec2 t = ivec2(i % 22, i / 22);
+					inputTile[t.y][t.x] = fetchInput(tileOrigin + t, size);
+				}
+				barrier();
+
+				// Vertical blur, including the columns the horizontal blur needs on each side
+				for (int i = int(gl_LocalInvocationIndex); i < 22 * 16; i += 16 * 16)
+				{
+					int x = i % 22;
+					int y = i / 22 + 3;
+					verticalTile[y - 3][x] =
+						inputTile[y    ][x] * SampleWeights0 +
+						inputTile[y + 1][x] * SampleWeights1 +
+						inputTile[y - 1][x] * SampleWeights2 +
+						inputTile[y + 2][x] * SampleWeights3 +
+						inputTile[y - 2][x] * SampleWeights4 +
+						inputTile[y + 3][x] * SampleWeights5 +
+						inputTile[y - 3][x] * SampleWeights6;
+				}
+				barrier();
+
+				// Horizontal blur
+				ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+				if (all(lessThan(pos, size)))
+				{
+					int x = int(gl_LocalInvocationID.x) + 3;
+					int y = int(gl_LocalInvocationID.y);
+					vec3 color =
+						verticalTile[y][x    ] * SampleWeights0 +
+						verticalTile[y][x + 1] * SampleWeights1 +
+						verticalTile[y][x - 1] * SampleWeights2 +
+						verticalTile[y][x + 2] * SampleWeights3 +
+						verticalTile[y][x - 2] * SampleWeights4 +
+						verticalTile[y][x + 3] * SampleWeights5 +
+						verticalTile[y][x - 3] * SampleWeights6;
+					imageStore(outputImage, pos, vec4(color, 0.0));
+				}
 			}
 		)";
 	}
-	else if (filename == "shaders/BloomCombine.frag")
+	else if (filename == "shaders/BloomCombine.comp")
 	{
 		return R"(
-			layout(push_constant) uniform BloomPushConstants
-			{
-				float SampleWeights0;
-				float SampleWeights1;
-				float SampleWeights2;
-				float SampleWeights3;
-				float SampleWeights4;
-				float SampleWeights5;
-				float SampleWeights6;
-				float SampleWeights7;
-			};
+			layout(local_size_x = 8, local_size_y = 8) in;
 
 			layout(binding = 0) uniform sampler2D texSampler;
-			layout(location = 0) in vec2 texCoord;
-			layout(location = 0) out vec4 outColor;
+			layout(binding = 1, rgba16f) uniform image2D outputImage;
 
 			void main()
 			{
-				outColor = texture(texSampler, texCoord);
+				ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+				ivec2 size = imageSize(outputImage);
+				if (all(lessThan(pos, size)))
+				{
+					vec3 bloom = textureLod(texSampler, (vec2(pos) + 0.5) / vec2(size), 0.0).rgb;
+					imageStore(outputImage, pos, imageLoad(outputImage, pos) + vec4(bloom, 0.0));
+				}
 			}
 		)";
 	}
-	else if (filename == "shaders/Blur.frag")
+	else if (filename == "shaders/Upscale.comp")
 	{
 		return R"(
-			layout(push_constant) uniform BloomPushConstants
+			layout(local_size_x = 8, local_size_y = 8) in;
+
+			layout(push_constant) uniform UpscalePushConstants
 			{
-				float SampleWeights0;
-				float SampleWeights1;
-				float SampleWeights2;
-				float SampleWeights3;
-				float SampleWeights4;
-				float SampleWeights5;
-				float SampleWeights6;
-				float SampleWeights7;
+				vec2 InputSize;
+				vec2 OutputSize;
+				float Sharpness;
+				float Padding1, Padding2, Padding3;
 			};
 
-			layout(binding = 0) uniform sampler2D texSampler;
-			layout(location = 0) in vec2 texCoord;
-			layout(location = 0) out vec4 outColor;
+			layout(binding = 0) uniform sampler2D sceneTexture;
+			layout(binding = 1, rgba16f) uniform writeonly image2D outputImage;
+
+			vec3 fetch(ivec2 pos)
+			{
+				return texelFetch(sceneTexture, clamp(pos, ivec2(0), ivec2(InputSize) - 1), 0).rgb;
+			}
+
+			float luma(vec3 c)
+			{
+				return dot(c, vec3(0.299, 0.587, 0.114));
+			}
+
+			// Polynomial approximation of a windowed lanczos2 kernel taking the squared distance.
+			// A smaller window value widens the kernel, a larger one sharpens it.
+			float kernelWeight(float d2, float window)
+			{
+				d2 = min(d2, 4.0);
+				float base = (25.0 / 16.0) * (0.4 * d2 - 1.0) * (0.4 * d2 - 1.0) - (25.0 / 16.0 - 1.0);
+				float w = window * d2 - 1.0;
+				return base * w * w;
+			}
 
 			void main()
 			{
-			#if defined(BLUR_HORIZONTAL)
-				outColor =
-					textureOffset(texSampler, texCoord, ivec2( 0, 0)) * SampleWeights0 +
-					textureOffset(texSampler, texCoord, ivec2( 1, 0)) * SampleWeights1 +
-					textureOffset(texSampler, texCoord, ivec2(-1, 0)) * SampleWeights2 +
-					textureOffset(texSampler, texCoord, ivec2( 2, 0)) * SampleWeights3 +
-					textureOffset(texSampler, texCoord, ivec2(-2, 0)) * SampleWeights4 +
-					textureOffset(texSampler, texCoord, ivec2( 3, 0)) * SampleWeights5 +
-					textureOffset(texSampler, texCoord, ivec2(-3, 0)) * SampleWeights6;
-			#else
-				outColor =
-					textureOffset(texSampler, texCoord, ivec2(0, 0)) * SampleWeights0 +
-					textureOffset(texSampler, texCoord, ivec2(0, 1)) * SampleWeights1 +
-					textureOffset(texSampler, texCoord, ivec2(0,-1)) * SampleWeights2 +
-					textureOffset(texSampler, texCoord, ivec2(0, 2)) * SampleWeights3 +
-					textureOffset(texSampler, texCoord, ivec2(0,-2)) * SampleWeights4 +
-					textureOffset(texSampler, texCoord, ivec2(0, 3)) * SampleWeights5 +
-					textureOffset(texSampler, texCoord, ivec2(0,-3)) * SampleWeights6;
-			#endif
+				ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+				if (any(greaterThanEqual(dst, ivec2(OutputSize))))
+					return;
+
+				vec2 src = (vec2(dst) + 0.5) * InputSize / OutputSize - 0.5;
+				ivec2 base = ivec2(floor(src));
+				vec2 f = src - vec2(base);
+
+				// 4x4 texel neighbourhood around the sample position
+				vec3 c[4][4];
+				float l[4][4];
+				for (int y = 0; y < 4; y++)
+				{
+					for (int x = 0; x < 4; x++)
+					{
+						c[y][x] = fetch(base + ivec2(x - 1, y - 1));
+						l[y][x] = luma(c[y][x]);
+					}
+				}
+
+				// Gradient of the four centre texels, weighted by their bilinear contribution
+				vec2 dir = vec2(0.0);
+				for (int y = 1; y <= 2; y++)
+				{
+					for (int x = 1; x <= 2; x++)
+					{
+						float w = (x == 1 ? 1.0 - f.x : f.x) * (y == 1 ? 1.0 - f.y : f.y);
+						dir += vec2(l[y][x + 1] - l[y][x - 1], l[y + 1][x] - l[y - 1][x]) * w;
+					}
+				}
+
+				float minL = min(min(l[1][1], l[1][2]), min(l[2][1], l[2][2]));
+				float maxL = max(max(l[1][1], l[1][2]), max(l[2][1], l[2][2]));
+				float edge = clamp(length(dir) / max(2.0 * (maxL - minL), 1.0 / 256.0), 0.0, 1.0);
+
+				float dirLength = length(dir);
+				dir = dirLength > 1.0 / 4096.0 ? dir / dirLength : vec2(1.0, 0.0);
+
+				// Narrow the kernel across the edge and widen it along the edge
+				float stretch = 1.0 / max(abs(dir.x), abs(dir.y));
+				vec2 axisScale = vec2(1.0 + (stretch - 1.0) * edge, 1.0 - 0.5 * edge);
+				float window = 0.5 - 0.29 * edge;
+
+				vec3 sum = vec3(0.0);
+				float weightSum = 0.0;
+				for (int y = 0; y < 4; y++)
+				{
+					for (int x = 0; x < 4; x++)
+					{
+						vec2 offset = vec2(x - 1, y - 1) - f;
+						vec2 v = vec2(dot(offset, dir), dot(offset, vec2(-dir.y, dir.x))) * axisScale;
+						float w = kernelWeight(dot(v, v), window);
+						sum += c[y][x] * w;
+						weightSum += w;
+					}
+				}
+				vec3 color = sum / max(weightSum, 1.0 / 1024.0);
+
+				// Remove ringing by clamping to the centre texels
+				vec3 minC = min(min(c[1][1], c[1][2]), min(c[2][1], c[2][2]));
+				vec3 maxC = max(max(c[1][1], c[1][2]), max(c[2][1], c[2][2]));
+				color = clamp(color, minC, maxC);
+
+				// Contrast adaptive sharpening against the bilinear result, backing off in high contrast areas
+				vec3 bilinear = mix(mix(c[1][1], c[1][2], f.x), mix(c[2][1], c[2][2], f.x), f.y);
+				float amount = sqrt(clamp(min(minL, max(1.0 - maxL, 0.0)) / max(maxL, 1.0 / 256.0), 0.0, 1.0)) * Sharpness;
+				color = clamp(color + (color - bilinear) * amount * 2.0, minC, maxC);
+
+				imageStore(outputImage, dst, vec4(color, 1.0));
 			}
 		)";
 	}
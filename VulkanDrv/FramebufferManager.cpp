@@ -9,51 +9,41 @@ FramebufferManager::FramebufferManager(UVulkanRenderDevice* renderer) : renderer
 
 void FramebufferManager::CreateSceneFramebuffer()
 {
-	SceneFramebuffer = FramebufferBuilder()
-		.RenderPass(renderer->RenderPasses->Scene.RenderPass.get())
-		.Size(renderer->Textures->Scene->Width, renderer->Textures->Scene->Height)
-		.AddAttachment(renderer->Textures->Scene->ColorBufferView.get())
-		.AddAttachment(renderer->Textures->Scene->HitBufferView.get())
-		.AddAttachment(renderer->Textures->Scene->DepthBufferView.get())
-		.DebugName("SceneFramebuffer")
-		.Create(renderer->Device.get());
-
-	for (int level = 0; level < NumBloomLevels; level++)
+	auto buffers = renderer->Textures->Scene.get();
+	for (int hitTest = 0; hitTest < 2; hitTest++)
 	{
-		BloomBlurLevels[level].VTextureFB = FramebufferBuilder()
-			.RenderPass(renderer->RenderPasses->Postprocess.RenderPass.get())
-			.Size(renderer->Textures->Scene->BloomBlurLevels[level].Width, renderer->Textures->Scene->BloomBlurLevels[level].Height)
-			.AddAttachment(renderer->Textures->Scene->BloomBlurLevels[level].VTextureView.get())
-			.DebugName("VTextureFB")
-			.Create(renderer->Device.get());
-
-		BloomBlurLevels[level].HTextureFB = FramebufferBuilder()
-			.RenderPass(renderer->RenderPasses->Postprocess.RenderPass.get())
-			.Size(renderer->Textures->Scene->BloomBlurLevels[level].Width, renderer->Textures->Scene->BloomBlurLevels[level].Height)
-			.AddAttachment(renderer->Textures->Scene->BloomBlurLevels[level].HTextureView.get())
-			.DebugName("HTextureFB")
-			.Create(renderer->Device.get());
+		FramebufferBuilder builder;
+		builder.RenderPass(renderer->RenderPasses->Scene.RenderPass[hitTest].get());
+		builder.Size(buffers->Width, buffers->Height);
+		builder.AddAttachment(buffers->ColorBufferView.get());
+		if (hitTest)
+			builder.AddAttachment(buffers->HitBufferView.get());
+		builder.AddAttachment(buffers->DepthBufferView.get());
+		if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+		{
+			builder.AddAttachment(buffers->PPImageView[0].get());
+			if (hitTest)
+				builder.AddAttachment(buffers->PPHitBufferView.get());
+		}
+		builder.DebugName("SceneFramebuffer");
+		SceneFramebuffer[hitTest] = builder.Create(renderer->Device.get());
 	}
 
 	for (int i = 0; i < 2; i++)
 	{
 		PPImageFB[i] = FramebufferBuilder()
 			.RenderPass(renderer->RenderPasses->Postprocess.RenderPass.get())
-			.Size(renderer->Textures->Scene->Width, renderer->Textures->Scene->Height)
+			.Size(renderer->Textures->Scene->PPImage[i]->width, renderer->Textures->Scene->PPImage[i]->height)
 			.AddAttachment(renderer->Textures->Scene->PPImageView[i].get())
-			.DebugName("BloomPPImageFB")
+			.DebugName("PPImageFB")
 			.Create(renderer->Device.get());
 	}
 }
 
 void FramebufferManager::DestroySceneFramebuffer()
 {
-	SceneFramebuffer.reset();
-	for (int level = 0; level < NumBloomLevels; level++)
-	{
-		BloomBlurLevels[level].VTextureFB.reset();
-		BloomBlurLevels[level].HTextureFB.reset();
-	}
+	for (int hitTest = 0; hitTest < 2; hitTest++)
+		SceneFramebuffer[hitTest].reset();
 
 	for (int i = 0; i < 2; i++)
 		PPImageFB[i].reset();
@@ -64,14 +54,14 @@ void FramebufferManager::CreateSwapChainFramebuffers()
 	renderer->RenderPasses->CreatePresentRenderPass();
 	renderer->RenderPasses->CreatePresentPipeline();
 
-	auto swapchain = renderer->Commands->SwapChain.get();
-	for (int i = 0; i < swapchain->ImageCount(); i++)
+	auto commands = renderer->Commands.get();
+	for (int i = 0; i < commands->GetPresentImageCount(); i++)
 	{
 		SwapChainFramebuffers.push_back(
 			FramebufferBuilder()
 				.RenderPass(renderer->RenderPasses->Present.RenderPass.get())
-				.Size(renderer->Commands->SwapChain->Width(), renderer->Commands->SwapChain->Height())
-				.AddAttachment(swapchain->GetImageView(i))
+				.Size(commands->GetPresentWidth(), commands->GetPresentHeight())
+				.AddAttachment(commands->GetPresentImageView(i))
 				.DebugName("SwapChainFramebuffer")
 				.Create(renderer->Device.get()));
 	}
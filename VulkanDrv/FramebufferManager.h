@@ -16,16 +16,11 @@ public:
 	void DestroySwapChainFramebuffers();
 
 	VulkanFramebuffer* GetSwapChainFramebuffer();
+	VulkanFramebuffer* GetSceneFramebuffer(bool hitTest) { return SceneFramebuffer[hitTest].get(); }
 
-	std::unique_ptr<VulkanFramebuffer> SceneFramebuffer;
+	std::unique_ptr<VulkanFramebuffer> SceneFramebuffer[2];
 	std::unique_ptr<VulkanFramebuffer> PPImageFB[2];
 
-	struct
-	{
-		std::unique_ptr<VulkanFramebuffer> VTextureFB;
-		std::unique_ptr<VulkanFramebuffer> HTextureFB;
-	} BloomBlurLevels[NumBloomLevels];
-
 private:
 	UVulkanRenderDevice* renderer = nullptr;
 	std::vector<std::unique_ptr<VulkanFramebuffer>> SwapChainFramebuffers;
@@ -0,0 +1,156 @@
+
+#include "Precomp.h"
+#include "PipelineCompiler.h"
+#include "RenderPassManager.h"
+#include <chrono>
+#include <algorithm>
+
+PipelineCompiler::PipelineCompiler()
+{
+	Worker = std::thread([this]() { WorkerMain(); });
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+	Cancel();
+
+	std::unique_lock<std::mutex> lock(Mutex);
+	StopWorker = true;
+	lock.unlock();
+	WorkerCondition.notify_one();
+	Worker.join();
+}
+
+void PipelineCompiler::Queue(PipelineState* target, std::function<std::unique_ptr<VulkanPipeline>()> create)
+{
+	target->Queued = true;
+	PendingCount++;
+
+	std::unique_lock<std::mutex> lock(Mutex);
+	Job job;
+	job.Target = target;
+	job.Create = std::move(create);
+	Jobs.push_back(std::move(job));
+	lock.unlock();
+	WorkerCondition.notify_one();
+}
+
+void PipelineCompiler::ProcessCompleted()
+{
+	if (!HasCompleted)
+		return;
+
+	std::unique_lock<std::mutex> lock(Mutex);
+	std::vector<CompletedJob> completed = std::move(Completed);
+	Completed.clear();
+	HasCompleted = false;
+	lock.unlock();
+
+	for (CompletedJob& job : completed)
+	{
+		// The render thread may have had to create it itself in the meantime
+		if (!job.Target->Pipeline)
+		{
+			job.Target->Pipeline = std::move(job.Pipeline);
+
+			// A failed pipeline is not queued again. Its users keep drawing with a fallback, or create it on demand, which throws the error there.
+			if (!job.Target->Pipeline)
+			{
+				job.Target->Failed = true;
+				debugf(TEXT("VulkanDrv: background pipeline compile failed: %s"), appFromAnsi(job.Error.c_str()));
+			}
+		}
+		job.Target->Queued = false;
+		CompiledCount++;
+		CompileMs += job.Milliseconds;
+	}
+}
+
+void PipelineCompiler::Finish(PipelineState* target)
+{
+	// Called when the render thread can't draw without the pipeline.
+	// A job the worker hasn't started is created right here instead of waiting behind the jobs in front of it.
+	std::unique_lock<std::mutex> lock(Mutex);
+	auto it = std::find_if(Jobs.begin(), Jobs.end(), [target](const Job& job) { return job.Target == target; });
+	if (it != Jobs.end())
+	{
+		Job job = std::move(*it);
+		Jobs.erase(it);
+		PendingCount--;
+		lock.unlock();
+
+		target->Queued = false;
+		target->Pipeline = job.Create();
+		return;
+	}
+
+	IdleCondition.wait(lock, [this, target]() { return BusyTarget != target; });
+	lock.unlock();
+	ProcessCompleted();
+}
+
+void PipelineCompiler::Cancel()
+{
+	// Drops everything not yet handed back. Called before the render passes or targets the jobs refer to are destroyed.
+	std::unique_lock<std::mutex> lock(Mutex);
+	IdleCondition.wait(lock, [this]() { return !BusyTarget; });
+	for (Job& job : Jobs)
+		job.Target->Queued = false;
+	for (CompletedJob& job : Completed)
+		job.Target->Queued = false;
+	Jobs.clear();
+	Completed.clear();
+	HasCompleted = false;
+	PendingCount = 0;
+}
+
+void PipelineCompiler::Cancel(PipelineState* target)
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	IdleCondition.wait(lock, [this, target]() { return BusyTarget != target; });
+	auto jobsEnd = std::remove_if(Jobs.begin(), Jobs.end(), [target](const Job& job) { return job.Target == target; });
+	PendingCount -= (int)(Jobs.end() - jobsEnd);
+	Jobs.erase(jobsEnd, Jobs.end());
+	Completed.erase(std::remove_if(Completed.begin(), Completed.end(), [target](const CompletedJob& job) { return job.Target == target; }), Completed.end());
+	target->Queued = false;
+}
+
+void PipelineCompiler::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	while (true)
+	{
+		WorkerCondition.wait(lock, [this]() { return StopWorker || !Jobs.empty(); });
+		if (StopWorker)
+			break;
+
+		Job job = std::move(Jobs.front());
+		Jobs.erase(Jobs.begin());
+		BusyTarget = job.Target;
+		lock.unlock();
+
+		CompletedJob result;
+		result.Target = job.Target;
+		auto start = std::chrono::steady_clock::now();
+		try
+		{
+			result.Pipeline = job.Create();
+		}
+		catch (const std::exception& e)
+		{
+			result.Error = e.what();
+		}
+		catch (...)
+		{
+			result.Error = "unknown error";
+		}
+		result.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+		Completed.push_back(std::move(result));
+		HasCompleted = true;
+		PendingCount--;
+		BusyTarget = nullptr;
+		IdleCondition.notify_all();
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+
+struct PipelineState;
+
+// Creates pipelines on a background thread. Finished pipelines are handed back on the render thread by ProcessCompleted.
+class PipelineCompiler
+{
+public:
+	PipelineCompiler();
+	~PipelineCompiler();
+
+	void Queue(PipelineState* target, std::function<std::unique_ptr<VulkanPipeline>()> create);
+	void ProcessCompleted();
+	void Finish(PipelineState* target);
+	void Cancel();
+	void Cancel(PipelineState* target);
+
+	int GetPendingCount() const { return PendingCount; }
+
+	int CompiledCount = 0;
+	double CompileMs = 0.0;
+
+private:
+	void WorkerMain();
+
+	struct Job
+	{
+		PipelineState* Target = nullptr;
+		std::function<std::unique_ptr<VulkanPipeline>()> Create;
+	};
+
+	struct CompletedJob
+	{
+		PipelineState* Target = nullptr;
+		std::unique_ptr<VulkanPipeline> Pipeline;
+		std::string Error;
+		double Milliseconds = 0.0;
+	};
+
+	std::mutex Mutex;
+	std::condition_variable WorkerCondition;
+	std::condition_variable IdleCondition;
+	std::vector<Job> Jobs;
+	std::vector<CompletedJob> Completed;
+	std::atomic<int> PendingCount{ 0 };
+	std::atomic<bool> HasCompleted{ false };
+	PipelineState* BusyTarget = nullptr;
+	bool StopWorker = false;
+	std::thread Worker;
+};
@@ -2,15 +2,18 @@
 #include "Precomp.h"
 #include "RenderPassManager.h"
 #include "UVulkanRenderDevice.h"
+#include <chrono>
 
 RenderPassManager::RenderPassManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
 	CreateSceneBindlessPipelineLayout();
 	CreatePostprocessRenderPass();
 	CreatePresentPipelineLayout();
+	CreatePresentLutPipeline();
 	CreateScreenshotPipeline();
 	CreateBloomPipelineLayout();
 	CreateBloomPipeline();
+	CreateUpscalePipeline();
 }
 
 RenderPassManager::~RenderPassManager()
@@ -35,16 +38,143 @@ void RenderPassManager::CreatePresentPipelineLayout()
 		.Create(renderer->Device.get());
 }
 
+void RenderPassManager::CreatePresentLutPipeline()
+{
+	Present.LutPipelineLayout = PipelineLayoutBuilder()
+		.AddSetLayout(renderer->DescriptorSets->GetPresentLutLayout())
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PresentLutPushConstants))
+		.DebugName("PresentLutPipelineLayout")
+		.Create(renderer->Device.get());
+
+	Present.LutPipeline = ComputePipelineBuilder()
+		.ComputeShader(renderer->Shaders->Postprocess.PresentLut.get())
+		.Layout(Present.LutPipelineLayout.get())
+		.DebugName("PresentLut")
+		.Create(renderer->Device.get());
+}
+
 void RenderPassManager::CreateBloomPipelineLayout()
 {
 	Bloom.PipelineLayout = PipelineLayoutBuilder()
 		.AddSetLayout(renderer->DescriptorSets->GetBloomLayout())
-		.AddPushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BloomPushConstants))
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants))
 		.DebugName("BloomPipelineLayout")
 		.Create(renderer->Device.get());
 }
 
 PipelineState* RenderPassManager::GetPipeline(DWORD PolyFlags)
+{
+	int index = GetPipelineIndex(PolyFlags);
+	PipelineState* state = &Scene.Pipeline[Scene.HitTest][index];
+	if (!state->Pipeline)
+	{
+		// No fallback can stand in for a different blend state
+		bool hitTest = Scene.HitTest;
+		CreatePipelineNow(state, [=]() { return CreateScenePipeline(hitTest, index, ~0u); });
+	}
+	return state;
+}
+
+PipelineState* RenderPassManager::GetTilePipeline(DWORD PolyFlags)
+{
+	int index = GetPipelineIndex(PolyFlags);
+	PipelineState* state = &Scene.TilePipeline[Scene.HitTest][index];
+	if (!state->Pipeline)
+	{
+		bool hitTest = Scene.HitTest;
+		CreatePipelineNow(state, [=]() { return CreateScenePipeline(hitTest, index, ~0u, true); });
+	}
+	return state;
+}
+
+PipelineState* RenderPassManager::GetSurfacePipeline(DWORD PolyFlags, uint32_t surfaceFlags)
+{
+	// Pipelines with the surface flags baked into the fragment shader are compiled in the background.
+	// The generic pipeline draws the surface until it is ready, or for good if it failed to compile.
+	int index = GetPipelineIndex(PolyFlags);
+	PipelineState& state = Scene.SurfacePipelines[Scene.HitTest][(surfaceFlags << 5) | index];
+	if (state.Pipeline)
+		return &state;
+
+	if (!state.Queued && !state.Failed)
+	{
+		bool hitTest = Scene.HitTest;
+		Compiler.Queue(&state, [=]() { return CreateScenePipeline(hitTest, index, surfaceFlags); });
+	}
+	return GetPipeline(PolyFlags);
+}
+
+VulkanPipeline* RenderPassManager::GetPresentPipeline()
+{
+	if (!Present.Pipeline.Pipeline)
+	{
+		VulkanRenderPass* renderPass = Present.RenderPass.get();
+		CreatePipelineNow(&Present.Pipeline, [=]() { return CreatePresentPipeline(renderPass, "PresentPipeline"); });
+	}
+	return Present.Pipeline.Pipeline.get();
+}
+
+VulkanPipeline* RenderPassManager::GetScreenshotPipeline()
+{
+	if (!Present.ScreenshotPipeline.Pipeline)
+	{
+		VulkanRenderPass* renderPass = Postprocess.RenderPass.get();
+		CreatePipelineNow(&Present.ScreenshotPipeline, [=]() { return CreatePresentPipeline(renderPass, "ScreenshotPipeline"); });
+	}
+	return Present.ScreenshotPipeline.Pipeline.get();
+}
+
+std::unique_ptr<VulkanPipeline> RenderPassManager::CreatePresentPipeline(VulkanRenderPass* renderPass, const char* debugName)
+{
+	return GraphicsPipelineBuilder()
+		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
+		.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentShader.get())
+		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
+		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
+		.Layout(Present.PipelineLayout.get())
+		.RenderPass(renderPass)
+		.DebugName(debugName)
+		.Create(renderer->Device.get());
+}
+
+void RenderPassManager::QueuePresentPipelines()
+{
+	// Nothing else can draw the frame to the screen, so these are compiled before the first frame needs them
+	if (Present.RenderPass && !Present.Pipeline.Pipeline && !Present.Pipeline.Queued && !Present.Pipeline.Failed)
+	{
+		VulkanRenderPass* renderPass = Present.RenderPass.get();
+		Compiler.Queue(&Present.Pipeline, [=]() { return CreatePresentPipeline(renderPass, "PresentPipeline"); });
+	}
+	if (!Present.ScreenshotPipeline.Pipeline && !Present.ScreenshotPipeline.Queued && !Present.ScreenshotPipeline.Failed)
+	{
+		VulkanRenderPass* renderPass = Postprocess.RenderPass.get();
+		Compiler.Queue(&Present.ScreenshotPipeline, [=]() { return CreatePresentPipeline(renderPass, "ScreenshotPipeline"); });
+	}
+}
+
+void RenderPassManager::CreatePipelineNow(PipelineState* state, const std::function<std::unique_ptr<VulkanPipeline>()>& create)
+{
+	Compiler.ProcessCompleted();
+	if (state->Pipeline)
+		return;
+
+	// Take over the background job if there is one, so that the pipeline isn't created twice
+	auto start = std::chrono::steady_clock::now();
+	if (state->Queued)
+		Compiler.Finish(state);
+	if (!state->Pipeline)
+		state->Pipeline = create();
+	AddOnDemandTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void RenderPassManager::AddOnDemandTime(double milliseconds)
+{
+	PipelineStats.OnDemandCount++;
+	PipelineStats.OnDemandMs += milliseconds;
+	PipelineStats.WorstHitchMs = std::max(PipelineStats.WorstHitchMs, milliseconds);
+}
+
+int RenderPassManager::GetPipelineIndex(DWORD PolyFlags)
 {
 	int index;
 	if (PolyFlags & PF_Translucent)
@@ -77,30 +207,71 @@ PipelineState* RenderPassManager::GetPipeline(DWORD PolyFlags)
 		index |= 16;
 	}
 
-	return &Scene.Pipeline[index];
+	return index;
 }
 
 PipelineState* RenderPassManager::GetEndFlashPipeline()
 {
-	return &Scene.Pipeline[2];
+	return GetPipeline(PF_Highlighted);
 }
 
 void RenderPassManager::CreatePipelines()
 {
-	VulkanShader* vertShader = renderer->Shaders->Scene.VertexShader.get();
+	auto start = std::chrono::steady_clock::now();
+
+	Compiler.Cancel();
+	for (int hitTest = 0; hitTest < 2; hitTest++)
+		CreateScenePipelines(hitTest);
+
+	QueuePresentPipelines();
+
+	// Warm up the variants nearly every level uses: solid and masked world geometry, translucent, modulated and highlighted.
+	// The hit test variants come last. The editor draws with them whenever the user clicks into a viewport.
+	static const DWORD warmup[] = { PF_Occlude, PF_Occlude | PF_Masked, PF_Translucent, PF_Modulated, PF_Highlighted, 0 };
+	static const DWORD tileWarmup[] = { PF_Masked, PF_Translucent, PF_Modulated, 0 }; // HUD, font and sprite tiles
+	for (int hitTest = 0; hitTest < 2; hitTest++)
+	{
+		for (DWORD polyflags : warmup)
+		{
+			int index = GetPipelineIndex(polyflags);
+			Compiler.Queue(&Scene.Pipeline[hitTest][index], [=]() { return CreateScenePipeline(hitTest, index, ~0u); });
+		}
+		for (DWORD polyflags : tileWarmup)
+		{
+			int index = GetPipelineIndex(polyflags);
+			Compiler.Queue(&Scene.TilePipeline[hitTest][index], [=]() { return CreateScenePipeline(hitTest, index, ~0u, true); });
+		}
+	}
+
+	PipelineStats.StartupMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::unique_ptr<VulkanPipeline> RenderPassManager::CreateScenePipeline(bool hitTest, int index, uint32_t specializedFlags, bool tiles)
+{
+	VulkanShader* vertShader = tiles ? renderer->Shaders->Scene.TileVertexShader.get() : renderer->Shaders->Scene.VertexShader.get();
 	VulkanShader* fragShader = renderer->Shaders->Scene.FragmentShader.get();
 	VulkanShader* fragShaderAlphaTest = renderer->Shaders->Scene.FragmentShaderAlphaTest.get();
 	VulkanPipelineLayout* layout = Scene.BindlessPipelineLayout.get();
-	static const char* debugName = "ScenePipeline";
 
-	for (int i = 0; i < 32; i++)
+	GraphicsPipelineBuilder builder;
+	builder.AddVertexShader(vertShader);
+	builder.Viewport(0.0f, 0.0f, (float)renderer->Textures->Scene->Width, (float)renderer->Textures->Scene->Height);
+	builder.Scissor(0, 0, renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
+	builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	if (tiles)
+	{
+		// One instance per tile, drawn as a four vertex strip
+		builder.Topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP);
+		builder.AddVertexBufferBinding(1, sizeof(TileInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
+		builder.AddVertexAttribute(0, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, Rect));
+		builder.AddVertexAttribute(1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, TexRect));
+		builder.AddVertexAttribute(2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, Color));
+		builder.AddVertexAttribute(3, 1, VK_FORMAT_R32_SFLOAT, offsetof(TileInstance, Z));
+		builder.AddVertexAttribute(4, 1, VK_FORMAT_R32_SINT, offsetof(TileInstance, TextureBind));
+	}
+	else
 	{
-		GraphicsPipelineBuilder builder;
-		builder.AddVertexShader(vertShader);
-		builder.Viewport(0.0f, 0.0f, (float)renderer->Textures->Scene->Width, (float)renderer->Textures->Scene->Height);
-		builder.Scissor(0, 0, renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
 		builder.Topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-		builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
 		builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
 		builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
 		builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
@@ -110,61 +281,80 @@ void RenderPassManager::CreatePipelines()
 		builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
 		builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
 		builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
-		builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
-		builder.Layout(layout);
-		builder.RenderPass(Scene.RenderPass.get());
+	}
+	builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
+	builder.Layout(layout);
+	builder.RenderPass(Scene.RenderPass[hitTest].get());
 
-		// Avoid clipping the weapon. The UE1 engine clips the geometry anyway.
-		if (renderer->Device.get()->EnabledFeatures.Features.depthClamp)
-			builder.DepthClampEnable(true);
+	// Avoid clipping the weapon. The UE1 engine clips the geometry anyway.
+	if (renderer->Device.get()->EnabledFeatures.Features.depthClamp)
+		builder.DepthClampEnable(true);
 
-		ColorBlendAttachmentBuilder colorblend;
-		switch (i & 3)
-		{
-		case 0: // PF_Translucent
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR);
-			builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
-			break;
-		case 1: // PF_Modulated
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_DST_COLOR, VK_BLEND_FACTOR_SRC_COLOR);
-			builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
-			break;
-		case 2: // PF_Highlighted
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
-			builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
-			break;
-		case 3:
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO); // Hmm, is it faster to keep the blend mode enabled or to toggle it?
-			break;
-		}
+	ColorBlendAttachmentBuilder colorblend;
+	switch (index & 3)
+	{
+	case 0: // PF_Translucent
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR);
+		builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
+		break;
+	case 1: // PF_Modulated
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_DST_COLOR, VK_BLEND_FACTOR_SRC_COLOR);
+		builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
+		break;
+	case 2: // PF_Highlighted
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
+		builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
+		break;
+	case 3:
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO); // Hmm, is it faster to keep the blend mode enabled or to toggle it?
+		break;
+	}
 
-		if (i & 4) // PF_Invisible
-		{
-			colorblend.ColorWriteMask(0);
-		}
+	if (index & 4) // PF_Invisible
+	{
+		colorblend.ColorWriteMask(0);
+	}
 
-		if (i & 8) // PF_Occlude
-		{
-			builder.DepthStencilEnable(true, true, false);
-		}
-		else
-		{
-			builder.DepthStencilEnable(true, false, false);
-		}
+	if (index & 8) // PF_Occlude
+	{
+		builder.DepthStencilEnable(true, true, false);
+	}
+	else
+	{
+		builder.DepthStencilEnable(true, false, false);
+	}
 
-		if (i & 16) // PF_Masked
-			builder.AddFragmentShader(fragShaderAlphaTest);
-		else
-			builder.AddFragmentShader(fragShader);
+	if (index & 16) // PF_Masked
+		builder.AddFragmentShader(fragShaderAlphaTest);
+	else
+		builder.AddFragmentShader(fragShader);
 
-		builder.AddColorBlendAttachment(colorblend.Create());
+	builder.AddColorBlendAttachment(colorblend.Create());
+	if (hitTest)
 		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
 
-		builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
-		builder.DebugName(debugName);
+	builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
+	if (specializedFlags != ~0u)
+		builder.AddConstant(0, specializedFlags);
+	builder.DebugName(specializedFlags != ~0u ? "SurfacePipeline" : tiles ? "TilePipeline" : "ScenePipeline");
 
-		Scene.Pipeline[i].Pipeline = builder.Create(renderer->Device.get());
+	return builder.Create(renderer->Device.get());
+}
+
+void RenderPassManager::CreateScenePipelines(bool hitTest)
+{
+	VulkanShader* vertShader = renderer->Shaders->Scene.VertexShader.get();
+	VulkanShader* fragShader = renderer->Shaders->Scene.FragmentShader.get();
+	VulkanPipelineLayout* layout = Scene.BindlessPipelineLayout.get();
+	static const char* debugName = "ScenePipeline";
+
+	// Scene pipelines are created when first used
+	for (int i = 0; i < 32; i++)
+	{
+		Scene.Pipeline[hitTest][i].Pipeline.reset();
+		Scene.TilePipeline[hitTest][i].Pipeline.reset();
 	}
+	Scene.SurfacePipelines[hitTest].clear();
 
 	// Line pipeline
 	for (int i = 0; i < 2; i++)
@@ -186,10 +376,11 @@ void RenderPassManager::CreatePipelines()
 		builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
 		builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
 		builder.Layout(layout);
-		builder.RenderPass(Scene.RenderPass.get());
+		builder.RenderPass(Scene.RenderPass[hitTest].get());
 
 		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA).Create());
-		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
+		if (hitTest)
+			builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
 
 		builder.DepthStencilEnable(true, true, false);
 		builder.AddFragmentShader(fragShader);
@@ -197,12 +388,12 @@ void RenderPassManager::CreatePipelines()
 		builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
 		builder.DebugName(debugName);
 
-		Scene.LinePipeline[i].Pipeline = builder.Create(renderer->Device.get());
+		Scene.LinePipeline[hitTest][i].Pipeline = builder.Create(renderer->Device.get());
 
 		if (i == 0)
 		{
-			Scene.LinePipeline[i].MinDepth = 0.0f;
-			Scene.LinePipeline[i].MaxDepth = 0.1f;
+			Scene.LinePipeline[hitTest][i].MinDepth = 0.0f;
+			Scene.LinePipeline[hitTest][i].MaxDepth = 0.1f;
 		}
 	}
 
@@ -227,95 +418,163 @@ void RenderPassManager::CreatePipelines()
 		builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
 		builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
 		builder.Layout(layout);
-		builder.RenderPass(Scene.RenderPass.get());
+		builder.RenderPass(Scene.RenderPass[hitTest].get());
 
 		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA).Create());
-		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
+		if (hitTest)
+			builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
 
 		builder.DepthStencilEnable(true, true, false);
 		builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
 		builder.DebugName(debugName);
 
-		Scene.PointPipeline[i].Pipeline = builder.Create(renderer->Device.get());
+		Scene.PointPipeline[hitTest][i].Pipeline = builder.Create(renderer->Device.get());
 
 		if (i == 0)
 		{
-			Scene.PointPipeline[i].MinDepth = 0.0f;
-			Scene.PointPipeline[i].MaxDepth = 0.1f;
+			Scene.PointPipeline[hitTest][i].MinDepth = 0.0f;
+			Scene.PointPipeline[hitTest][i].MaxDepth = 0.1f;
 		}
 	}
 }
 
 void RenderPassManager::CreateRenderPass()
 {
-	Scene.RenderPass = RenderPassBuilder()
-		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddAttachment(
-			VK_FORMAT_R32_UINT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddDepthStencilAttachment(
-			VK_FORMAT_D32_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.AddSubpass()
-		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassColorAttachmentRef(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassDepthStencilAttachmentRef(2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.DebugName("SceneRenderPass")
-		.Create(renderer->Device.get());
+	for (int hitTest = 0; hitTest < 2; hitTest++)
+	{
+		Scene.RenderPass[hitTest] = CreateSceneRenderPass(false, hitTest);
+		Scene.RenderPassContinue[hitTest] = CreateSceneRenderPass(true, hitTest);
+	}
+}
 
-	Scene.RenderPassContinue = RenderPassBuilder()
-		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddAttachment(
-			VK_FORMAT_R32_UINT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddDepthStencilAttachment(
-			VK_FORMAT_D32_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.AddSubpass()
-		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassColorAttachmentRef(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassDepthStencilAttachmentRef(2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.DebugName("SceneRenderPassContinue")
-		.Create(renderer->Device.get());
+std::unique_ptr<VulkanRenderPass> RenderPassManager::CreateSceneRenderPass(bool continuePass, bool hitTest)
+{
+	VkSampleCountFlagBits samples = renderer->Textures->Scene->SceneSamples;
+	VkAttachmentLoadOp loadOp = continuePass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	VkImageLayout colorLayout = continuePass ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	VkImageLayout depthLayout = continuePass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+
+	RenderPassBuilder builder;
+	builder.AddAttachment(VK_FORMAT_R16G16B16A16_SFLOAT, samples, loadOp, VK_ATTACHMENT_STORE_OP_STORE, colorLayout, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (hitTest)
+		builder.AddAttachment(VK_FORMAT_R32_UINT, samples, loadOp, VK_ATTACHMENT_STORE_OP_STORE, colorLayout, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	builder.AddDepthStencilAttachment(VK_FORMAT_D32_SFLOAT, samples, loadOp, VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, depthLayout, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+	// Multisampled scenes resolve into the post process image (and the hit buffer when hit testing) at the end of the pass
+	bool resolve = samples != VK_SAMPLE_COUNT_1_BIT;
+	if (resolve)
+	{
+		builder.AddAttachment(VK_FORMAT_R16G16B16A16_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		if (hitTest)
+			builder.AddAttachment(VK_FORMAT_R32_UINT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+
+	// Without hit testing the hit attachment is left out entirely. Scene.frag still writes location 1, which is then discarded.
+	uint32_t depthIndex = hitTest ? 2 : 1;
+	builder.AddSubpass();
+	builder.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (hitTest)
+		builder.AddSubpassColorAttachmentRef(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	builder.AddSubpassDepthStencilAttachmentRef(depthIndex, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	if (resolve)
+	{
+		builder.AddSubpassResolveAttachmentRef(depthIndex + 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		if (hitTest)
+			builder.AddSubpassResolveAttachmentRef(depthIndex + 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+
+	builder.DebugName(continuePass ? "SceneRenderPassContinue" : "SceneRenderPass");
+	return builder.Create(renderer->Device.get());
+}
+
+void RenderPassManager::BeginScene(VulkanCommandBuffer* cmdbuffer, bool hitTest, float r, float g, float b, float a)
+{
+	auto buffers = renderer->Textures->Scene.get();
+	Scene.HitTest = hitTest;
+
+	Compiler.ProcessCompleted();
+
+	// Special thanks to Khronos and AMD for making this absolute hell to use.
+	VkAccessFlags srcColorAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	VkAccessFlags srcDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	VkAccessFlags dstDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+	PipelineBarrier barrier;
+	barrier.AddImage(buffers->ColorBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	if (hitTest)
+		barrier.AddImage(buffers->HitBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	barrier.AddImage(buffers->DepthBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT);
+	if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		barrier.AddImage(buffers->PPImage[0].get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		srcStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		if (hitTest)
+		{
+			barrier.AddImage(buffers->PPHitBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, dstColorAccess);
+			srcStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+	}
+	barrier.Execute(cmdbuffer, srcStages, dstStages);
+
+	RenderPassBegin begin;
+	begin.RenderPass(Scene.RenderPass[hitTest].get());
+	begin.Framebuffer(renderer->Framebuffers->GetSceneFramebuffer(hitTest));
+	begin.RenderArea(0, 0, buffers->Width, buffers->Height);
+	begin.AddClearColor(r, g, b, a);
+	if (hitTest)
+		begin.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	begin.AddClearDepthStencil(1.0f, 0);
+	begin.Execute(cmdbuffer);
+}
+
+void RenderPassManager::ContinueScene(VulkanCommandBuffer* cmdbuffer)
+{
+	auto buffers = renderer->Textures->Scene.get();
+
+	VkAccessFlags srcColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+	VkAccessFlags srcDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	VkAccessFlags dstDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+	PipelineBarrier barrier;
+	barrier.AddImage(buffers->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	if (Scene.HitTest)
+		barrier.AddImage(buffers->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	barrier.AddImage(buffers->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT);
+	if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		// The previous pass already resolved into these. The continued pass resolves again over the whole image.
+		barrier.AddImage(buffers->PPImage[0].get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		if (Scene.HitTest)
+			barrier.AddImage(buffers->PPHitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	}
+	barrier.Execute(cmdbuffer, srcStages, dstStages);
+
+	RenderPassBegin()
+		.RenderPass(Scene.RenderPassContinue[Scene.HitTest].get())
+		.Framebuffer(renderer->Framebuffers->GetSceneFramebuffer(Scene.HitTest))
+		.RenderArea(0, 0, buffers->Width, buffers->Height)
+		.Execute(cmdbuffer);
+}
+
+void RenderPassManager::EndScene(VulkanCommandBuffer* cmdbuffer)
+{
+	cmdbuffer->endRenderPass();
 }
 
 void RenderPassManager::CreatePresentRenderPass()
 {
+	// A queued present pipeline refers to the render pass being replaced
+	Compiler.Cancel(&Present.Pipeline);
+
 	Present.RenderPass = RenderPassBuilder()
 		.AddAttachment(
-			renderer->Commands->SwapChain->Format().format,
+			renderer->Commands->GetPresentFormat().format,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
 			VK_ATTACHMENT_STORE_OP_STORE,
@@ -329,34 +588,14 @@ void RenderPassManager::CreatePresentRenderPass()
 
 void RenderPassManager::CreatePresentPipeline()
 {
-	for (int i = 0; i < 16; i++)
-	{
-		Present.Pipeline[i] = GraphicsPipelineBuilder()
-			.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-			.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentShader[i].get())
-			.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-			.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-			.Layout(Present.PipelineLayout.get())
-			.RenderPass(Present.RenderPass.get())
-			.DebugName("PresentPipeline")
-			.Create(renderer->Device.get());
-	}
+	Present.Pipeline.Pipeline.reset();
+	QueuePresentPipelines();
 }
 
 void RenderPassManager::CreateScreenshotPipeline()
 {
-	for (int i = 0; i < 16; i++)
-	{
-		Present.ScreenshotPipeline[i] = GraphicsPipelineBuilder()
-			.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-			.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentShader[i].get())
-			.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-			.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-			.Layout(Present.PipelineLayout.get())
-			.RenderPass(Postprocess.RenderPass.get())
-			.DebugName("ScreenshotPipeline")
-			.Create(renderer->Device.get());
-	}
+	Present.ScreenshotPipeline.Pipeline.reset();
+	QueuePresentPipelines();
 }
 
 void RenderPassManager::CreatePostprocessRenderPass()
@@ -373,71 +612,40 @@ void RenderPassManager::CreatePostprocessRenderPass()
 		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
 		.DebugName("PPRenderPass")
 		.Create(renderer->Device.get());
-
-	Postprocess.RenderPassCombine = RenderPassBuilder()
-		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpass()
-		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.DebugName("PPRenderPassCombine")
-		.Create(renderer->Device.get());
 }
 
-void RenderPassManager::CreateBloomPipeline()
+void RenderPassManager::CreateUpscalePipeline()
 {
-	Bloom.Extract = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.Extract.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.Extract")
+	Upscale.PipelineLayout = PipelineLayoutBuilder()
+		.AddSetLayout(renderer->DescriptorSets->GetUpscaleLayout())
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpscalePushConstants))
+		.DebugName("UpscalePipelineLayout")
 		.Create(renderer->Device.get());
 
-	Bloom.Combine = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.Combine.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE).Create())
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.Combine")
+	Upscale.Pipeline = ComputePipelineBuilder()
+		.ComputeShader(renderer->Shaders->Upscale.get())
+		.Layout(Upscale.PipelineLayout.get())
+		.DebugName("Upscale")
 		.Create(renderer->Device.get());
+}
 
-	Bloom.Scale = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.Combine.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
+void RenderPassManager::CreateBloomPipeline()
+{
+	Bloom.Extract = ComputePipelineBuilder()
+		.ComputeShader(renderer->Shaders->Bloom.Extract.get())
 		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.Copy")
+		.DebugName("Bloom.Extract")
 		.Create(renderer->Device.get());
 
-	Bloom.BlurVertical = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.BlurVertical.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
+	Bloom.Blur = ComputePipelineBuilder()
+		.ComputeShader(renderer->Shaders->Bloom.Blur.get())
 		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.BlurVertical")
+		.DebugName("Bloom.Blur")
 		.Create(renderer->Device.get());
 
-	Bloom.BlurHorizontal = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.BlurHorizontal.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
+	Bloom.Combine = ComputePipelineBuilder()
+		.ComputeShader(renderer->Shaders->Bloom.Combine.get())
 		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.BlurHorizontal")
+		.DebugName("Bloom.Combine")
 		.Create(renderer->Device.get());
 }
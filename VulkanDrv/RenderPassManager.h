@@ -1,5 +1,7 @@
 #pragma once
 
+#include "PipelineCompiler.h"
+
 class UVulkanRenderDevice;
 
 struct PipelineState
@@ -7,6 +9,8 @@ struct PipelineState
 	std::unique_ptr<VulkanPipeline> Pipeline;
 	float MinDepth = 0.1f;
 	float MaxDepth = 1.0f;
+	bool Queued = false;
+	bool Failed = false; // The background compile threw. It is not queued again.
 };
 
 class RenderPassManager
@@ -18,6 +22,10 @@ public:
 	void CreateRenderPass();
 	void CreatePipelines();
 
+	void BeginScene(VulkanCommandBuffer* cmdbuffer, bool hitTest, float r, float g, float b, float a);
+	void ContinueScene(VulkanCommandBuffer* cmdbuffer);
+	void EndScene(VulkanCommandBuffer* cmdbuffer);
+
 	void CreatePresentRenderPass();
 	void CreatePresentPipeline();
 	void CreateScreenshotPipeline();
@@ -26,48 +34,87 @@ public:
 	void CreateBloomPipeline();
 
 	PipelineState* GetPipeline(DWORD polyflags);
+	PipelineState* GetTilePipeline(DWORD polyflags);
+	PipelineState* GetSurfacePipeline(DWORD polyflags, uint32_t surfaceFlags);
 	PipelineState* GetEndFlashPipeline();
-	PipelineState* GetLinePipeline(bool occludeLines) { return &Scene.LinePipeline[occludeLines]; }
-	PipelineState* GetPointPipeline(bool occludeLines) { return &Scene.PointPipeline[occludeLines]; }
+	PipelineState* GetLinePipeline(bool occludeLines) { return &Scene.LinePipeline[Scene.HitTest][occludeLines]; }
+	PipelineState* GetPointPipeline(bool occludeLines) { return &Scene.PointPipeline[Scene.HitTest][occludeLines]; }
+	VulkanPipeline* GetPresentPipeline();
+	VulkanPipeline* GetScreenshotPipeline();
+
+	void CancelPipelineCompiles() { Compiler.Cancel(); }
+	int GetPendingPipelineCount() const { return Compiler.GetPendingCount(); }
+	int GetBackgroundPipelineCount() const { return Compiler.CompiledCount; }
+	double GetBackgroundPipelineMs() const { return Compiler.CompileMs; }
+
+	struct
+	{
+		double StartupMs = 0.0; // Render thread time spent in CreatePipelines
+		int OnDemandCount = 0; // Pipelines the render thread had to create at first use
+		double OnDemandMs = 0.0;
+		double WorstHitchMs = 0.0;
+	} PipelineStats;
 
 	struct
 	{
 		std::unique_ptr<VulkanPipelineLayout> BindlessPipelineLayout;
-		std::unique_ptr<VulkanRenderPass> RenderPass;
-		std::unique_ptr<VulkanRenderPass> RenderPassContinue;
-		PipelineState Pipeline[32];
-		PipelineState LinePipeline[2];
-		PipelineState PointPipeline[2];
+		// Render passes, framebuffers and pipelines are indexed by whether hit testing is active
+		std::unique_ptr<VulkanRenderPass> RenderPass[2];
+		std::unique_ptr<VulkanRenderPass> RenderPassContinue[2];
+		bool HitTest = false;
+		PipelineState Pipeline[2][32];
+		PipelineState TilePipeline[2][32];
+		PipelineState LinePipeline[2][2];
+		PipelineState PointPipeline[2][2];
+		std::unordered_map<uint32_t, PipelineState> SurfacePipelines[2];
 	} Scene;
 
 	struct
 	{
 		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
 		std::unique_ptr<VulkanRenderPass> RenderPass;
-		std::unique_ptr<VulkanPipeline> Pipeline[16];
-		std::unique_ptr<VulkanPipeline> ScreenshotPipeline[16];
+		PipelineState Pipeline;
+		PipelineState ScreenshotPipeline;
+		std::unique_ptr<VulkanPipelineLayout> LutPipelineLayout;
+		std::unique_ptr<VulkanPipeline> LutPipeline;
 	} Present;
 
 	struct
 	{
 		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
 		std::unique_ptr<VulkanPipeline> Extract;
+		std::unique_ptr<VulkanPipeline> Blur;
 		std::unique_ptr<VulkanPipeline> Combine;
-		std::unique_ptr<VulkanPipeline> Scale;
-		std::unique_ptr<VulkanPipeline> BlurVertical;
-		std::unique_ptr<VulkanPipeline> BlurHorizontal;
 	} Bloom;
 
+	struct
+	{
+		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
+		std::unique_ptr<VulkanPipeline> Pipeline;
+	} Upscale;
+
 	struct
 	{
 		std::unique_ptr<VulkanRenderPass> RenderPass;
-		std::unique_ptr<VulkanRenderPass> RenderPassCombine;
 	} Postprocess;
 
 private:
+	std::unique_ptr<VulkanRenderPass> CreateSceneRenderPass(bool continuePass, bool hitTest);
+	void CreateScenePipelines(bool hitTest);
+	std::unique_ptr<VulkanPipeline> CreateScenePipeline(bool hitTest, int index, uint32_t specializedFlags, bool tiles = false);
+	std::unique_ptr<VulkanPipeline> CreatePresentPipeline(VulkanRenderPass* renderPass, const char* debugName);
+	void QueuePresentPipelines();
+	static int GetPipelineIndex(DWORD polyflags);
+	void CreatePipelineNow(PipelineState* state, const std::function<std::unique_ptr<VulkanPipeline>()>& create);
+	void AddOnDemandTime(double milliseconds);
 	void CreateSceneBindlessPipelineLayout();
 	void CreatePresentPipelineLayout();
+	void CreatePresentLutPipeline();
 	void CreateBloomPipelineLayout();
+	void CreateUpscalePipeline();
 
 	UVulkanRenderDevice* renderer = nullptr;
+
+	// Declared last so that it is stopped before the pipeline states it writes to are destroyed
+	PipelineCompiler Compiler;
 };
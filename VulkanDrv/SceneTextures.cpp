@@ -3,7 +3,7 @@
 #include "SceneTextures.h"
 #include "UVulkanRenderDevice.h"
 
-SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int height, int multisample) : Width(width), Height(height), Multisample(multisample)
+SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int height, int outputWidth, int outputHeight, int multisample) : Width(width), Height(height), Multisample(multisample), OutputWidth(outputWidth), OutputHeight(outputHeight)
 {
 	SceneSamples = GetBestSampleCount(renderer->Device.get(), multisample);
 
@@ -49,10 +49,10 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 	for (int i = 0; i < 2; i++)
 	{
 		PPImage[i] = ImageBuilder()
-			.Size(width, height)
+			.Size(i == 0 ? width : outputWidth, i == 0 ? height : outputHeight)
 			.Samples(VK_SAMPLE_COUNT_1_BIT)
 			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
 			.DebugName("ppImage")
 			.Create(renderer->Device.get());
 
@@ -62,14 +62,35 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 			.Create(renderer->Device.get());
 	}
 
+	if (width != outputWidth || height != outputHeight)
+	{
+		UpscaleImage = ImageBuilder()
+			.Size(outputWidth, outputHeight)
+			.Samples(VK_SAMPLE_COUNT_1_BIT)
+			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
+			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+			.DebugName("upscaleImage")
+			.Create(renderer->Device.get());
+
+		UpscaleImageView = ImageViewBuilder()
+			.Image(UpscaleImage.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
+			.DebugName("upscaleImageView")
+			.Create(renderer->Device.get());
+	}
+
 	PPHitBuffer = ImageBuilder()
 		.Size(width, height)
 		.Samples(VK_SAMPLE_COUNT_1_BIT)
 		.Format(VK_FORMAT_R32_UINT)
-		.Usage(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.Usage(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
 		.DebugName("ppHitBuffer")
 		.Create(renderer->Device.get());
 
+	PPHitBufferView = ImageViewBuilder()
+		.Image(PPHitBuffer.get(), VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT)
+		.DebugName("ppHitBufferView")
+		.Create(renderer->Device.get());
+
 	StagingHitBuffer = BufferBuilder()
 		.Usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU)
 		.Size(width * height * sizeof(uint32_t))
@@ -86,30 +107,17 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 		BloomBlurLevels[level].Width = bloomWidth;
 		BloomBlurLevels[level].Height = bloomHeight;
 
-		BloomBlurLevels[level].VTexture = ImageBuilder()
+		BloomBlurLevels[level].Texture = ImageBuilder()
 			.Size(bloomWidth, bloomHeight)
 			.Samples(VK_SAMPLE_COUNT_1_BIT)
 			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-			.DebugName("BloomVTexture")
+			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT)
+			.DebugName("BloomTexture")
 			.Create(renderer->Device.get());
 
-		BloomBlurLevels[level].HTexture = ImageBuilder()
-			.Size(bloomWidth, bloomHeight)
-			.Samples(VK_SAMPLE_COUNT_1_BIT)
-			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-			.DebugName("BloomHTexture")
-			.Create(renderer->Device.get());
-
-		BloomBlurLevels[level].VTextureView = ImageViewBuilder()
-			.Image(BloomBlurLevels[level].VTexture.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
-			.DebugName("BloomVTextureView")
-			.Create(renderer->Device.get());
-
-		BloomBlurLevels[level].HTextureView = ImageViewBuilder()
-			.Image(BloomBlurLevels[level].HTexture.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
-			.DebugName("BloomHTextureView")
+		BloomBlurLevels[level].View = ImageViewBuilder()
+			.Image(BloomBlurLevels[level].Texture.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
+			.DebugName("BloomTextureView")
 			.Create(renderer->Device.get());
 	}
 
@@ -142,25 +150,18 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 	for (int level = 0; level < NumBloomLevels; level++)
 	{
 		barrier.AddImage(
-			BloomBlurLevels[level].VTexture.get(),
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			0,
-			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			VK_IMAGE_ASPECT_COLOR_BIT);
-		barrier.AddImage(
-			BloomBlurLevels[level].HTexture.get(),
+			BloomBlurLevels[level].Texture.get(),
 			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_GENERAL,
 			0,
-			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
 			VK_IMAGE_ASPECT_COLOR_BIT);
 	}
 
 	barrier.Execute(
 		renderer->Commands->GetDrawCommands(),
 		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
 SceneTextures::~SceneTextures()
@@ -11,7 +11,7 @@ enum { NumBloomLevels = 4 };
 class SceneTextures
 {
 public:
-	SceneTextures(UVulkanRenderDevice* renderer, int width, int height, int multisample);
+	SceneTextures(UVulkanRenderDevice* renderer, int width, int height, int outputWidth, int outputHeight, int multisample);
 	~SceneTextures();
 
 	// Current active multisample setting
@@ -29,12 +29,21 @@ public:
 	std::unique_ptr<VulkanImage> DepthBuffer;
 	std::unique_ptr<VulkanImageView> DepthBufferView;
 
-	// Post processing image buffers
+	// Post processing image buffers. PPImage[1] is only used for screenshots and is the size of the output.
 	std::unique_ptr<VulkanImage> PPImage[2];
 	std::unique_ptr<VulkanImageView> PPImageView[2];
 
+	// Output size image written by the upscaler. Only created when the scene is rendered at a lower resolution.
+	std::unique_ptr<VulkanImage> UpscaleImage;
+	std::unique_ptr<VulkanImageView> UpscaleImageView;
+
+	// Final image of the post process chain, as seen by the present pass
+	VulkanImage* GetOutputImage() { return UpscaleImage ? UpscaleImage.get() : PPImage[0].get(); }
+	VulkanImageView* GetOutputView() { return UpscaleImageView ? UpscaleImageView.get() : PPImageView[0].get(); }
+
 	// Texture and buffer used to download the hitbuffer
 	std::unique_ptr<VulkanImage> PPHitBuffer;
+	std::unique_ptr<VulkanImageView> PPHitBufferView;
 	std::unique_ptr<VulkanBuffer> StagingHitBuffer;
 
 	// Size of the scene framebuffer
@@ -42,13 +51,15 @@ public:
 	int Height = 0;
 	int Multisample = 0;
 
-	// Bloom post processing buffers
+	// Size of the image presented. Differs from the scene size when a render scale is active.
+	int OutputWidth = 0;
+	int OutputHeight = 0;
+
+	// Bloom downsample chain. Level 0 is half the scene size, each following level halves it again.
 	struct
 	{
-		std::unique_ptr<VulkanImage> VTexture;
-		std::unique_ptr<VulkanImageView> VTextureView;
-		std::unique_ptr<VulkanImage> HTexture;
-		std::unique_ptr<VulkanImageView> HTextureView;
+		std::unique_ptr<VulkanImage> Texture;
+		std::unique_ptr<VulkanImageView> View;
 		int Width = 0;
 		int Height = 0;
 	} BloomBlurLevels[NumBloomLevels];
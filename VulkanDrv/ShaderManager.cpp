@@ -14,6 +14,12 @@ ShaderManager::ShaderManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 		.DebugName("vertexShader")
 		.Create("vertexShader", renderer->Device.get());
 
+	Scene.TileVertexShader = ShaderBuilder()
+		.Type(ShaderType::Vertex)
+		.AddSource("shaders/Tile.vert", LoadShaderCode("shaders/Tile.vert"))
+		.DebugName("tileVertexShader")
+		.Create("tileVertexShader", renderer->Device.get());
+
 	Scene.FragmentShader = ShaderBuilder()
 		.Type(ShaderType::Fragment)
 		.AddSource("shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#"))
@@ -32,46 +38,41 @@ ShaderManager::ShaderManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 		.DebugName("ppVertexShader")
 		.Create("ppVertexShader", renderer->Device.get());
 
-	static const char* transferFunctions[2] = { nullptr, "HDR_MODE" };
-	static const char* gammaModes[2] = { "GAMMA_MODE_D3D9", "GAMMA_MODE_XOPENGL" };
-	static const char* colorModes[4] = { nullptr, "COLOR_CORRECT_MODE0", "COLOR_CORRECT_MODE1", "COLOR_CORRECT_MODE2" };
-	for (int i = 0; i < 16; i++)
-	{
-		std::string defines;
-		if (transferFunctions[i & 1]) defines += std::string("#define ") + transferFunctions[i & 1] + "\r\n";
-		if (gammaModes[(i >> 1) & 1]) defines += std::string("#define ") + gammaModes[(i >> 1) & 1] + "\r\n";
-		if (colorModes[(i >> 2) & 3]) defines += std::string("#define ") + colorModes[(i >> 2) & 3] + "\r\n";
+	Postprocess.FragmentPresentShader = ShaderBuilder()
+		.Type(ShaderType::Fragment)
+		.AddSource("shaders/Present.frag", LoadShaderCode("shaders/Present.frag"))
+		.DebugName("ppFragmentPresentShader")
+		.Create("ppFragmentPresentShader", renderer->Device.get());
 
-		Postprocess.FragmentPresentShader[i] = ShaderBuilder()
-			.Type(ShaderType::Fragment)
-			.AddSource("shaders/Present.frag", LoadShaderCode("shaders/Present.frag", defines))
-			.DebugName("ppFragmentPresentShader")
-			.Create("ppFragmentPresentShader", renderer->Device.get());
-	}
+	Postprocess.PresentLut = ShaderBuilder()
+		.Type(ShaderType::Compute)
+		.AddSource("shaders/PresentLut.comp", LoadShaderCode("shaders/PresentLut.comp"))
+		.DebugName("ppPresentLut")
+		.Create("ppPresentLut", renderer->Device.get());
 
 	Bloom.Extract = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BloomExtract.frag", LoadShaderCode("shaders/BloomExtract.frag"))
+		.Type(ShaderType::Compute)
+		.AddSource("shaders/BloomExtract.comp", LoadShaderCode("shaders/BloomBlur.comp", "#define BLOOM_EXTRACT"))
 		.DebugName("BloomPass.Extract")
 		.Create("BloomPass.Extract", renderer->Device.get());
 
+	Bloom.Blur = ShaderBuilder()
+		.Type(ShaderType::Compute)
+		.AddSource("shaders/BloomBlur.comp", LoadShaderCode("shaders/BloomBlur.comp"))
+		.DebugName("BloomPass.Blur")
+		.Create("BloomPass.Blur", renderer->Device.get());
+
 	Bloom.Combine = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BloomCombine.frag", LoadShaderCode("shaders/BloomCombine.frag"))
+		.Type(ShaderType::Compute)
+		.AddSource("shaders/BloomCombine.comp", LoadShaderCode("shaders/BloomCombine.comp"))
 		.DebugName("BloomPass.Combine")
 		.Create("BloomPass.Combine", renderer->Device.get());
 
-	Bloom.BlurVertical = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BlurVertical.frag", LoadShaderCode("shaders/Blur.frag", "#define BLUR_VERTICAL"))
-		.DebugName("BloomPass.BlurVertical")
-		.Create("BloomPass.BlurVertical", renderer->Device.get());
-
-	Bloom.BlurHorizontal = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BlurHorizontal.frag", LoadShaderCode("shaders/Blur.frag", "#define BLUR_HORIZONTAL"))
-		.DebugName("BloomPass.BlurHorizontal")
-		.Create("BloomPass.BlurHorizontal", renderer->Device.get());
+	Upscale = ShaderBuilder()
+		.Type(ShaderType::Compute)
+		.AddSource("shaders/Upscale.comp", LoadShaderCode("shaders/Upscale.comp"))
+		.DebugName("Upscale")
+		.Create("Upscale", renderer->Device.get());
 }
 
 ShaderManager::~ShaderManager()
@@ -16,6 +16,17 @@ struct SceneVertex
 	ivec4 TextureBinds;
 };
 
+// One tile or sprite. The corners are generated by Tile.vert.
+struct TileInstance
+{
+	vec4 Rect; // x0, y0, x1, y1 in view space, already scaled by Z
+	vec4 TexRect; // u0, v0, u1, v1
+	vec4 Color;
+	float Z;
+	int32_t TextureBind;
+	int32_t Padding1, Padding2;
+};
+
 struct ScenePushConstants
 {
 	mat4 objectToProjection;
@@ -25,12 +36,24 @@ struct ScenePushConstants
 };
 
 struct PresentPushConstants
+{
+	float LutMaxValue;
+	float LutSize;
+	int32_t Dither;
+	int32_t Padding;
+};
+
+struct PresentLutPushConstants
 {
 	float Contrast;
 	float Saturation;
 	float Brightness;
 	float HdrScale;
 	vec4 GammaCorrection;
+	float LutMaxValue;
+	int32_t GammaMode;
+	int32_t ColorCorrectMode;
+	int32_t HdrMode;
 };
 
 struct BloomPushConstants
@@ -38,6 +61,14 @@ struct BloomPushConstants
 	float SampleWeights[8];
 };
 
+struct UpscalePushConstants
+{
+	vec2 InputSize;
+	vec2 OutputSize;
+	float Sharpness;
+	float Padding1, Padding2, Padding3;
+};
+
 class ShaderManager
 {
 public:
@@ -47,6 +78,7 @@ public:
 	struct SceneShaders
 	{
 		std::unique_ptr<VulkanShader> VertexShader;
+		std::unique_ptr<VulkanShader> TileVertexShader;
 		std::unique_ptr<VulkanShader> FragmentShader;
 		std::unique_ptr<VulkanShader> FragmentShaderAlphaTest;
 	} Scene;
@@ -54,17 +86,19 @@ public:
 	struct
 	{
 		std::unique_ptr<VulkanShader> VertexShader;
-		std::unique_ptr<VulkanShader> FragmentPresentShader[16];
+		std::unique_ptr<VulkanShader> FragmentPresentShader;
+		std::unique_ptr<VulkanShader> PresentLut;
 	} Postprocess;
 
 	struct
 	{
 		std::unique_ptr<VulkanShader> Extract;
+		std::unique_ptr<VulkanShader> Blur;
 		std::unique_ptr<VulkanShader> Combine;
-		std::unique_ptr<VulkanShader> BlurVertical;
-		std::unique_ptr<VulkanShader> BlurHorizontal;
 	} Bloom;
 
+	std::unique_ptr<VulkanShader> Upscale;
+
 	static std::string LoadShaderCode(const std::string& filename, const std::string& defines = {});
 
 private:
@@ -8,6 +8,7 @@ TextureManager::TextureManager(UVulkanRenderDevice* renderer) : renderer(rendere
 {
 	CreateNullTexture();
 	CreateDitherTexture();
+	CreatePresentLut();
 }
 
 TextureManager::~TextureManager()
@@ -39,7 +40,7 @@ CachedTexture* TextureManager::GetTexture(FTextureInfo* info, bool masked)
 	if (!tex)
 	{
 		tex.reset(new CachedTexture());
-		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		UploadTexture(tex.get(), info, masked);
 	}
 #if defined(OLDUNREAL469SDK)
 	else if (info->bRealtimeChanged && (!info->Texture || info->Texture->RealtimeChangeCount != tex->RealtimeChangeCount))
@@ -47,18 +48,82 @@ CachedTexture* TextureManager::GetTexture(FTextureInfo* info, bool masked)
 		if (info->Texture)
 			info->Texture->RealtimeChangeCount = tex->RealtimeChangeCount;
 		info->bRealtimeChanged = 0;
-		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		UploadTexture(tex.get(), info, masked);
 	}
 #else
 	else if (info->bRealtimeChanged)
 	{
 		info->bRealtimeChanged = 0;
-		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		UploadTexture(tex.get(), info, masked);
 	}
 #endif
+	else if (tex->ValidatedFlush != FlushCount)
+	{
+		RevalidateTexture(tex.get(), info, masked);
+	}
+	tex->LastUsedFlush = FlushCount;
 	return tex.get();
 }
 
+void TextureManager::UploadTexture(CachedTexture* tex, FTextureInfo* info, bool masked)
+{
+	tex->Source = info->Texture;
+	tex->USize = info->USize;
+	tex->VSize = info->VSize;
+	tex->NumMips = info->NumMips;
+	tex->Format = info->Format;
+	tex->MipData = GetMipData(info);
+	tex->PaletteHash = GetPaletteHash(info);
+	tex->ValidatedFlush = FlushCount;
+	renderer->Uploads->UploadTexture(tex, *info, masked);
+}
+
+void TextureManager::RevalidateTexture(CachedTexture* tex, FTextureInfo* info, bool masked)
+{
+	// The cache id may now belong to a different texture. Start over with a new image.
+	if (tex->Source != info->Texture || tex->USize != info->USize || tex->VSize != info->VSize || tex->NumMips != info->NumMips || tex->Format != info->Format)
+	{
+		auto deletelist = renderer->Commands->FrameDeleteList.get();
+		if (tex->imageView)
+			deletelist->imageViews.push_back(std::move(tex->imageView));
+		if (tex->image)
+			deletelist->images.push_back(std::move(tex->image));
+		tex->imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		UploadTexture(tex, info, masked);
+	}
+	else if (!info->Texture || tex->MipData != GetMipData(info) || tex->PaletteHash != GetPaletteHash(info))
+	{
+		// Same size, new contents. Lightmaps and fogmaps have no source texture to compare, so they are always converted again.
+		// The image can be reused as is.
+		UploadTexture(tex, info, masked);
+	}
+	else
+	{
+		tex->ValidatedFlush = FlushCount;
+	}
+}
+
+void* TextureManager::GetMipData(const FTextureInfo* info)
+{
+	return (info->NumMips > 0 && info->Mips[0]) ? info->Mips[0]->DataPtr : nullptr;
+}
+
+uint32_t TextureManager::GetPaletteHash(const FTextureInfo* info)
+{
+	if (info->Format != TEXF_P8 || !info->Palette)
+		return 0;
+
+	// FNV-1a
+	const BYTE* data = (const BYTE*)info->Palette;
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < 256 * (int)sizeof(FColor); i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 void TextureManager::ClearCache()
 {
 	for (auto& cache : TextureCache)
@@ -67,6 +132,25 @@ void TextureManager::ClearCache()
 	}
 }
 
+void TextureManager::InvalidateCache()
+{
+	// Textures are kept and rechecked at their next use. Those not used since the previous flush are released,
+	// as are lightmaps and fogmaps since nothing tells whether a reused cache id still holds the same surface data.
+	for (auto& cache : TextureCache)
+	{
+		for (auto it = cache.begin(); it != cache.end();)
+		{
+			CachedTexture* tex = it->second.get();
+			if ((tex->LastUsedFlush != FlushCount || !tex->Source) && !tex->inPendingUploads)
+				it = cache.erase(it);
+			else
+				++it;
+		}
+	}
+	FlushCount++;
+	ClearAllBindlessIndexes();
+}
+
 void TextureManager::ClearAllBindlessIndexes()
 {
 	for (auto& cache : TextureCache)
@@ -122,6 +206,27 @@ void TextureManager::CreateNullTexture()
 	renderer->Commands->FrameDeleteList->buffers.push_back(std::move(stagingbuffer));
 }
 
+void TextureManager::CreatePresentLut()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		PresentLut[i] = ImageBuilder()
+			.Type(VK_IMAGE_TYPE_3D)
+			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
+			.Size(PresentLutSize, PresentLutSize)
+			.Depth(PresentLutSize)
+			.Usage(VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+			.DebugName("PresentLut")
+			.Create(renderer->Device.get());
+
+		PresentLutView[i] = ImageViewBuilder()
+			.Type(VK_IMAGE_VIEW_TYPE_3D)
+			.Image(PresentLut[i].get(), VK_FORMAT_R16G16B16A16_SFLOAT)
+			.DebugName("PresentLutView")
+			.Create(renderer->Device.get());
+	}
+}
+
 void TextureManager::CreateDitherTexture()
 {
 	static const float ditherdata[64] =
@@ -16,6 +16,7 @@ public:
 	CachedTexture* GetTexture(FTextureInfo* info, bool masked);
 
 	void ClearCache();
+	void InvalidateCache();
 	void ClearAllBindlessIndexes();
 
 	std::unique_ptr<VulkanImage> NullTexture;
@@ -24,6 +25,12 @@ public:
 	std::unique_ptr<VulkanImage> DitherImage;
 	std::unique_ptr<VulkanImageView> DitherImageView;
 
+	// Color transform applied by the present pass. Baked by UVulkanRenderDevice::UpdatePresentLut.
+	// Perspective and ortho viewports use different color settings, so each has its own LUT and the editor can switch between them without rebaking.
+	std::unique_ptr<VulkanImage> PresentLut[2];
+	std::unique_ptr<VulkanImageView> PresentLutView[2];
+	static const int PresentLutSize = 64;
+
 	std::unique_ptr<SceneTextures> Scene;
 
 	int GetTexturesInCache() { return TextureCache[0].size() + TextureCache[1].size(); }
@@ -31,7 +38,13 @@ public:
 private:
 	void CreateNullTexture();
 	void CreateDitherTexture();
+	void CreatePresentLut();
+	void UploadTexture(CachedTexture* tex, FTextureInfo* info, bool masked);
+	void RevalidateTexture(CachedTexture* tex, FTextureInfo* info, bool masked);
+	static void* GetMipData(const FTextureInfo* info);
+	static uint32_t GetPaletteHash(const FTextureInfo* info);
 
 	UVulkanRenderDevice* renderer = nullptr;
 	std::unordered_map<QWORD, std::unique_ptr<CachedTexture>> TextureCache[2];
+	int FlushCount = 0;
 };
@@ -40,6 +40,7 @@ void UVulkanRenderDevice::StaticConstructor()
 #if defined(OLDUNREAL469SDK)
 	UseLightmapAtlas = 0; // Note: do not turn this on. It does not work and generates broken fogmaps.
 	SupportsUpdateTextureRect = 1;
+	SupportsDrawTileList = 1;
 	MaxTextureSize = 4096;
 	NeedsMaskedFonts = 0;
 	DescFlags |= RDDESCF_Certified;
@@ -72,6 +73,10 @@ void UVulkanRenderDevice::StaticConstructor()
 	VkDeviceIndex = 0;
 	VkDebug = 0;
 	VkExclusiveFullscreen = 0;
+	VkHeadless = 0;
+	VkRenderScale = 1.0f;
+	VkUpscaleSharpness = 0.5f;
+	VkVertexStreaming = 0;
 
 #if defined(OLDUNREAL469SDK)
 	new(GetClass(), TEXT("UseLightmapAtlas"), RF_Public) UBoolProperty(CPP_PROPERTY(UseLightmapAtlas), TEXT("Display"), CPF_Config);
@@ -117,6 +122,15 @@ void UVulkanRenderDevice::StaticConstructor()
 	new(GetClass(), TEXT("VkDeviceIndex"), RF_Public) UIntProperty(CPP_PROPERTY(VkDeviceIndex), TEXT("Display"), CPF_Config);
 	new(GetClass(), TEXT("VkDebug"), RF_Public) UBoolProperty(CPP_PROPERTY(VkDebug), TEXT("Display"), CPF_Config);
 	new(GetClass(), TEXT("VkExclusiveFullscreen"), RF_Public) UBoolProperty(CPP_PROPERTY(VkExclusiveFullscreen), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkHeadless"), RF_Public) UBoolProperty(CPP_PROPERTY(VkHeadless), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkRenderScale"), RF_Public) UFloatProperty(CPP_PROPERTY(VkRenderScale), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkUpscaleSharpness"), RF_Public) UFloatProperty(CPP_PROPERTY(VkUpscaleSharpness), TEXT("Display"), CPF_Config);
+
+	UEnum* VertexStreamingModes = new(GetClass(), TEXT("VertexStreamingModes"))UEnum(nullptr);
+	new(VertexStreamingModes->Names)FName(TEXT("Auto"));
+	new(VertexStreamingModes->Names)FName(TEXT("Direct"));
+	new(VertexStreamingModes->Names)FName(TEXT("Staging"));
+	new(GetClass(), TEXT("VkVertexStreaming"), RF_Public) UByteProperty(CPP_PROPERTY(VkVertexStreaming), TEXT("Display"), CPF_Config, VertexStreamingModes);
 
 	unguard;
 }
@@ -142,16 +156,19 @@ UBOOL UVulkanRenderDevice::Init(UViewport* InViewport, INT NewX, INT NewY, INT N
 
 #ifdef WIN32
 		auto instance = VulkanInstanceBuilder()
-			.RequireSurfaceExtensions()
+			.RequireSurfaceExtensions(!VkHeadless)
 			.DebugLayer(VkDebug)
 			.Create();
 
 		auto deviceBuilder = VulkanDeviceBuilder();
 
-		auto surface = VulkanSurfaceBuilder()
-			.Win32Window((HWND)Viewport->GetWindow())
-			.Create(instance);
-		deviceBuilder.Surface(surface);
+		if (!VkHeadless)
+		{
+			auto surface = VulkanSurfaceBuilder()
+				.Win32Window((HWND)Viewport->GetWindow())
+				.Create(instance);
+			deviceBuilder.Surface(surface);
+		}
 #else
 		// SDLDrv doesn't create the window until you call ResizeViewport
 		if (!Viewport->ResizeViewport(Fullscreen ? (BLIT_Fullscreen | BLIT_Vulkan) : (BLIT_HardwarePaint | BLIT_Vulkan), NewX, NewY, NewColorBytes))
@@ -163,31 +180,37 @@ UBOOL UVulkanRenderDevice::Init(UViewport* InViewport, INT NewX, INT NewY, INT N
 		auto window = (SDL_Window*)Viewport->GetWindow();
 
 		auto instanceBuilder = VulkanInstanceBuilder();
-		instanceBuilder.RequireExtension(VK_KHR_SURFACE_EXTENSION_NAME);
-		instanceBuilder.OptionalExtension(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME); // For HDR support
 		instanceBuilder.DebugLayer(VkDebug);
-
-		unsigned int extCount = 0;
-		SDL_Vulkan_GetInstanceExtensions(window, &extCount, nullptr);
-		std::vector<const char*> extNames(extCount);
-		SDL_Vulkan_GetInstanceExtensions(window, &extCount, extNames.data());
-		for (const char* name : extNames)
+		if (!VkHeadless)
 		{
-			instanceBuilder.RequireExtension(name);
+			instanceBuilder.RequireExtension(VK_KHR_SURFACE_EXTENSION_NAME);
+			instanceBuilder.OptionalExtension(VK_EXT_SWAPCHAIN_COLOR_SPACE_EXTENSION_NAME); // For HDR support
+
+			unsigned int extCount = 0;
+			SDL_Vulkan_GetInstanceExtensions(window, &extCount, nullptr);
+			std::vector<const char*> extNames(extCount);
+			SDL_Vulkan_GetInstanceExtensions(window, &extCount, extNames.data());
+			for (const char* name : extNames)
+			{
+				instanceBuilder.RequireExtension(name);
+			}
 		}
 
 		auto instance = instanceBuilder.Create();
 		auto deviceBuilder = VulkanDeviceBuilder();
 
-		VkSurfaceKHR surfaceHandle = {};
-		if (SDL_Vulkan_CreateSurface(window, instance->Instance, &surfaceHandle) == SDL_FALSE)
+		if (!VkHeadless)
 		{
-			debugf(TEXT("Couldn't create Vulkan surface: %ls"), appFromAnsi(SDL_GetError()));
-			return 0;
-		}
+			VkSurfaceKHR surfaceHandle = {};
+			if (SDL_Vulkan_CreateSurface(window, instance->Instance, &surfaceHandle) == SDL_FALSE)
+			{
+				debugf(TEXT("Couldn't create Vulkan surface: %ls"), appFromAnsi(SDL_GetError()));
+				return 0;
+			}
 
-		auto surface = std::make_shared<VulkanSurface>(instance, surfaceHandle);
-		deviceBuilder.Surface(surface);
+			auto surface = std::make_shared<VulkanSurface>(instance, surfaceHandle);
+			deviceBuilder.Surface(surface);
+		}
 #endif
 
 		deviceBuilder.RequireExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
@@ -363,6 +386,7 @@ void UVulkanRenderDevice::Exit()
 
 	if (Device) vkDeviceWaitIdle(Device->device);
 
+	Recorder.reset();
 	Framebuffers.reset();
 	RenderPasses.reset();
 	DescriptorSets.reset();
@@ -382,11 +406,24 @@ void UVulkanRenderDevice::SubmitAndWait(bool present, int presentWidth, int pres
 {
 	DescriptorSets->UpdateBindlessSet();
 
+	if (Buffers->StagingVertices)
+		Buffers->CopyStagedVertices(Commands->GetTransferCommands(), SceneVertexPos, SceneIndexPos, TileInstancePos);
+
 	Commands->SubmitCommands(present, presentWidth, presentHeight, presentFullscreen);
 
 	Batch.SceneIndexStart = 0;
+	Batch.TileInstanceStart = 0;
 	SceneVertexPos = 0;
 	SceneIndexPos = 0;
+	TileInstancePos = 0;
+}
+
+void UVulkanRenderDevice::BindSceneBuffers(VulkanCommandBuffer* cmdbuffer)
+{
+	VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffer->buffer, Buffers->TileInstanceBuffer->buffer };
+	VkDeviceSize offsets[] = { 0, 0 };
+	cmdbuffer->bindVertexBuffers(0, 2, vertexBuffers, offsets);
+	cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
 }
 
 #if defined(UNREALGOLD)
@@ -395,25 +432,25 @@ void UVulkanRenderDevice::Flush()
 {
 	guard(UVulkanRenderDevice::Flush);
 
+	if (Recorder)
+		Recorder->Flush();
+
 	if (IsLocked)
 	{
-		DrawBatch(Commands->GetDrawCommands());
+		DrawBatch();
 		RenderPasses->EndScene(Commands->GetDrawCommands());
 		SubmitAndWait(false, 0, 0, false);
 
-		ClearTextureCache();
+		InvalidateTextureCache();
 
 		auto cmdbuffer = Commands->GetDrawCommands();
-		RenderPasses->BeginScene(cmdbuffer, 0.0f, 0.0f, 0.0f, 1.0f);
+		RenderPasses->ContinueScene(cmdbuffer);
 
-		VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffer->buffer };
-		VkDeviceSize offsets[] = { 0 };
-		cmdbuffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
-		cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+		BindSceneBuffers(cmdbuffer);
 	}
 	else
 	{
-		ClearTextureCache();
+		InvalidateTextureCache();
 	}
 
 	if (UsePrecache && !GIsEditor)
@@ -428,46 +465,25 @@ void UVulkanRenderDevice::Flush(UBOOL AllowPrecache)
 {
 	guard(UVulkanRenderDevice::Flush);
 
+	if (Recorder)
+		Recorder->Flush();
+
 	if (IsLocked)
 	{
-		DrawBatch(Commands->GetDrawCommands());
-		Commands->GetDrawCommands()->endRenderPass();
+		DrawBatch();
+		RenderPasses->EndScene(Commands->GetDrawCommands());
 		SubmitAndWait(false, 0, 0, false);
 
-		ClearTextureCache();
+		InvalidateTextureCache();
 
 		auto cmdbuffer = Commands->GetDrawCommands();
+		RenderPasses->ContinueScene(cmdbuffer);
 
-		VkAccessFlags srcColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-		VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-		VkAccessFlags srcDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkAccessFlags dstDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-
-		PipelineBarrier()
-			.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT)
-			.Execute(cmdbuffer, srcStages, dstStages);
-
-		RenderPassBegin()
-			.RenderPass(RenderPasses->Scene.RenderPassContinue.get())
-			.Framebuffer(Framebuffers->SceneFramebuffer.get())
-			.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f)
-			.AddClearDepthStencil(1.0f, 0)
-			.Execute(cmdbuffer);
-
-		VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffer->buffer };
-		VkDeviceSize offsets[] = { 0 };
-		cmdbuffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
-		cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+		BindSceneBuffers(cmdbuffer);
 	}
 	else
 	{
-		ClearTextureCache();
+		InvalidateTextureCache();
 	}
 
 	if (AllowPrecache && UsePrecache && !GIsEditor)
@@ -568,6 +584,82 @@ UBOOL UVulkanRenderDevice::Exec(const TCHAR* Cmd, FOutputDevice& Ar)
 		Ar.Log(*Str.LeftChop(1));
 		return 1;
 	}
+	else if (ParseCommand(&Cmd, TEXT("VkRecord")))
+	{
+		FString Filename;
+		if (!ParseToken(Cmd, Filename, 0) || Filename == TEXT("Stop"))
+		{
+			if (Recorder)
+			{
+				Ar.Logf(TEXT("Recorded %d frames"), Recorder->FrameCount);
+				Recorder.reset();
+			}
+			return 1;
+		}
+
+		FArchive* file = GFileManager->CreateFileWriter(*Filename);
+		if (!file)
+		{
+			Ar.Logf(TEXT("Could not create %s"), *Filename);
+			return 1;
+		}
+		Recorder.reset(new CallRecorder(file));
+		Ar.Logf(TEXT("Recording render calls to %s"), *Filename);
+		return 1;
+	}
+	else if (ParseCommand(&Cmd, TEXT("VkFlushTextures")))
+	{
+		if (!IsLocked)
+			ClearTextureCache();
+		return 1;
+	}
+	else if (ParseCommand(&Cmd, TEXT("VkPipelineStats")))
+	{
+		Ar.Logf(TEXT("Pipelines: Startup %.1f ms, On demand: %d (%.1f ms, worst %.1f ms), Background: %d (%.1f ms), Pending: %d"),
+			RenderPasses->PipelineStats.StartupMs, RenderPasses->PipelineStats.OnDemandCount, RenderPasses->PipelineStats.OnDemandMs, RenderPasses->PipelineStats.WorstHitchMs,
+			RenderPasses->GetBackgroundPipelineCount(), RenderPasses->GetBackgroundPipelineMs(), RenderPasses->GetPendingPipelineCount());
+		return 1;
+	}
+	else if (ParseCommand(&Cmd, TEXT("VkBenchVertices")))
+	{
+		RunVertexWriteBenchmark(Device.get(), Ar);
+		return 1;
+	}
+	else if (ParseCommand(&Cmd, TEXT("VkReplay")))
+	{
+		FString Filename;
+		if (!ParseToken(Cmd, Filename, 0) || Recorder || IsLocked)
+			return 1;
+
+		INT Loops = 1;
+		Parse(Cmd, TEXT("LOOPS="), Loops);
+		UBOOL NoHash = ParseParam(Cmd, TEXT("NOHASH"));
+		UBOOL CompareStreaming = ParseParam(Cmd, TEXT("COMPARESTREAMING"));
+
+		CallReplayer replayer(this);
+		if (!replayer.Load(*Filename))
+		{
+			Ar.Logf(TEXT("Could not load render call recording %s"), *Filename);
+			return 1;
+		}
+
+		if (CompareStreaming)
+		{
+			// Replay with direct and then staged vertices, whatever VkVertexStreaming Auto would pick
+			BYTE SavedStreaming = VkVertexStreaming;
+			for (BYTE mode = 1; mode <= 2; mode++)
+			{
+				RecreateSceneBuffers(mode);
+				replayer.Run(Max(Loops, 1), !NoHash, Ar);
+			}
+			RecreateSceneBuffers(SavedStreaming);
+		}
+		else
+		{
+			replayer.Run(Max(Loops, 1), !NoHash, Ar);
+		}
+		return 1;
+	}
 #if WIN32 // To do: what does the Unix build use for the TEXT() template?
 	else if (ParseCommand(&Cmd, TEXT("GetVkDevices")))
 	{
@@ -599,6 +691,9 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 {
 	guard(UVulkanRenderDevice::Lock);
 
+	if (Recorder)
+		Recorder->Lock(InFlashScale, InFlashFog, ScreenClear, RenderLockFlags);
+
 	HitData = InHitData;
 	HitSize = InHitSize;
 
@@ -611,11 +706,14 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 	try
 	{
 		// If frame textures no longer match the window or user settings, recreate them along with the swap chain
-		if (!Textures->Scene || Textures->Scene->Width != Viewport->SizeX || Textures->Scene->Height != Viewport->SizeY ||Textures->Scene->Multisample != GetSettingsMultisample())
+		int sceneWidth = GetSettingsSceneSize(Viewport->SizeX);
+		int sceneHeight = GetSettingsSceneSize(Viewport->SizeY);
+		if (!Textures->Scene || Textures->Scene->OutputWidth != Viewport->SizeX || Textures->Scene->OutputHeight != Viewport->SizeY || Textures->Scene->Width != sceneWidth || Textures->Scene->Height != sceneHeight || Textures->Scene->Multisample != GetSettingsMultisample())
 		{
+			RenderPasses->CancelPipelineCompiles();
 			Framebuffers->DestroySceneFramebuffer();
 			Textures->Scene.reset();
-			Textures->Scene.reset(new SceneTextures(this, Viewport->SizeX, Viewport->SizeY, GetSettingsMultisample()));
+			Textures->Scene.reset(new SceneTextures(this, sceneWidth, sceneHeight, Viewport->SizeX, Viewport->SizeY, GetSettingsMultisample()));
 			RenderPasses->CreateRenderPass();
 			RenderPasses->CreatePipelines();
 			Framebuffers->CreateSceneFramebuffer();
@@ -623,34 +721,9 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 		}
 
 		auto cmdbuffer = Commands->GetDrawCommands();
+		RenderPasses->BeginScene(cmdbuffer, HitData != nullptr, ScreenClear.X, ScreenClear.Y, ScreenClear.Z, ScreenClear.W);
 
-		// Special thanks to Khronos and AMD for making this absolute hell to use.
-		VkAccessFlags srcColorAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-		VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-		VkAccessFlags srcDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkAccessFlags dstDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-
-		PipelineBarrier()
-			.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT)
-			.Execute(cmdbuffer, srcStages, dstStages);
-
-		RenderPassBegin()
-			.RenderPass(RenderPasses->Scene.RenderPass.get())
-			.Framebuffer(Framebuffers->SceneFramebuffer.get())
-			.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-			.AddClearColor(ScreenClear.X, ScreenClear.Y, ScreenClear.Z, ScreenClear.W)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f)
-			.AddClearDepthStencil(1.0f, 0)
-			.Execute(cmdbuffer);
-
-		VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffer->buffer };
-		VkDeviceSize offsets[] = { 0 };
-		cmdbuffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
-		cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+		BindSceneBuffers(cmdbuffer);
 
 		IsLocked = true;
 	}
@@ -666,37 +739,24 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 	unguard;
 }
 
+void UVulkanRenderDevice::RecreateSceneBuffers(BYTE streamingMode)
+{
+	vkDeviceWaitIdle(Device->device);
+	VkVertexStreaming = streamingMode;
+	Buffers.reset();
+	Buffers.reset(new BufferManager(this));
+}
+
 void UVulkanRenderDevice::FlushDrawBatchAndWait()
 {
-	DrawBatch(Commands->GetDrawCommands());
-	Commands->GetDrawCommands()->endRenderPass();
+	DrawBatch();
+	RenderPasses->EndScene(Commands->GetDrawCommands());
 	SubmitAndWait(false, 0, 0, false);
 
 	auto drawcommands = Commands->GetDrawCommands();
+	RenderPasses->ContinueScene(drawcommands);
 
-	VkAccessFlags srcColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-	VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-	VkAccessFlags srcDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-	VkAccessFlags dstDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-
-	PipelineBarrier()
-		.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-		.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-		.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT)
-		.Execute(drawcommands, srcStages, dstStages);
-
-	RenderPassBegin()
-		.RenderPass(RenderPasses->Scene.RenderPassContinue.get())
-		.Framebuffer(Framebuffers->SceneFramebuffer.get())
-		.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-		.Execute(drawcommands);
-
-	VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffer->buffer };
-	VkDeviceSize offsets[] = { 0 };
-	drawcommands->bindVertexBuffers(0, 1, vertexBuffers, offsets);
-	drawcommands->bindIndexBuffer(Buffers->SceneIndexBuffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+	BindSceneBuffers(drawcommands);
 	drawcommands->setViewport(0, 1, &viewportdesc);
 }
 
@@ -705,13 +765,18 @@ void UVulkanRenderDevice::DrawStats(FSceneNode* Frame)
 	Super::DrawStats(Frame);
 
 #if defined(OLDUNREAL469SDK)
-	GRender->ShowStat(CurrentFrame, TEXT("Vulkan: Draw calls: %d, Complex surfaces: %d, Gouraud polygons: %d, Tiles: %d; Uploads: %d, Rect Uploads: %d\r\n"), Stats.DrawCalls, Stats.ComplexSurfaces, Stats.GouraudPolygons, Stats.Tiles, Stats.Uploads, Stats.RectUploads);
+	GRender->ShowStat(CurrentFrame, TEXT("Vulkan: Draw calls: %d, Complex surfaces: %d, Gouraud polygons: %d, Tiles: %d, Lines: %d, Points: %d; Uploads: %d, Rect Uploads: %d\r\n"), Stats.DrawCalls, Stats.ComplexSurfaces, Stats.GouraudPolygons, Stats.Tiles, Stats.Lines, Stats.Points, Stats.Uploads, Stats.RectUploads);
+	GRender->ShowStat(CurrentFrame, TEXT("Vulkan: Pipelines: Startup %.1f ms, On demand: %d (%.1f ms, worst %.1f ms), Background: %d (%.1f ms), Pending: %d\r\n"),
+		RenderPasses->PipelineStats.StartupMs, RenderPasses->PipelineStats.OnDemandCount, RenderPasses->PipelineStats.OnDemandMs, RenderPasses->PipelineStats.WorstHitchMs,
+		RenderPasses->GetBackgroundPipelineCount(), RenderPasses->GetBackgroundPipelineMs(), RenderPasses->GetPendingPipelineCount());
 #endif
 
 	Stats.DrawCalls = 0;
 	Stats.ComplexSurfaces = 0;
 	Stats.GouraudPolygons = 0;
 	Stats.Tiles = 0;
+	Stats.Lines = 0;
+	Stats.Points = 0;
 	Stats.Uploads = 0;
 	Stats.RectUploads = 0;
 }
@@ -720,10 +785,13 @@ void UVulkanRenderDevice::Unlock(UBOOL Blit)
 {
 	guard(UVulkanRenderDevice::Unlock);
 
+	if (Recorder)
+		Recorder->Unlock(Blit);
+
 	try
 	{
-		DrawBatch(Commands->GetDrawCommands());
-		Commands->GetDrawCommands()->endRenderPass();
+		DrawBatch();
+		RenderPasses->EndScene(Commands->GetDrawCommands());
 
 		BlitSceneToPostprocess();
 		if (Bloom)
@@ -731,17 +799,25 @@ void UVulkanRenderDevice::Unlock(UBOOL Blit)
 			RunBloomPass();
 		}
 
+		if (Textures->Scene->UpscaleImage)
+		{
+			RunUpscalePass();
+		}
+
+		int windowWidth = Viewport->SizeX;
+		int windowHeight = Viewport->SizeY;
+		if (!VkHeadless)
+		{
 #ifdef WIN32
-		RECT box = {};
-		GetClientRect((HWND)Viewport->GetWindow(), &box);
-		int windowWidth = box.right;
-		int windowHeight = box.bottom;
+			RECT box = {};
+			GetClientRect((HWND)Viewport->GetWindow(), &box);
+			windowWidth = box.right;
+			windowHeight = box.bottom;
 #else
-		auto window = (SDL_Window*)Viewport->GetWindow();
-		int windowWidth = 0;
-		int windowHeight = 0;
-		SDL_GL_GetDrawableSize(window, &windowWidth, &windowHeight);
+			auto window = (SDL_Window*)Viewport->GetWindow();
+			SDL_GL_GetDrawableSize(window, &windowWidth, &windowHeight);
 #endif
+		}
 
 		SubmitAndWait(Blit ? true : false, windowWidth, windowHeight, Viewport->IsFullscreen());
 
@@ -757,8 +833,8 @@ void UVulkanRenderDevice::Unlock(UBOOL Blit)
 		if (HitData)
 		{
 			// Look for the last hit
-			int width = Viewport->HitXL;
-			int height = Viewport->HitYL;
+			int hitX, hitY, width, height;
+			GetSceneHitRect(hitX, hitY, width, height);
 			int hit = 0;
 			const int32_t* data = (const int32_t*)Textures->Scene->StagingHitBuffer->Map(0, width * height * sizeof(int32_t));
 			if (data)
@@ -829,11 +905,18 @@ void UVulkanRenderDevice::UpdateTextureRect(FTextureInfo& Info, INT U, INT V, IN
 
 #endif
 
-void UVulkanRenderDevice::DrawBatch(VulkanCommandBuffer* cmdbuffer)
+void UVulkanRenderDevice::DrawBatch()
 {
+	// Flushing lines may submit and start a new command buffer when the scene buffers are full
+	FlushLineBatch();
+	auto cmdbuffer = Commands->GetDrawCommands();
+
 	size_t icount = SceneIndexPos - Batch.SceneIndexStart;
-	if (icount > 0)
+	size_t tcount = TileInstancePos - Batch.TileInstanceStart;
+	if (icount > 0 || tcount > 0)
 	{
+		StreamFence();
+
 		if (viewportdesc.minDepth != Batch.Pipeline->MinDepth || viewportdesc.maxDepth != Batch.Pipeline->MaxDepth)
 		{
 			viewportdesc.minDepth = Batch.Pipeline->MinDepth;
@@ -845,8 +928,13 @@ void UVulkanRenderDevice::DrawBatch(VulkanCommandBuffer* cmdbuffer)
 		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, Batch.Pipeline->Pipeline.get());
 		cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, DescriptorSets->GetBindlessSet());
 		cmdbuffer->pushConstants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ScenePushConstants), &pushconstants);
-		cmdbuffer->drawIndexed(icount, 1, Batch.SceneIndexStart, 0, 0);
+		// Tile pipelines never share a batch with indexed geometry since SetPipeline flushes between them
+		if (tcount > 0)
+			cmdbuffer->draw(4, tcount, 0, Batch.TileInstanceStart);
+		else
+			cmdbuffer->drawIndexed(icount, 1, Batch.SceneIndexStart, 0, 0);
 		Batch.SceneIndexStart = SceneIndexPos;
+		Batch.TileInstanceStart = TileInstancePos;
 		Stats.DrawCalls++;
 	}
 }
@@ -855,6 +943,9 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 {
 	guardSlow(UVulkanRenderDevice::DrawComplexSurface);
 
+	if (Recorder)
+		Recorder->DrawComplexSurface(Frame, Surface, Facet);
+
 	DWORD PolyFlags = ApplyPrecedenceRules(Surface.PolyFlags);
 
 	CachedTexture* tex = Textures->GetTexture(Surface.Texture, !!(PolyFlags & PF_Masked));
@@ -906,7 +997,7 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 		DetailVMult = GetVMult(*Surface.FogMap);
 	}
 
-	SetPipeline(RenderPasses->GetPipeline(PolyFlags));
+	SetPipeline(RenderPasses->GetSurfacePipeline(PolyFlags, flags));
 
 	ivec4 textureBinds = GetTextureIndexes(PolyFlags, tex, lightmap, macrotex, detailtex);
 	vec4 color(1.0f);
@@ -1043,6 +1134,9 @@ void UVulkanRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 {
 	guardSlow(UVulkanRenderDevice::DrawGouraudPolygon);
 
+	if (Recorder)
+		Recorder->DrawGouraudPolygon(Frame, Info, Pts, NumPts, PolyFlags);
+
 	if (NumPts < 3) return; // This can apparently happen!!
 
 	PolyFlags = ApplyPrecedenceRules(PolyFlags);
@@ -1148,6 +1242,9 @@ void UVulkanRenderDevice::DrawGouraudTriangles(const FSceneNode* Frame, const FT
 {
 	guardSlow(UVulkanRenderDevice::DrawGouraudTriangles);
 
+	if (Recorder)
+		Recorder->DrawGouraudTriangles(Frame, Info, Pts, NumPts, PolyFlags, DataFlags);
+
 	if (NumPts < 3) return; // This can apparently happen!!
 
 	PolyFlags = ApplyPrecedenceRules(PolyFlags);
@@ -1285,6 +1382,9 @@ void UVulkanRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 {
 	guardSlow(UVulkanRenderDevice::DrawTile);
 
+	if (Recorder)
+		Recorder->DrawTile(Frame, Info, X, Y, XL, YL, U, V, UL, VL, Z, Color, Fog, PolyFlags);
+
 	// stijn: fix for invisible actor icons in ortho viewports
 	if (GIsEditor && Frame->Viewport->Actor && (Frame->Viewport->IsOrtho() || Abs(Z) <= SMALL_NUMBER))
 	{
@@ -1302,7 +1402,7 @@ void UVulkanRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 	float v1 = (V + VL) * VMult;
 	bool clamp = (u0 >= 0.0f && u1 <= 1.00001f && v0 >= 0.0f && v1 <= 1.00001f);
 
-	SetPipeline(RenderPasses->GetPipeline(PolyFlags));
+	SetPipeline(RenderPasses->GetTilePipeline(PolyFlags));
 	ivec4 textureBinds = GetTextureIndexes(PolyFlags, tex, clamp);
 
 	float r, g, b, a;
@@ -1330,48 +1430,204 @@ void UVulkanRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 		YL = YL - Y;
 	}
 
-	auto alloc = ReserveVertices(4, 6);
-	if (alloc.vptr)
+	TileInstance* tile = ReserveTiles(1);
+	if (tile)
 	{
-		SceneVertex* vptr = alloc.vptr;
-		uint32_t* iptr = alloc.iptr;
-		uint32_t vpos = alloc.vpos;
+		tile->Rect = vec4(RFX2 * Z * (X - Frame->FX2), RFY2 * Z * (Y - Frame->FY2), RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y + YL - Frame->FY2));
+		tile->TexRect = vec4(u0, v0, u1, v1);
+		tile->Color = vec4(r, g, b, a);
+		tile->Z = Z;
+		tile->TextureBind = textureBinds.x;
+		UseTiles(1);
+	}
+
+	Stats.Tiles++;
+
+	unguardSlow;
+}
 
-		vptr[0] = { 0, vec3(RFX2 * Z * (X - Frame->FX2),      RFY2 * Z * (Y - Frame->FY2),      Z), vec2(u0, v0), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
-		vptr[1] = { 0, vec3(RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y - Frame->FY2),      Z), vec2(u1, v0), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
-		vptr[2] = { 0, vec3(RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y + YL - Frame->FY2), Z), vec2(u1, v1), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
-		vptr[3] = { 0, vec3(RFX2 * Z * (X - Frame->FX2),      RFY2 * Z * (Y + YL - Frame->FY2), Z), vec2(u0, v1), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
+#if defined(OLDUNREAL469SDK)
+
+void UVulkanRenderDevice::DrawTileList(const FSceneNode* Frame, const FTextureInfo& Info, const FTileRect* Tiles, INT NumTiles, FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags)
+{
+	guardSlow(UVulkanRenderDevice::DrawTileList);
 
-		iptr[0] = vpos;
-		iptr[1] = vpos + 1;
-		iptr[2] = vpos + 2;
-		iptr[3] = vpos;
-		iptr[4] = vpos + 2;
-		iptr[5] = vpos + 3;
+	if (Recorder)
+		Recorder->DrawTileList(Frame, Info, Tiles, NumTiles, Z, Color, Fog, PolyFlags);
 
-		UseVertices(4, 6);
+	// stijn: fix for invisible actor icons in ortho viewports
+	if (GIsEditor && Frame->Viewport->Actor && (Frame->Viewport->IsOrtho() || Abs(Z) <= SMALL_NUMBER))
+	{
+		Z = 1.f;
 	}
 
-	Stats.Tiles++;
+	PolyFlags = ApplyPrecedenceRules(PolyFlags);
+
+	CachedTexture* tex = Textures->GetTexture(const_cast<FTextureInfo*>(&Info), !!(PolyFlags & PF_Masked));
+	float UMult = tex ? GetUMult(Info) : 0.0f;
+	float VMult = tex ? GetVMult(Info) : 0.0f;
+
+	SetPipeline(RenderPasses->GetTilePipeline(PolyFlags));
+
+	// The texture index is part of the instance, so all tiles go into the same draw. Each clamp mode is only looked up once.
+	int textureBinds[2];
+	bool textureBindsValid[2] = { false, false };
+
+	float r, g, b, a;
+	if (PolyFlags & PF_Modulated)
+	{
+		r = 1.0f;
+		g = 1.0f;
+		b = 1.0f;
+	}
+	else
+	{
+		r = Color.X;
+		g = Color.Y;
+		b = Color.Z;
+	}
+	a = 1.0f;
+
+	float rfx2z = RFX2 * Z;
+	float rfy2z = RFY2 * Z;
+	bool snapToPixels = Textures->Scene->Multisample > 1;
+
+	// Larger lists are split so that a single reservation always fits in the tile buffer
+	const INT MaxTilesPerChunk = 4096;
+
+	INT tileIndex = 0;
+	while (tileIndex < NumTiles)
+	{
+		INT count = Min(NumTiles - tileIndex, MaxTilesPerChunk);
+
+		TileInstance* tile = ReserveTiles(count);
+		if (!tile)
+			break;
+
+		for (INT i = 0; i < count; i++)
+		{
+			const FTileRect& Tile = Tiles[tileIndex + i];
+			FLOAT X = Tile.X;
+			FLOAT Y = Tile.Y;
+			FLOAT XL = Tile.XL;
+			FLOAT YL = Tile.YL;
+
+			float u0 = Tile.U * UMult;
+			float v0 = Tile.V * VMult;
+			float u1 = (Tile.U + Tile.UL) * UMult;
+			float v1 = (Tile.V + Tile.VL) * VMult;
+			int clamp = (u0 >= 0.0f && u1 <= 1.00001f && v0 >= 0.0f && v1 <= 1.00001f);
+			if (!textureBindsValid[clamp])
+			{
+				textureBinds[clamp] = GetTextureIndexes(PolyFlags, tex, !!clamp).x;
+				textureBindsValid[clamp] = true;
+			}
+
+			if (snapToPixels)
+			{
+				XL = std::floor(X + XL + 0.5f);
+				YL = std::floor(Y + YL + 0.5f);
+				X = std::floor(X + 0.5f);
+				Y = std::floor(Y + 0.5f);
+				XL = XL - X;
+				YL = YL - Y;
+			}
+
+			tile->Rect = vec4(rfx2z * (X - Frame->FX2), rfy2z * (Y - Frame->FY2), rfx2z * (X + XL - Frame->FX2), rfy2z * (Y + YL - Frame->FY2));
+			tile->TexRect = vec4(u0, v0, u1, v1);
+			tile->Color = vec4(r, g, b, a);
+			tile->Z = Z;
+			tile->TextureBind = textureBinds[clamp];
+			tile++;
+		}
+
+		UseTiles(count);
+		tileIndex += count;
+	}
+
+	Stats.Tiles += NumTiles;
 
 	unguardSlow;
 }
 
+#endif
+
 vec4 UVulkanRenderDevice::ApplyInverseGamma(vec4 color)
 {
 	if (Viewport->IsOrtho())
 		return color;
 	float brightness = Clamp(Viewport->GetOuterUClient()->Brightness * 2.0, 0.05, 2.99);
-	float gammaRed = Max(brightness + GammaOffset + GammaOffsetRed, 0.001f);
-	float gammaGreen = Max(brightness + GammaOffset + GammaOffsetGreen, 0.001f);
-	float gammaBlue = Max(brightness + GammaOffset + GammaOffsetBlue, 0.001f);
-	return vec4(pow(color.r, gammaRed), pow(color.g, gammaGreen), pow(color.b, gammaBlue), color.a);
+	float gamma[3] =
+	{
+		Max(brightness + GammaOffset + GammaOffsetRed, 0.001f),
+		Max(brightness + GammaOffset + GammaOffsetGreen, 0.001f),
+		Max(brightness + GammaOffset + GammaOffsetBlue, 0.001f)
+	};
+
+	// Editor lines mostly come in long runs of the same color. Only call pow when the color or gamma changes.
+	if (InverseGammaCache.Valid && InverseGammaCache.Input.r == color.r && InverseGammaCache.Input.g == color.g && InverseGammaCache.Input.b == color.b && memcmp(InverseGammaCache.Gamma, gamma, sizeof(gamma)) == 0)
+		return vec4(InverseGammaCache.Output.r, InverseGammaCache.Output.g, InverseGammaCache.Output.b, color.a);
+
+	vec4 result(pow(color.r, gamma[0]), pow(color.g, gamma[1]), pow(color.b, gamma[2]), color.a);
+	InverseGammaCache.Input = color;
+	InverseGammaCache.Output = result;
+	memcpy(InverseGammaCache.Gamma, gamma, sizeof(gamma));
+	InverseGammaCache.Valid = true;
+	return result;
+}
+
+void UVulkanRenderDevice::FlushLineBatch()
+{
+	size_t vcount = LineBatch.VertexCount;
+	if (vcount == 0)
+		return;
+
+	// Cleared first as SetPipeline and ReserveVertices may call back in here through DrawBatch
+	LineBatch.VertexCount = 0;
+
+	SetPipeline(LineBatch.Pipeline);
+	GetTextureIndexes(PF_Highlighted, nullptr); // Makes sure the null texture the vertices refer to is bound
+
+	size_t icount = LineBatch.Points ? vcount / 4 * 6 : vcount;
+	auto alloc = ReserveVertices(vcount, icount);
+	if (alloc.vptr)
+	{
+		memcpy(alloc.vptr, LineBatch.Vertices.data(), vcount * sizeof(SceneVertex));
+
+		uint32_t* iptr = alloc.iptr;
+		uint32_t vpos = alloc.vpos;
+		if (LineBatch.Points)
+		{
+			for (size_t i = 0; i < vcount; i += 4)
+			{
+				iptr[0] = vpos;
+				iptr[1] = vpos + 1;
+				iptr[2] = vpos + 2;
+				iptr[3] = vpos;
+				iptr[4] = vpos + 2;
+				iptr[5] = vpos + 3;
+				iptr += 6;
+				vpos += 4;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < vcount; i++)
+				iptr[i] = vpos + (uint32_t)i;
+		}
+
+		UseVertices(vcount, icount);
+	}
 }
 
 void UVulkanRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD LineFlags, FVector P1, FVector P2)
 {
 	guard(UVulkanRenderDevice::Draw3DLine);
 
+	// Ortho viewports are recorded as the 2D lines and points drawn here, as the replay viewport may not be ortho
+	if (Recorder && !Frame->Viewport->IsOrtho())
+		Recorder->Draw3DLine(Frame, Color, LineFlags, P1, P2);
+
 	P1 = P1.TransformPointBy(Frame->Coords);
 	P2 = P2.TransformPointBy(Frame->Coords);
 	if (Frame->Viewport->IsOrtho())
@@ -1399,25 +1655,14 @@ void UVulkanRenderDevice::Draw3DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 #else
 		bool occlude = OccludeLines;
 #endif
-		SetPipeline(RenderPasses->GetLinePipeline(occlude));
-		ivec4 textureBinds = GetTextureIndexes(PF_Highlighted, nullptr);
 		vec4 color = ApplyInverseGamma(vec4(Color.X, Color.Y, Color.Z, 1.0f));
+		ivec4 textureBinds(0);
 
-		auto alloc = ReserveVertices(2, 2);
-		if (alloc.vptr)
-		{
-			SceneVertex* vptr = alloc.vptr;
-			uint32_t* iptr = alloc.iptr;
-			uint32_t vpos = alloc.vpos;
-
-			vptr[0] = { 0, vec3(P1.X, P1.Y, P1.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-			vptr[1] = { 0, vec3(P2.X, P2.Y, P2.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-
-			iptr[0] = vpos;
-			iptr[1] = vpos + 1;
+		SceneVertex* vptr = AddLineVertices(RenderPasses->GetLinePipeline(occlude), false, 2);
+		vptr[0] = { 0, vec3(P1.X, P1.Y, P1.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
+		vptr[1] = { 0, vec3(P2.X, P2.Y, P2.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
 
-			UseVertices(2, 2);
-		}
+		Stats.Lines++;
 	}
 
 	unguard;
@@ -1434,30 +1679,22 @@ void UVulkanRenderDevice::Draw2DLine(FSceneNode* Frame, FPlane Color, DWORD Line
 {
 	guard(UVulkanRenderDevice::Draw2DLine);
 
+	if (Recorder)
+		Recorder->Draw2DLine(Frame, Color, LineFlags, P1, P2);
+
 #if defined(OLDUNREAL469SDK)
 	bool occlude = !!(LineFlags & LINE_DepthCued);
 #else
 	bool occlude = OccludeLines;
 #endif
-	SetPipeline(RenderPasses->GetLinePipeline(occlude));
-	ivec4 textureBinds = GetTextureIndexes(PF_Highlighted, nullptr);
 	vec4 color = ApplyInverseGamma(vec4(Color.X, Color.Y, Color.Z, 1.0f));
+	ivec4 textureBinds(0);
 
-	auto alloc = ReserveVertices(2, 2);
-	if (alloc.vptr)
-	{
-		SceneVertex* vptr = alloc.vptr;
-		uint32_t* iptr = alloc.iptr;
-		uint32_t vpos = alloc.vpos;
-
-		vptr[0] = { 0, vec3(RFX2 * P1.Z * (P1.X - Frame->FX2), RFY2 * P1.Z * (P1.Y - Frame->FY2), P1.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-		vptr[1] = { 0, vec3(RFX2 * P2.Z * (P2.X - Frame->FX2), RFY2 * P2.Z * (P2.Y - Frame->FY2), P2.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
+	SceneVertex* vptr = AddLineVertices(RenderPasses->GetLinePipeline(occlude), false, 2);
+	vptr[0] = { 0, vec3(RFX2 * P1.Z * (P1.X - Frame->FX2), RFY2 * P1.Z * (P1.Y - Frame->FY2), P1.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
+	vptr[1] = { 0, vec3(RFX2 * P2.Z * (P2.X - Frame->FX2), RFY2 * P2.Z * (P2.Y - Frame->FY2), P2.Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
 
-		iptr[0] = vpos;
-		iptr[1] = vpos + 1;
-
-		UseVertices(2, 2);
-	}
+	Stats.Lines++;
 
 	unguard;
 }
@@ -1466,6 +1703,9 @@ void UVulkanRenderDevice::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD Lin
 {
 	guard(UVulkanRenderDevice::Draw2DPoint);
 
+	if (Recorder)
+		Recorder->Draw2DPoint(Frame, Color, LineFlags, X1, Y1, X2, Y2, Z);
+
 	// Hack to fix UED selection problem with selection brush
 	if (GIsEditor) Z = 1.0f;
 
@@ -1474,31 +1714,16 @@ void UVulkanRenderDevice::Draw2DPoint(FSceneNode* Frame, FPlane Color, DWORD Lin
 #else
 	bool occlude = OccludeLines;
 #endif
-	SetPipeline(RenderPasses->GetPointPipeline(occlude));
-	ivec4 textureBinds = GetTextureIndexes(PF_Highlighted, nullptr);
 	vec4 color = ApplyInverseGamma(vec4(Color.X, Color.Y, Color.Z, 1.0f));
+	ivec4 textureBinds(0);
 
-	auto alloc = ReserveVertices(4, 6);
-	if (alloc.vptr)
-	{
-		SceneVertex* vptr = alloc.vptr;
-		uint32_t* iptr = alloc.iptr;
-		uint32_t vpos = alloc.vpos;
-
-		vptr[0] = { 0, vec3(RFX2 * Z * (X1 - Frame->FX2 - 0.5f), RFY2 * Z * (Y1 - Frame->FY2 - 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-		vptr[1] = { 0, vec3(RFX2 * Z * (X2 - Frame->FX2 + 0.5f), RFY2 * Z * (Y1 - Frame->FY2 - 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-		vptr[2] = { 0, vec3(RFX2 * Z * (X2 - Frame->FX2 + 0.5f), RFY2 * Z * (Y2 - Frame->FY2 + 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-		vptr[3] = { 0, vec3(RFX2 * Z * (X1 - Frame->FX2 - 0.5f), RFY2 * Z * (Y2 - Frame->FY2 + 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
-
-		iptr[0] = vpos;
-		iptr[1] = vpos + 1;
-		iptr[2] = vpos + 2;
-		iptr[3] = vpos;
-		iptr[4] = vpos + 2;
-		iptr[5] = vpos + 3;
+	SceneVertex* vptr = AddLineVertices(RenderPasses->GetPointPipeline(occlude), true, 4);
+	vptr[0] = { 0, vec3(RFX2 * Z * (X1 - Frame->FX2 - 0.5f), RFY2 * Z * (Y1 - Frame->FY2 - 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
+	vptr[1] = { 0, vec3(RFX2 * Z * (X2 - Frame->FX2 + 0.5f), RFY2 * Z * (Y1 - Frame->FY2 - 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
+	vptr[2] = { 0, vec3(RFX2 * Z * (X2 - Frame->FX2 + 0.5f), RFY2 * Z * (Y2 - Frame->FY2 + 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
+	vptr[3] = { 0, vec3(RFX2 * Z * (X1 - Frame->FX2 - 0.5f), RFY2 * Z * (Y2 - Frame->FY2 + 0.5f), Z), vec2(0.0f), vec2(0.0f), vec2(0.0f), vec2(0.0f), color, textureBinds };
 
-		UseVertices(4, 6);
-	}
+	Stats.Points++;
 
 	unguard;
 }
@@ -1507,7 +1732,10 @@ void UVulkanRenderDevice::ClearZ(FSceneNode* Frame)
 {
 	guard(UVulkanRenderDevice::ClearZ);
 
-	DrawBatch(Commands->GetDrawCommands());
+	if (Recorder)
+		Recorder->ClearZ(Frame);
+
+	DrawBatch();
 
 	VkClearAttachment attachment = {};
 	VkClearRect rect = {};
@@ -1548,7 +1776,7 @@ void UVulkanRenderDevice::PopHit(INT Count, UBOOL bForce)
 
 void UVulkanRenderDevice::SetHitLocation()
 {
-	DrawBatch(Commands->GetDrawCommands());
+	DrawBatch();
 
 	if (!HitQueryStack.empty())
 	{
@@ -1580,30 +1808,25 @@ void UVulkanRenderDevice::ReadPixels(FColor* Pixels)
 {
 	guard(UVulkanRenderDevice::GetStats);
 
-	auto cmdbuffer = Commands->GetDrawCommands();
+	DrawBatch();
 
-	DrawBatch(cmdbuffer);
+	auto cmdbuffer = Commands->GetDrawCommands();
 
 	if (GammaCorrectScreenshots)
 	{
-		PresentPushConstants pushconstants = GetPresentPushConstants();
-
-		bool ActiveHdr = false; // (Commands->SwapChain->Format().colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT) ? 1 : 0;
-
-		// Select present shader based on what the user is actually using
-		int presentShader = 0;
-		if (ActiveHdr) presentShader |= 1;
-		if (GammaMode == 1) presentShader |= 2;
-		if (pushconstants.Brightness != 0.0f || pushconstants.Contrast != 1.0f || pushconstants.Saturation != 1.0f) presentShader |= (Clamp(GrayFormula, 0, 2) + 1) << 2;
+		// Screenshots are always stored in SDR. Uses the same LUT as the present pass, rebaking it if HDR is active.
+		bool ActiveHdr = false;
+		UpdatePresentLut(ActiveHdr);
+		PresentPushConstants pushconstants = GetPresentPushConstants(ActiveHdr);
 
 		VkViewport viewport = {};
-		viewport.width = Textures->Scene->Width;
-		viewport.height = Textures->Scene->Height;
+		viewport.width = Textures->Scene->OutputWidth;
+		viewport.height = Textures->Scene->OutputHeight;
 		viewport.maxDepth = 1.0f;
 
 		VkRect2D scissor = {};
-		scissor.extent.width = Textures->Scene->Width;
-		scissor.extent.height = Textures->Scene->Height;
+		scissor.extent.width = Textures->Scene->OutputWidth;
+		scissor.extent.height = Textures->Scene->OutputHeight;
 
 		auto cmdbuffer = Commands->GetDrawCommands();
 
@@ -1619,14 +1842,14 @@ void UVulkanRenderDevice::ReadPixels(FColor* Pixels)
 		RenderPassBegin()
 			.RenderPass(RenderPasses->Postprocess.RenderPass.get())
 			.Framebuffer(Framebuffers->PPImageFB[1].get())
-			.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
+			.RenderArea(0, 0, Textures->Scene->OutputWidth, Textures->Scene->OutputHeight)
 			.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
 			.Execute(cmdbuffer);
 
 		cmdbuffer->setViewport(0, 1, &viewport);
 		cmdbuffer->setScissor(0, 1, &scissor);
-		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.ScreenshotPipeline[presentShader].get());
-		cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.PipelineLayout.get(), 0, DescriptorSets->GetPresentSet());
+		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->GetScreenshotPipeline());
+		cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.PipelineLayout.get(), 0, DescriptorSets->GetPresentSet(GetPresentLutIndex()));
 		cmdbuffer->pushConstants(RenderPasses->Present.PipelineLayout.get(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PresentPushConstants), &pushconstants);
 		cmdbuffer->draw(6, 1, 0, 0);
 
@@ -1638,7 +1861,7 @@ void UVulkanRenderDevice::ReadPixels(FColor* Pixels)
 	}
 
 	// Convert from rgba16f to bgra8 using the GPU:
-	auto srcimage = Textures->Scene->PPImage[GammaCorrectScreenshots ? 1 : 0].get();
+	auto srcimage = GammaCorrectScreenshots ? Textures->Scene->PPImage[1].get() : Textures->Scene->GetOutputImage();
 
 	int w = Viewport->SizeX;
 	int h = Viewport->SizeY;
@@ -1714,7 +1937,7 @@ void UVulkanRenderDevice::EndFlash()
 		vec2 zero2(0.0f);
 		ivec4 zero4(0);
 
-		DrawBatch(Commands->GetDrawCommands());
+		DrawBatch();
 		pushconstants.objectToProjection = mat4::identity();
 		pushconstants.nearClip = vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -1742,7 +1965,7 @@ void UVulkanRenderDevice::EndFlash()
 			UseVertices(4, 6);
 		}
 
-		DrawBatch(Commands->GetDrawCommands());
+		DrawBatch();
 		if (CurrentFrame)
 			SetSceneNode(CurrentFrame);
 	}
@@ -1753,8 +1976,10 @@ void UVulkanRenderDevice::SetSceneNode(FSceneNode* Frame)
 {
 	guardSlow(UVulkanRenderDevice::SetSceneNode);
 
-	auto commands = Commands->GetDrawCommands();
-	DrawBatch(commands);
+	if (Recorder)
+		Recorder->SetSceneNode(Frame, Viewport->Actor->FovAngle);
+
+	DrawBatch();
 
 	CurrentFrame = Frame;
 	Aspect = Frame->FY / Frame->FX;
@@ -1762,14 +1987,18 @@ void UVulkanRenderDevice::SetSceneNode(FSceneNode* Frame)
 	RFX2 = 2.0f * RProjZ / Frame->FX;
 	RFY2 = 2.0f * RProjZ * Aspect / Frame->FY;
 
+	// The frame is in output pixels while the scene may be rendered at a lower resolution
+	float scaleX = Textures->Scene->Width / (float)Textures->Scene->OutputWidth;
+	float scaleY = Textures->Scene->Height / (float)Textures->Scene->OutputHeight;
+
 	viewportdesc = {};
-	viewportdesc.x = Frame->XB;
-	viewportdesc.y = Frame->YB;
-	viewportdesc.width = Frame->X;
-	viewportdesc.height = Frame->Y;
+	viewportdesc.x = Frame->XB * scaleX;
+	viewportdesc.y = Frame->YB * scaleY;
+	viewportdesc.width = Frame->X * scaleX;
+	viewportdesc.height = Frame->Y * scaleY;
 	viewportdesc.minDepth = 0.1f;
 	viewportdesc.maxDepth = 1.0f;
-	commands->setViewport(0, 1, &viewportdesc);
+	Commands->GetDrawCommands()->setViewport(0, 1, &viewportdesc);
 
 	pushconstants.objectToProjection = mat4::frustum(-RProjZ, RProjZ, -Aspect * RProjZ, Aspect * RProjZ, 1.0f, 32768.0f, handedness::left, clipzrange::zero_positive_w);
 	pushconstants.nearClip = vec4(Frame->NearClip.X, Frame->NearClip.Y, Frame->NearClip.Z, Frame->NearClip.W);
@@ -1792,68 +2021,79 @@ void UVulkanRenderDevice::ClearTextureCache()
 	Uploads->ClearCache();
 }
 
+void UVulkanRenderDevice::InvalidateTextureCache()
+{
+	// Gamma is applied by the present pass and never baked into textures. Keep them and only redo those whose source changed.
+	DescriptorSets->ClearCache();
+	Textures->InvalidateCache();
+}
+
 void UVulkanRenderDevice::BlitSceneToPostprocess()
 {
 	auto buffers = Textures->Scene.get();
 	auto cmdbuffer = Commands->GetDrawCommands();
 
-	PipelineBarrier barrer0;
-	VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	barrer0.AddImage(
-		buffers->ColorBuffer.get(),
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		VK_ACCESS_TRANSFER_READ_BIT);
-	if (HitData)
+	if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		// The scene render pass already resolved into the post process image and hit buffer
+		PipelineBarrier barrier;
+		barrier.AddImage(
+			buffers->PPImage[0].get(),
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT);
+		if (HitData)
+		{
+			barrier.AddImage(
+				buffers->PPHitBuffer.get(),
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_ACCESS_TRANSFER_READ_BIT);
+		}
+		barrier.Execute(
+			cmdbuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (HitData ? VK_PIPELINE_STAGE_TRANSFER_BIT : 0));
+	}
+	else
 	{
+		PipelineBarrier barrer0;
+		VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		barrer0.AddImage(
-			buffers->HitBuffer.get(),
+			buffers->ColorBuffer.get(),
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 			VK_ACCESS_TRANSFER_READ_BIT);
+		if (HitData)
+		{
+			barrer0.AddImage(
+				buffers->HitBuffer.get(),
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_ACCESS_TRANSFER_READ_BIT);
+			barrer0.AddImage(
+				buffers->PPHitBuffer.get(),
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_ACCESS_TRANSFER_READ_BIT,
+				VK_ACCESS_TRANSFER_WRITE_BIT);
+			srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
 		barrer0.AddImage(
-			buffers->PPHitBuffer.get(),
+			buffers->PPImage[0].get(),
 			VK_IMAGE_LAYOUT_UNDEFINED,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_ACCESS_TRANSFER_READ_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 			VK_ACCESS_TRANSFER_WRITE_BIT);
-		srcStageMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	barrer0.AddImage(
-		buffers->PPImage[0].get(),
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		VK_ACCESS_TRANSFER_WRITE_BIT);
-	barrer0.Execute(
-		Commands->GetDrawCommands(),
-		srcStageMask,
-		VK_PIPELINE_STAGE_TRANSFER_BIT);
+		barrer0.Execute(
+			cmdbuffer,
+			srcStageMask,
+			VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-	if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
-	{
-		VkImageResolve resolve = {};
-		resolve.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		resolve.srcSubresource.layerCount = 1;
-		resolve.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		resolve.dstSubresource.layerCount = 1;
-		resolve.extent = { (uint32_t)buffers->ColorBuffer->width, (uint32_t)buffers->ColorBuffer->height, 1 };
-		cmdbuffer->resolveImage(
-			buffers->ColorBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			buffers->PPImage[0]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &resolve);
-		if (HitData)
-		{
-			cmdbuffer->resolveImage(
-				buffers->HitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				buffers->PPHitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1, &resolve);
-		}
-	}
-	else
-	{
 		auto colorBuffer = buffers->ColorBuffer.get();
 		VkImageBlit blit = {};
 		blit.srcOffsets[0] = { 0, 0, 0 };
@@ -1881,36 +2121,38 @@ void UVulkanRenderDevice::BlitSceneToPostprocess()
 				buffers->PPHitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				1, &copy);
 		}
-	}
 
-	PipelineBarrier barrier1;
-	barrier1.AddImage(
-		buffers->PPImage[0].get(),
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_SHADER_READ_BIT);
-	if (HitData)
-	{
+		PipelineBarrier barrier1;
 		barrier1.AddImage(
-			buffers->PPHitBuffer.get(),
+			buffers->PPImage[0].get(),
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT);
+			VK_ACCESS_SHADER_READ_BIT);
+		if (HitData)
+		{
+			barrier1.AddImage(
+				buffers->PPHitBuffer.get(),
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_ACCESS_TRANSFER_READ_BIT);
+		}
+		barrier1.Execute(
+			cmdbuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (HitData ? VK_PIPELINE_STAGE_TRANSFER_BIT : 0));
 	}
-	barrier1.Execute(
-		Commands->GetDrawCommands(),
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		HitData ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
 	if (HitData)
 	{
 		VkBufferImageCopy copy = {};
 		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		copy.imageSubresource.layerCount = 1;
-		copy.imageOffset = { (int32_t)Viewport->HitX, (int32_t)Viewport->HitY, (int32_t)0 };
-		copy.imageExtent = { (uint32_t)Viewport->HitXL, (uint32_t)Viewport->HitYL, (uint32_t)1 };
+		int x, y, width, height;
+		GetSceneHitRect(x, y, width, height);
+		copy.imageOffset = { (int32_t)x, (int32_t)y, (int32_t)0 };
+		copy.imageExtent = { (uint32_t)width, (uint32_t)height, (uint32_t)1 };
 		cmdbuffer->copyImageToBuffer(buffers->PPHitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffers->StagingHitBuffer->buffer, 1, &copy);
 
 		PipelineBarrier()
@@ -1919,6 +2161,41 @@ void UVulkanRenderDevice::BlitSceneToPostprocess()
 	}
 }
 
+void UVulkanRenderDevice::GetSceneHitRect(int& x, int& y, int& width, int& height)
+{
+	// Map the hit rectangle from output pixels to scene pixels, covering at least one pixel
+	int x1 = (int)std::ceil((Viewport->HitX + Viewport->HitXL) * (float)Textures->Scene->Width / Textures->Scene->OutputWidth);
+	int y1 = (int)std::ceil((Viewport->HitY + Viewport->HitYL) * (float)Textures->Scene->Height / Textures->Scene->OutputHeight);
+	x = clamp((int)(Viewport->HitX * (float)Textures->Scene->Width / Textures->Scene->OutputWidth), 0, Textures->Scene->Width - 1);
+	y = clamp((int)(Viewport->HitY * (float)Textures->Scene->Height / Textures->Scene->OutputHeight), 0, Textures->Scene->Height - 1);
+	width = clamp(x1, x + 1, Textures->Scene->Width) - x;
+	height = clamp(y1, y + 1, Textures->Scene->Height) - y;
+}
+
+void UVulkanRenderDevice::RunUpscalePass()
+{
+	auto buffers = Textures->Scene.get();
+	auto cmdbuffer = Commands->GetDrawCommands();
+
+	UpscalePushConstants pushconstants;
+	pushconstants.InputSize = vec2((float)buffers->Width, (float)buffers->Height);
+	pushconstants.OutputSize = vec2((float)buffers->OutputWidth, (float)buffers->OutputHeight);
+	pushconstants.Sharpness = clamp((float)VkUpscaleSharpness, 0.0f, 1.0f);
+
+	PipelineBarrier()
+		.AddImage(buffers->UpscaleImage.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Upscale.Pipeline.get());
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Upscale.PipelineLayout.get(), 0, DescriptorSets->GetUpscaleSet());
+	cmdbuffer->pushConstants(RenderPasses->Upscale.PipelineLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpscalePushConstants), &pushconstants);
+	cmdbuffer->dispatch((buffers->OutputWidth + 7) / 8, (buffers->OutputHeight + 7) / 8, 1);
+
+	PipelineBarrier()
+		.AddImage(buffers->UpscaleImage.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
 void UVulkanRenderDevice::RunBloomPass()
 {
 	float blurAmount = 0.6f + BloomAmount * (1.9f / 255.0f);
@@ -1926,158 +2203,59 @@ void UVulkanRenderDevice::RunBloomPass()
 	ComputeBlurSamples(7, blurAmount, pushconstants.SampleWeights);
 
 	auto cmdbuffer = Commands->GetDrawCommands();
+	auto& levels = Textures->Scene->BloomBlurLevels;
 
-	PipelineBarrier()
-		.AddImage(Textures->Scene->BloomBlurLevels[0].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-	// Extract overbright pixels that we want to bloom:
-	BloomStep(cmdbuffer,
-		RenderPasses->Bloom.Extract.get(),
-		DescriptorSets->GetBloomPPImageSet(),
-		Framebuffers->BloomBlurLevels[0].VTextureFB.get(),
-		Textures->Scene->BloomBlurLevels[0].Width,
-		Textures->Scene->BloomBlurLevels[0].Height,
-		pushconstants);
-
-	// Blur and downscale:
-	for (int i = 0; i < NumBloomLevels - 1; i++)
-	{
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		// Gaussian blur
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurVertical.get(),
-			DescriptorSets->GetBloomVTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].HTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
-
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurHorizontal.get(),
-			DescriptorSets->GetBloomHTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].VTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
+	PipelineBarrier barrier0;
+	barrier0.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	for (int i = 0; i < NumBloomLevels; i++)
+		barrier0.AddImage(levels[i].Texture.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	barrier0.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i + 1].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		// Linear downscale
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.Scale.get(),
-			DescriptorSets->GetBloomVTextureSet(i),
-			Framebuffers->BloomBlurLevels[i + 1].VTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i + 1].Width,
-			Textures->Scene->BloomBlurLevels[i + 1].Height,
-			pushconstants);
+	// Extract overbright pixels that we want to bloom, then blur and downscale:
+	for (int i = 0; i < NumBloomLevels; i++)
+	{
+		if (i > 0)
+			BloomBarrier(cmdbuffer);
+		BloomStep(cmdbuffer, i == 0 ? RenderPasses->Bloom.Extract.get() : RenderPasses->Bloom.Blur.get(), DescriptorSets->GetBloomDownSet(i), levels[i].Width, levels[i].Height, pushconstants);
 	}
 
 	// Blur and upscale:
-	for (int i = NumBloomLevels - 1; i >= 0; i--)
+	for (int i = NumBloomLevels - 2; i >= 0; i--)
 	{
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		// Gaussian blur
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurVertical.get(),
-			DescriptorSets->GetBloomVTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].HTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
-
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurHorizontal.get(),
-			DescriptorSets->GetBloomHTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].VTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
-
-		// Linear upscale
-		if (i > 0)
-		{
-			PipelineBarrier()
-				.AddImage(Textures->Scene->BloomBlurLevels[i - 1].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-				.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-				.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-			BloomStep(cmdbuffer,
-				RenderPasses->Bloom.Scale.get(),
-				DescriptorSets->GetBloomVTextureSet(i),
-				Framebuffers->BloomBlurLevels[i - 1].VTextureFB.get(),
-				Textures->Scene->BloomBlurLevels[i - 1].Width,
-				Textures->Scene->BloomBlurLevels[i - 1].Height,
-				pushconstants);
-		}
+		BloomBarrier(cmdbuffer);
+		BloomStep(cmdbuffer, RenderPasses->Bloom.Blur.get(), DescriptorSets->GetBloomUpSet(i), levels[i].Width, levels[i].Height, pushconstants);
 	}
 
 	PipelineBarrier()
-		.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-		.AddImage(Textures->Scene->BloomBlurLevels[0].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+		.AddImage(levels[0].Texture.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
 	// Add bloom back to frame post process texture:
-	BloomStep(cmdbuffer,
-		RenderPasses->Bloom.Combine.get(),
-		DescriptorSets->GetBloomVTextureSet(0),
-		Framebuffers->PPImageFB[0].get(),
-		Textures->Scene->Width,
-		Textures->Scene->Height,
-		pushconstants);
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.Combine.get());
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.PipelineLayout.get(), 0, DescriptorSets->GetBloomCombineSet());
+	cmdbuffer->dispatch((Textures->Scene->Width + 7) / 8, (Textures->Scene->Height + 7) / 8, 1);
 
 	PipelineBarrier()
-		.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 }
 
-void UVulkanRenderDevice::BloomStep(VulkanCommandBuffer* cmdbuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* input, VulkanFramebuffer* output, int width, int height, const BloomPushConstants& pushconstants)
+void UVulkanRenderDevice::BloomStep(VulkanCommandBuffer* cmdbuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* set, int width, int height, const BloomPushConstants& pushconstants)
 {
-	RenderPassBegin()
-		.RenderPass(pipeline != RenderPasses->Bloom.Combine.get() ? RenderPasses->Postprocess.RenderPass.get() : RenderPasses->Postprocess.RenderPassCombine.get())
-		.Framebuffer(output)
-		.RenderArea(0, 0, width, height)
-		.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
-		.Execute(cmdbuffer);
-
-	VkViewport viewport = {};
-	viewport.width = (float)width;
-	viewport.height = (float)height;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.extent.width = width;
-	scissor.extent.height = height;
-
-	cmdbuffer->setViewport(0, 1, &viewport);
-	cmdbuffer->setScissor(0, 1, &scissor);
-	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Bloom.PipelineLayout.get(), 0, input);
-	cmdbuffer->pushConstants(RenderPasses->Bloom.PipelineLayout.get(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BloomPushConstants), &pushconstants);
-	cmdbuffer->draw(6, 1, 0, 0);
+	// Each workgroup blurs a 16x16 tile of the output level
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.PipelineLayout.get(), 0, set);
+	cmdbuffer->pushConstants(RenderPasses->Bloom.PipelineLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &pushconstants);
+	cmdbuffer->dispatch((width + 15) / 16, (height + 15) / 16, 1);
+}
 
-	cmdbuffer->endRenderPass();
+void UVulkanRenderDevice::BloomBarrier(VulkanCommandBuffer* cmdbuffer)
+{
+	// The next step reads the level just written and overwrites a level an earlier step read
+	PipelineBarrier()
+		.AddMemory(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
 float UVulkanRenderDevice::ComputeBlurGaussian(float n, float theta) // theta = Blur Amount
@@ -2107,10 +2285,23 @@ void UVulkanRenderDevice::ComputeBlurSamples(int sampleCount, float blurAmount,
 	}
 }
 
-PresentPushConstants UVulkanRenderDevice::GetPresentPushConstants()
+PresentPushConstants UVulkanRenderDevice::GetPresentPushConstants(bool hdr)
 {
 	PresentPushConstants pushconstants;
+	pushconstants.LutMaxValue = GetPresentLutPushConstants(hdr).LutMaxValue;
+	pushconstants.LutSize = (float)TextureManager::PresentLutSize;
+	pushconstants.Dither = hdr ? 0 : 1;
+	pushconstants.Padding = 0;
+	return pushconstants;
+}
+
+PresentLutPushConstants UVulkanRenderDevice::GetPresentLutPushConstants(bool hdr)
+{
+	PresentLutPushConstants pushconstants = {};
 	pushconstants.HdrScale = 0.8f + HdrScale * (3.0f / 255.0f);
+	pushconstants.LutMaxValue = hdr ? 16.0f : 4.0f;
+	pushconstants.GammaMode = GammaMode == 1 ? 1 : 0;
+	pushconstants.HdrMode = hdr ? 1 : 0;
 	if (Viewport->IsOrtho())
 	{
 		pushconstants.GammaCorrection = { 1.0f };
@@ -2160,20 +2351,52 @@ PresentPushConstants UVulkanRenderDevice::GetPresentPushConstants()
 			pushconstants.Brightness = (128 - LinearBrightness) / 128.0f * -1.8f;
 		}
 	}
+
+	bool colorCorrect = pushconstants.Brightness != 0.0f || pushconstants.Contrast != 1.0f || pushconstants.Saturation != 1.0f;
+	pushconstants.ColorCorrectMode = colorCorrect ? Clamp(GrayFormula, 0, 2) + 1 : 0;
 	return pushconstants;
 }
 
-void UVulkanRenderDevice::DrawPresentTexture(int width, int height)
+int UVulkanRenderDevice::GetPresentLutIndex()
+{
+	// Ortho viewports have their own LUT, as they don't use the color settings
+	return Viewport->IsOrtho() ? 1 : 0;
+}
+
+void UVulkanRenderDevice::UpdatePresentLut(bool hdr)
 {
-	PresentPushConstants pushconstants = GetPresentPushConstants();
+	// Only rebake the LUT when the color settings actually changed
+	int lut = GetPresentLutIndex();
+	PresentLutPushConstants pushconstants = GetPresentLutPushConstants(hdr);
+	if (PresentLutValid[lut] && memcmp(&PresentLutSettings[lut], &pushconstants, sizeof(PresentLutPushConstants)) == 0)
+		return;
 
-	bool ActiveHdr = (Commands->SwapChain->Format().colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT) ? 1 : 0;
+	PresentLutSettings[lut] = pushconstants;
+	PresentLutValid[lut] = true;
+
+	auto cmdbuffer = Commands->GetDrawCommands();
+	int groups = (TextureManager::PresentLutSize + 3) / 4;
+
+	PipelineBarrier()
+		.AddImage(Textures->PresentLut[lut].get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Present.LutPipeline.get());
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Present.LutPipelineLayout.get(), 0, DescriptorSets->GetPresentLutSet(lut));
+	cmdbuffer->pushConstants(RenderPasses->Present.LutPipelineLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PresentLutPushConstants), &pushconstants);
+	cmdbuffer->dispatch(groups, groups, groups);
+
+	PipelineBarrier()
+		.AddImage(Textures->PresentLut[lut].get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+void UVulkanRenderDevice::DrawPresentTexture(int width, int height)
+{
+	bool ActiveHdr = (Commands->GetPresentFormat().colorSpace == VK_COLOR_SPACE_EXTENDED_SRGB_LINEAR_EXT) ? 1 : 0;
 
-	// Select present shader based on what the user is actually using
-	int presentShader = 0;
-	if (ActiveHdr) presentShader |= 1;
-	if (GammaMode == 1) presentShader |= 2;
-	if (pushconstants.Brightness != 0.0f || pushconstants.Contrast != 1.0f || pushconstants.Saturation != 1.0f) presentShader |= (Clamp(GrayFormula, 0, 2) + 1) << 2;
+	UpdatePresentLut(ActiveHdr);
+	PresentPushConstants pushconstants = GetPresentPushConstants(ActiveHdr);
 
 	float scale = std::min(width / (float)Viewport->SizeX, height / (float)Viewport->SizeY);
 	int letterboxWidth = (int)std::round(Viewport->SizeX * scale);
@@ -2198,24 +2421,24 @@ void UVulkanRenderDevice::DrawPresentTexture(int width, int height)
 	auto cmdbuffer = Commands->GetDrawCommands();
 
 	PipelineBarrier()
-		.AddImage(Commands->SwapChain->GetImage(Commands->PresentImageIndex), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+		.AddImage(Commands->GetPresentImage(Commands->PresentImageIndex), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
 		.Execute(cmdbuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 
 	RenderPassBegin()
 		.RenderPass(RenderPasses->Present.RenderPass.get())
 		.Framebuffer(Framebuffers->GetSwapChainFramebuffer())
-		.RenderArea(0, 0, Commands->SwapChain->Width(), Commands->SwapChain->Height())
+		.RenderArea(0, 0, Commands->GetPresentWidth(), Commands->GetPresentHeight())
 		.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
 		.Execute(cmdbuffer);
 	cmdbuffer->setViewport(0, 1, &viewport);
 	cmdbuffer->setScissor(0, 1, &scissor);
-	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.Pipeline[presentShader].get());
-	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.PipelineLayout.get(), 0, DescriptorSets->GetPresentSet());
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->GetPresentPipeline());
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.PipelineLayout.get(), 0, DescriptorSets->GetPresentSet(GetPresentLutIndex()));
 	cmdbuffer->pushConstants(RenderPasses->Present.PipelineLayout.get(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PresentPushConstants), &pushconstants);
 	cmdbuffer->draw(6, 1, 0, 0);
 	cmdbuffer->endRenderPass();
 
 	PipelineBarrier()
-		.AddImage(Commands->SwapChain->GetImage(Commands->PresentImageIndex), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0)
+		.AddImage(Commands->GetPresentImage(Commands->PresentImageIndex), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, Commands->IsHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0)
 		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 }
@@ -2,6 +2,7 @@
 
 #include "CommandBufferManager.h"
 #include "BufferManager.h"
+#include "CallRecorder.h"
 #include "DescriptorSetManager.h"
 #include "FramebufferManager.h"
 #include "RenderPassManager.h"
@@ -9,6 +10,7 @@
 #include "ShaderManager.h"
 #include "TextureManager.h"
 #include "UploadManager.h"
+#include "VertexStream.h"
 #include "vec.h"
 #include "mat.h"
 
@@ -64,6 +66,7 @@ public:
 	void DrawGouraudTriangles(const FSceneNode* Frame, const FTextureInfo& Info, FTransTexture* const Pts, INT NumPts, DWORD PolyFlags, DWORD DataFlags, FSpanBuffer* Span) override;
 	UBOOL SupportsTextureFormat(ETextureFormat Format) override;
 	void UpdateTextureRect(FTextureInfo& Info, INT U, INT V, INT UL, INT VL) override;
+	void DrawTileList(const FSceneNode* Frame, const FTextureInfo& Info, const FTileRect* Tiles, INT NumTiles, FSpanBuffer* Span, FLOAT Z, FPlane Color, FPlane Fog, DWORD PolyFlags) override;
 #endif
 
 	int InterfacePadding[64]; // For allowing URenderDeviceOldUnreal469 interface to add things
@@ -86,6 +89,8 @@ public:
 	std::unique_ptr<RenderPassManager> RenderPasses;
 	std::unique_ptr<FramebufferManager> Framebuffers;
 
+	std::unique_ptr<CallRecorder> Recorder;
+
 	// Configuration.
 	BITFIELD UseVSync;
 	FLOAT GammaOffset;
@@ -112,20 +117,31 @@ public:
 	INT VkDeviceIndex;
 	BITFIELD VkDebug;
 	BITFIELD VkExclusiveFullscreen;
+	BITFIELD VkHeadless;
+	FLOAT VkRenderScale;
+	FLOAT VkUpscaleSharpness;
+	BYTE VkVertexStreaming;
 
 	void RunBloomPass();
-	void BloomStep(VulkanCommandBuffer* cmdbuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* input, VulkanFramebuffer* output, int width, int height, const BloomPushConstants &pushconstants);
+	void BloomStep(VulkanCommandBuffer* cmdbuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* set, int width, int height, const BloomPushConstants& pushconstants);
+	void BloomBarrier(VulkanCommandBuffer* cmdbuffer);
 	static float ComputeBlurGaussian(float n, float theta);
 	static void ComputeBlurSamples(int sampleCount, float blurAmount, float* sampleWeights);
+	void RunUpscalePass();
 
 	void DrawPresentTexture(int width, int height);
-	PresentPushConstants GetPresentPushConstants();
+	PresentPushConstants GetPresentPushConstants(bool hdr);
+	PresentLutPushConstants GetPresentLutPushConstants(bool hdr);
+	int GetPresentLutIndex();
+	void UpdatePresentLut(bool hdr);
 
 	struct
 	{
 		int ComplexSurfaces = 0;
 		int GouraudPolygons = 0;
 		int Tiles = 0;
+		int Lines = 0;
+		int Points = 0;
 		int DrawCalls = 0;
 		int Uploads = 0;
 		int RectUploads = 0;
@@ -142,9 +158,18 @@ public:
 		}
 	}
 
-private:
+	int GetSettingsSceneSize(int outputSize)
+	{
+		float scale = clamp((float)VkRenderScale, 0.25f, 1.0f);
+		return std::max((int)std::round(outputSize * scale), 1);
+	}
+
 	void ClearTextureCache();
+
+private:
+	void InvalidateTextureCache();
 	void BlitSceneToPostprocess();
+	void GetSceneHitRect(int& x, int& y, int& width, int& height);
 
 	struct VertexReserveInfo
 	{
@@ -165,17 +190,46 @@ private:
 			FlushDrawBatchAndWait();
 		}
 
-		return { Buffers->SceneVertices + SceneVertexPos, Buffers->SceneIndexes + SceneIndexPos, (uint32_t)SceneVertexPos };
+		// Vertices are assembled in cached scratch memory. UseVertices copies them into the mapped buffers.
+		if (VertexScratch.size() < vcount) VertexScratch.resize(vcount);
+		if (IndexScratch.size() < icount) IndexScratch.resize(icount);
+
+		return { VertexScratch.data(), IndexScratch.data(), (uint32_t)SceneVertexPos };
 	}
 
 	void FlushDrawBatchAndWait();
+	void RecreateSceneBuffers(BYTE streamingMode);
 
 	void UseVertices(size_t vcount, size_t icount)
 	{
+		CopyToMapped(Buffers->SceneVertices + SceneVertexPos, VertexScratch.data(), vcount * sizeof(SceneVertex), Buffers->SceneMemoryCached);
+		CopyToMapped(Buffers->SceneIndexes + SceneIndexPos, IndexScratch.data(), icount * sizeof(uint32_t), Buffers->SceneMemoryCached);
 		SceneVertexPos += vcount;
 		SceneIndexPos += icount;
 	}
 
+	TileInstance* ReserveTiles(size_t count)
+	{
+		if (TileInstancePos + count > (size_t)BufferManager::TileInstanceBufferSize)
+		{
+			if (count > (size_t)BufferManager::TileInstanceBufferSize)
+				return nullptr;
+
+			FlushDrawBatchAndWait();
+		}
+
+		if (TileScratch.size() < count) TileScratch.resize(count);
+		return TileScratch.data();
+	}
+
+	void UseTiles(size_t count)
+	{
+		CopyToMapped(Buffers->TileInstances + TileInstancePos, TileScratch.data(), count * sizeof(TileInstance), Buffers->SceneMemoryCached);
+		TileInstancePos += count;
+	}
+
+	void BindSceneBuffers(VulkanCommandBuffer* cmdbuffer);
+
 	VkViewport viewportdesc = {};
 
 	UBOOL UsePrecache;
@@ -192,14 +246,37 @@ private:
 	void SetPipeline(PipelineState* pipeline);
 	ivec4 GetTextureIndexes(DWORD PolyFlags, CachedTexture* tex, bool clamp = false);
 	ivec4 GetTextureIndexes(DWORD PolyFlags, CachedTexture* tex, CachedTexture* lightmap, CachedTexture* macrotex, CachedTexture* detailtex);
-	void DrawBatch(VulkanCommandBuffer* cmdbuffer);
+	void DrawBatch();
 	void SubmitAndWait(bool present, int presentWidth, int presentHeight, bool presentFullscreen);
 
 	vec4 ApplyInverseGamma(vec4 color);
 
+	struct
+	{
+		float Gamma[3] = { 0.0f, 0.0f, 0.0f };
+		vec4 Input = vec4(0.0f);
+		vec4 Output = vec4(0.0f);
+		bool Valid = false;
+	} InverseGammaCache;
+
+	// Editor lines and points are collected here and written to the scene buffers in one go when anything else is drawn
+	SceneVertex* AddLineVertices(PipelineState* pipeline, bool points, size_t count);
+	void FlushLineBatch();
+
+	struct
+	{
+		PipelineState* Pipeline = nullptr;
+		bool Points = false;
+		size_t VertexCount = 0;
+		std::vector<SceneVertex> Vertices;
+	} LineBatch;
+
+	static const size_t MaxLineBatchVertices = 64 * 1024;
+
 	struct
 	{
 		size_t SceneIndexStart = 0;
+		size_t TileInstanceStart = 0;
 		PipelineState* Pipeline = nullptr;
 	} Batch;
 
@@ -207,6 +284,11 @@ private:
 
 	size_t SceneVertexPos = 0;
 	size_t SceneIndexPos = 0;
+	size_t TileInstancePos = 0;
+
+	std::vector<SceneVertex> VertexScratch = std::vector<SceneVertex>(1024);
+	std::vector<uint32_t> IndexScratch = std::vector<uint32_t>(3072);
+	std::vector<TileInstance> TileScratch = std::vector<TileInstance>(256);
 
 	struct HitQuery
 	{
@@ -223,6 +305,10 @@ private:
 	int ForceHitIndex = -1;
 	HitQuery ForceHit;
 
+	// Settings each present LUT was last baked with
+	PresentLutPushConstants PresentLutSettings[2] = {};
+	bool PresentLutValid[2] = {};
+
 #ifdef WIN32
 	struct
 	{
@@ -238,13 +324,33 @@ private:
 
 inline void UVulkanRenderDevice::SetPipeline(PipelineState* pipeline)
 {
+	if (LineBatch.VertexCount != 0)
+		FlushLineBatch();
+
 	if (pipeline != Batch.Pipeline)
 	{
-		DrawBatch(Commands->GetDrawCommands());
+		DrawBatch();
 		Batch.Pipeline = pipeline;
 	}
 }
 
+inline SceneVertex* UVulkanRenderDevice::AddLineVertices(PipelineState* pipeline, bool points, size_t count)
+{
+	if (pipeline != LineBatch.Pipeline || LineBatch.VertexCount + count > MaxLineBatchVertices)
+	{
+		FlushLineBatch();
+		LineBatch.Pipeline = pipeline;
+		LineBatch.Points = points;
+	}
+
+	if (LineBatch.Vertices.size() < LineBatch.VertexCount + count)
+		LineBatch.Vertices.resize(MaxLineBatchVertices);
+
+	SceneVertex* vptr = LineBatch.Vertices.data() + LineBatch.VertexCount;
+	LineBatch.VertexCount += count;
+	return vptr;
+}
+
 inline ivec4 UVulkanRenderDevice::GetTextureIndexes(DWORD PolyFlags, CachedTexture* tex, bool clamp)
 {
 	return ivec4(DescriptorSets->GetTextureArrayIndex(PolyFlags, tex, clamp), 0, 0, 0);
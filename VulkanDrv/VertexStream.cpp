@@ -0,0 +1,133 @@
+
+#include "Precomp.h"
+#include "VertexStream.h"
+#include "ShaderManager.h"
+#include <chrono>
+
+namespace
+{
+	const size_t BenchVertexCount = 16384;
+	const size_t BenchScratchVertices = 256;
+	const int BenchPasses = 64;
+
+	// Fills vertices one field at a time, like the draw functions do
+	void WriteVertices(SceneVertex* vertex, size_t count, size_t first)
+	{
+		ivec4 textureBinds(1, 2, 3, 4);
+		for (size_t i = 0; i < count; i++)
+		{
+			float f = (float)(first + i);
+			vertex->Flags = 16;
+			vertex->Position.x = f;
+			vertex->Position.y = f + 1.0f;
+			vertex->Position.z = f + 2.0f;
+			vertex->TexCoord.s = f * 0.5f;
+			vertex->TexCoord.t = f * 0.25f;
+			vertex->TexCoord2.s = 0.0f;
+			vertex->TexCoord2.t = 0.0f;
+			vertex->TexCoord3.s = 0.0f;
+			vertex->TexCoord3.t = 0.0f;
+			vertex->TexCoord4.s = 0.0f;
+			vertex->TexCoord4.t = 0.0f;
+			vertex->Color.r = 1.0f;
+			vertex->Color.g = 1.0f;
+			vertex->Color.b = 1.0f;
+			vertex->Color.a = 1.0f;
+			vertex->TextureBinds = textureBinds;
+			vertex++;
+		}
+	}
+
+	double WriteDirect(SceneVertex* mapped)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < BenchPasses; pass++)
+			WriteVertices(mapped, BenchVertexCount, pass);
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double WriteStreamed(SceneVertex* mapped, SceneVertex* scratch)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < BenchPasses; pass++)
+		{
+			for (size_t i = 0; i < BenchVertexCount; i += BenchScratchVertices)
+			{
+				WriteVertices(scratch, BenchScratchVertices, pass + i);
+				StreamCopy(mapped + i, scratch, BenchScratchVertices * sizeof(SceneVertex));
+			}
+		}
+		StreamFence();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double WriteCopied(SceneVertex* mapped, SceneVertex* scratch)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int pass = 0; pass < BenchPasses; pass++)
+		{
+			for (size_t i = 0; i < BenchVertexCount; i += BenchScratchVertices)
+			{
+				WriteVertices(scratch, BenchScratchVertices, pass + i);
+				memcpy(mapped + i, scratch, BenchScratchVertices * sizeof(SceneVertex));
+			}
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void RunVertexWriteBenchmark(VulkanDevice* device, FOutputDevice& Ar)
+{
+	const VkPhysicalDeviceMemoryProperties& memory = device->PhysicalDevice.Properties.Memory;
+	uint32_t cachedTypes = 0;
+	uint32_t uncachedTypes = 0;
+	for (uint32_t i = 0; i < memory.memoryTypeCount; i++)
+	{
+		VkMemoryPropertyFlags flags = memory.memoryTypes[i].propertyFlags;
+		if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
+				cachedTypes |= 1 << i;
+			else
+				uncachedTypes |= 1 << i;
+		}
+	}
+
+	std::vector<SceneVertex> scratch(BenchScratchVertices);
+	size_t size = BenchVertexCount * sizeof(SceneVertex);
+	double megabytes = size * (double)BenchPasses / (1024.0 * 1024.0);
+
+	for (int cached = 1; cached >= 0; cached--)
+	{
+		const TCHAR* name = cached ? TEXT("cached") : TEXT("write-combined");
+		uint32_t types = cached ? cachedTypes : uncachedTypes;
+		if (types == 0)
+		{
+			Ar.Logf(TEXT("VkBenchVertices: no %s host visible memory type"), name);
+			continue;
+		}
+
+		try
+		{
+			auto buffer = BufferBuilder()
+				.Usage(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_UNKNOWN, VMA_ALLOCATION_CREATE_MAPPED_BIT)
+				.MemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, cached ? 0 : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, types)
+				.Size(size)
+				.DebugName("VertexBenchmarkBuffer")
+				.Create(device);
+
+			SceneVertex* mapped = (SceneVertex*)buffer->Map(0, size);
+			WriteDirect(mapped); // Warm up page mappings
+			double direct = WriteDirect(mapped);
+			double streamed = WriteStreamed(mapped, scratch.data());
+			double copied = WriteCopied(mapped, scratch.data());
+			buffer->Unmap();
+
+			Ar.Logf(TEXT("VkBenchVertices: %s memory: direct %.0f MB/s, scratch + stream %.0f MB/s, scratch + memcpy %.0f MB/s"), name, megabytes / direct, megabytes / streamed, megabytes / copied);
+		}
+		catch (const std::exception&)
+		{
+			Ar.Logf(TEXT("VkBenchVertices: could not allocate %s memory"), name);
+		}
+	}
+}
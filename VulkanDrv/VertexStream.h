@@ -0,0 +1,75 @@
+#pragma once
+
+#ifdef USE_SSE2
+#include <emmintrin.h>
+#endif
+
+class VulkanDevice;
+
+// Copies into a mapped buffer that may be uncached write-combined memory.
+// Full 16 byte non-temporal stores fill complete write-combining lines instead of issuing scattered partial writes.
+inline void StreamCopy(void* dst, const void* src, size_t size)
+{
+#ifdef USE_SSE2
+	uint8_t* d = (uint8_t*)dst;
+	const uint8_t* s = (const uint8_t*)src;
+
+	size_t head = std::min((size_t)((16 - ((uintptr_t)d & 15)) & 15), size);
+	if (head)
+	{
+		memcpy(d, s, head);
+		d += head;
+		s += head;
+		size -= head;
+	}
+
+	while (size >= 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+		_mm_stream_si128((__m128i*)d, a);
+		_mm_stream_si128((__m128i*)(d + 16), b);
+		_mm_stream_si128((__m128i*)(d + 32), c);
+		_mm_stream_si128((__m128i*)(d + 48), e);
+		d += 64;
+		s += 64;
+		size -= 64;
+	}
+
+	while (size >= 16)
+	{
+		_mm_stream_si128((__m128i*)d, _mm_loadu_si128((const __m128i*)s));
+		d += 16;
+		s += 16;
+		size -= 16;
+	}
+
+	if (size)
+		memcpy(d, s, size);
+#else
+	memcpy(dst, src, size);
+#endif
+}
+
+// Makes the streamed stores visible before the GPU is told to read them
+inline void StreamFence()
+{
+#ifdef USE_SSE2
+	_mm_sfence();
+#endif
+}
+
+// Copies scratch memory into a mapped scene buffer.
+// Cached mappings take plain stores: non-temporal stores would evict lines the next frame writes again.
+inline void CopyToMapped(void* dst, const void* src, size_t size, bool cached)
+{
+	if (cached)
+		memcpy(dst, src, size);
+	else
+		StreamCopy(dst, src, size);
+}
+
+// Compares writing vertices field by field against scratch assembly plus StreamCopy or memcpy, on cached and uncached host mappings
+void RunVertexWriteBenchmark(VulkanDevice* device, FOutputDevice& Ar);
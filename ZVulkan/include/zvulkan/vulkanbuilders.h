@@ -122,6 +122,7 @@ public:
 	ImageBuilder& Type(VkImageType type);
 	ImageBuilder& Flags(VkImageCreateFlags flags);
 	ImageBuilder& Size(int width, int height, int miplevels = 1, int arrayLayers = 1);
+	ImageBuilder& Depth(int depth);
 	ImageBuilder& Samples(VkSampleCountFlagBits samples);
 	ImageBuilder& Format(VkFormat format);
 	ImageBuilder& Usage(VkImageUsageFlags imageUsage, VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY, VmaAllocationCreateFlags allocFlags = 0);
@@ -393,8 +394,9 @@ public:
 
 	GraphicsPipelineBuilder& AddVertexShader(VulkanShader *shader);
 	GraphicsPipelineBuilder& AddFragmentShader(VulkanShader *shader);
+	GraphicsPipelineBuilder& AddConstant(uint32_t constantID, uint32_t value);
 
-	GraphicsPipelineBuilder& AddVertexBufferBinding(int index, size_t stride);
+	GraphicsPipelineBuilder& AddVertexBufferBinding(int index, size_t stride, VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX);
 	GraphicsPipelineBuilder& AddVertexAttribute(int location, int binding, VkFormat format, size_t offset);
 
 	GraphicsPipelineBuilder& AddDynamicState(VkDynamicState state);
@@ -421,6 +423,9 @@ private:
 	std::vector<VkVertexInputBindingDescription> vertexInputBindings;
 	std::vector<VkVertexInputAttributeDescription> vertexInputAttributes;
 	std::vector<VkDynamicState> dynamicStates;
+	std::vector<VkSpecializationMapEntry> constantEntries;
+	std::vector<uint32_t> constantValues;
+	VkSpecializationInfo specializationInfo = {};
 
 	VulkanPipelineCache* cache = nullptr;
 	const char* debugName = nullptr;
@@ -476,6 +481,7 @@ public:
 	RenderPassBuilder& AddSubpass();
 	RenderPassBuilder& AddSubpassColorAttachmentRef(uint32_t index, VkImageLayout layout);
 	RenderPassBuilder& AddSubpassDepthStencilAttachmentRef(uint32_t index, VkImageLayout layout);
+	RenderPassBuilder& AddSubpassResolveAttachmentRef(uint32_t index, VkImageLayout layout);
 
 	RenderPassBuilder& DebugName(const char* name) { debugName = name; return *this; }
 
@@ -491,6 +497,7 @@ private:
 	struct SubpassData
 	{
 		std::vector<VkAttachmentReference> colorRefs;
+		std::vector<VkAttachmentReference> resolveRefs;
 		VkAttachmentReference depthRef = { };
 	};
 
@@ -297,6 +297,12 @@ ImageBuilder& ImageBuilder::Size(int width, int height, int mipLevels, int array
 	return *this;
 }
 
+ImageBuilder& ImageBuilder::Depth(int depth)
+{
+	imageInfo.extent.depth = depth;
+	return *this;
+}
+
 ImageBuilder& ImageBuilder::Samples(VkSampleCountFlagBits samples)
 {
 	imageInfo.samples = samples;
@@ -1097,12 +1103,23 @@ GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddFragmentShader(VulkanShader
 	return *this;
 }
 
-GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddVertexBufferBinding(int index, size_t stride)
+GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddConstant(uint32_t constantID, uint32_t value)
+{
+	VkSpecializationMapEntry entry = {};
+	entry.constantID = constantID;
+	entry.offset = (uint32_t)(constantValues.size() * sizeof(uint32_t));
+	entry.size = sizeof(uint32_t);
+	constantEntries.push_back(entry);
+	constantValues.push_back(value);
+	return *this;
+}
+
+GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddVertexBufferBinding(int index, size_t stride, VkVertexInputRate inputRate)
 {
 	VkVertexInputBindingDescription desc = {};
 	desc.binding = index;
 	desc.stride = (uint32_t)stride;
-	desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	desc.inputRate = inputRate;
 	vertexInputBindings.push_back(desc);
 
 	vertexInputInfo.vertexBindingDescriptionCount = (uint32_t)vertexInputBindings.size();
@@ -1139,6 +1156,16 @@ std::unique_ptr<VulkanPipeline> GraphicsPipelineBuilder::Create(VulkanDevice* de
 	colorBlending.pAttachments = colorBlendAttachments.data();
 	colorBlending.attachmentCount = (uint32_t)colorBlendAttachments.size();
 
+	if (!constantEntries.empty())
+	{
+		specializationInfo.mapEntryCount = (uint32_t)constantEntries.size();
+		specializationInfo.pMapEntries = constantEntries.data();
+		specializationInfo.dataSize = constantValues.size() * sizeof(uint32_t);
+		specializationInfo.pData = constantValues.data();
+		for (VkPipelineShaderStageCreateInfo& stage : shaderStages)
+			stage.pSpecializationInfo = &specializationInfo;
+	}
+
 	VkPipeline pipeline = 0;
 	VkResult result = vkCreateGraphicsPipelines(device->device, cache ? cache->cache : VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
 	CheckVulkanError(result, "Could not create graphics pipeline");
@@ -1327,6 +1354,17 @@ RenderPassBuilder& RenderPassBuilder::AddSubpassDepthStencilAttachmentRef(uint32
 	return *this;
 }
 
+RenderPassBuilder& RenderPassBuilder::AddSubpassResolveAttachmentRef(uint32_t index, VkImageLayout layout)
+{
+	VkAttachmentReference resolveAttachmentRef = {};
+	resolveAttachmentRef.attachment = index;
+	resolveAttachmentRef.layout = layout;
+
+	subpassData.back()->resolveRefs.push_back(resolveAttachmentRef);
+	subpasses.back().pResolveAttachments = subpassData.back()->resolveRefs.data();
+	return *this;
+}
+
 std::unique_ptr<VulkanRenderPass> RenderPassBuilder::Create(VulkanDevice* device)
 {
 	VkRenderPass renderPass = 0;